@@ -32,6 +32,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "main.h"     /* for getval() */
 #include "usbhid-ups.h"
@@ -42,7 +43,7 @@
 #include "modbustypes.h"
 #include <math.h>
 
-#define APC_HID_VERSION "APC MODBUS over HID 0.1"
+#define APC_HID_VERSION "APC MODBUS over HID 0.2"
 
 #define APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL 2
 
@@ -58,55 +59,63 @@ int get_UPS_outlets_group_num() {
 int CheckModbusEnable(usb_dev_handle_t udev, USBDevice_t *hd) {
 	upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::CheckModbusEnable...");
 	uint16_t regnum = 0;
-	uint8_t *reg = ModbusReadRegister(udev, hd->MODBUSID, regnum, 2);
-	if (reg == NULL) {
+	uint8_t reg[2 * sizeof(uint16_t)];
+
+	if (!ModbusReadRegister(udev, hd->MODBUSID, regnum, 2, reg)) {
 		return 0;
 	}
-	free(reg);
 	return 1;
 }
 
+/* Registers are read through the register image cache of libmodbus, so
+ * that the items sharing registers (or adjacent registers) are served by
+ * a single transaction per update. */
+
+static bool		mb_ranges_added = false;
+static unsigned int	mb_cycle = 0;	/* update cycle of mb_reads */
+static unsigned int	mb_reads = 0;	/* ModbusReadCount() when it started */
+
+/* declare the registers used by the mapping table */
+static void mb_add_ranges(void)
+{
+	hid_info_t	*item;
+
+	for (item = apc_modbus_hid_subdriver.hid2nut; item->info_type != NULL; item++) {
+		if (item->hidflags & HU_FLAG_MODBUS)
+			ModbusCacheAddRange(item->mbregID, item->mbregLEN);
+	}
+
+	mb_ranges_added = true;
+}
+
+/* number of MODBUS transactions during the current update cycle */
+unsigned int MBGetTransactions(void)
+{
+	return (mb_cycle == reportbuf->cycle) ? ModbusReadCount() - mb_reads : 0;
+}
+
 int MBGetDataValue(hid_dev_handle_t udev, hid_info_t *hidups_item, double *Value, int age) {
 	upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. reg=%u, nregs=%u, NUTCMD: %s, datatype = %u", hidups_item->mbregID, hidups_item->mbregLEN, hidups_item->info_type, hidups_item->datatype);
-	uint8_t *reg = ModbusReadRegister(udev, DEFAULT_SLAVE_ADDR, hidups_item->mbregID, hidups_item->mbregLEN);
-	upsdebug_hex(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. ModbusReadRegister return buffer", reg, hidups_item->mbregLEN * sizeof(uint16_t));
+	const uint8_t *reg;
 
-	if (reg == NULL) {
-		return 0;
+	if (!mb_ranges_added) {
+		mb_add_ranges();
 	}
-	switch (decodeDT(hidups_item->datatype)) {
-		case 1: {			//DT_BINARYPOINT
-			uint8_t nbytes = hidups_item->mbregLEN * sizeof(uint16_t);
-			uint64_t v = BE2LE(reg, nbytes);
-			uint8_t scale = 9;
 
-			upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. DT_BINARYPOINT");
-			if (scaleDT(hidups_item->datatype, &scale))
-			{
-				upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. DT_BINARYPOINT. Signed. scale= %u", scale);
-				// Sign extend
-				int64_t sint = v;
-				sint <<= (8 * (sizeof(v) - nbytes));
-				sint >>= (8 * (sizeof(v) - nbytes));
-				*Value = (double)sint / (1ULL << scale);
-			}
-			else
-			{
-				upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. DT_BINARYPOINT. UnSigned. scale= %u", scale);
-				*Value = (double)v / (1ULL << scale);
-			}
-			break; 
-		}
-		case 2: break;		//DT_ENUMERATION
-		case 3: break;		//DT_STRING
-		case 0:				//DT_BITFIELD
-		default: {
-			uint64_t v = BE2LE(reg, hidups_item->mbregLEN * sizeof(uint16_t));
-			upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. DT_BITFIELD. value= 0x%08x", v);
-			*Value = (double)v;
-		}
+	if (mb_cycle != reportbuf->cycle) {
+		mb_cycle = reportbuf->cycle;
+		mb_reads = ModbusReadCount();
+		ModbusCacheNewCycle();
 	}
-	free(reg);
+
+	reg = ModbusCacheRead(udev, DEFAULT_SLAVE_ADDR, hidups_item->mbregID, hidups_item->mbregLEN, age);
+
+	if (reg == NULL) {
+		return 0;
+	}
+	upsdebug_hex(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. registers", reg, hidups_item->mbregLEN * sizeof(uint16_t));
+	MBDecodeValue(hidups_item->datatype, reg, hidups_item->mbregLEN, Value);
+	upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::MBGetDataValue. datatype = %u, value = %f", hidups_item->datatype, *Value);
 	return 1;
 }
 
@@ -213,6 +222,64 @@ static usb_device_id_t apc_usb_device_table[] = {
 	{ -1, -1, NULL }
 };
 
+/* apc_hid2nut, followed by the registers of smt_info[] that the HID
+ * reports don't provide */
+static void apc_build_hid2nut(void)
+{
+	static hid_info_t	*hid2nut = NULL;
+	hid_info_t	*item;
+	smt_info_t	*mb;
+	size_t		nhid = 0, nmb = 0;
+
+	if (hid2nut != NULL)
+		return;
+
+	for (item = apc_hid2nut; item->info_type != NULL; item++)
+		nhid++;
+
+	for (mb = smt_info; mb->info_type != NULL; mb++)
+		nmb++;
+
+	/* the terminating entry comes from xcalloc() */
+	hid2nut = xcalloc(nhid + nmb + 1, sizeof(*hid2nut));
+	memcpy(hid2nut, apc_hid2nut, nhid * sizeof(*hid2nut));
+
+	for (item = hid2nut + nhid, mb = smt_info; mb->info_type != NULL; mb++) {
+
+		if (mb->flags & (SMT_FLAG_STATIC | SMT_FLAG_STATUS | SMT_FLAG_NOHID))
+			continue;
+
+		item->info_type = mb->info_type;
+		item->info_flags = mb->info_flags;
+		item->info_len = mb->info_len;
+		item->hidpath = "UPS.APCModbusRTUTx";
+		item->hidflags = HU_FLAG_MODBUS;
+		item->hid2info = mb->lookup;
+		item->mbregID = mb->reg;
+		item->mbregLEN = mb->nregs;
+		item->datatype = mb->datatype;
+		item->Command = mb->command;
+
+		if (mb->flags & SMT_FLAG_CMD) {
+			/* value of the command, unused by MBSetDataValue() */
+			item->dfl = "0";
+			item->hidflags |= HU_TYPE_CMD;
+		} else {
+			item->dfl = mb->dfl;
+		}
+
+		if (mb->flags & SMT_FLAG_OUTLET_CMD)
+			item->Command |= BF_OUTLETCOMMAND_USBPORT;
+
+		if (mb->flags & SMT_FLAG_QUICK_POLL)
+			item->hidflags |= HU_FLAG_QUICK_POLL;
+
+		item++;
+	}
+
+	apc_modbus_hid_subdriver.hid2nut = hid2nut;
+}
+
 int apc_claim(HIDDevice_t *hd) {
 
 	upsdebugx(APC_MODBUS_HID_MESSAGES_DEBUG_LEVEL, "apc-hid::apc_claim...");
@@ -229,12 +296,14 @@ int apc_claim(HIDDevice_t *hd) {
 		case POSSIBLY_SUPPORTED:
 			/* by default, reject, unless the productid option is given */
 			if (getval("productid")) {
+				apc_build_hid2nut();
 				return 1;
 			}
 			possibly_supported("APC", hd);
 			return 0;
 
 		case SUPPORTED:
+			apc_build_hid2nut();
 			return 1;
 
 		case NOT_SUPPORTED:
@@ -44,6 +44,7 @@ extern subdriver_t apc_modbus_hid_subdriver;
 extern int max_report_size;
 int MBGetDataValue(hid_dev_handle_t udev, hid_info_t *hidups_item, double *Value, int age);
 int MBSetDataValue(hid_dev_handle_t udev, hid_info_t	*hidups_item, double Value);
+unsigned int MBGetTransactions(void);
 int CheckModbusEnable(usb_dev_handle_t udev, USBDevice_t *hd);
 int get_UPS_outlets_group_num();
 
@@ -160,83 +161,7 @@ static hid_info_t apc_hid2nut[] = {
 	{ "BOOL", 0, 0, "UPS.PowerSummary.PresentStatus.NeedReplacement", NULL, NULL, 0, replacebatt_info },
 	{ "BOOL", 0, 0, "UPS.PowerSummary.PresentStatus.RemainingTimeLimitExpired", NULL, NULL, 0, timelimitexpired_info },
 
-// Be very careful in case if change variable names. Check usbhid-ups::instcmd
-	{ "outlet.1.load.off", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USBPORT  },
-	{ "outlet.1.load.off.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.1.load.on", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.1.load.on.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.1.load.on.coldboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USBPORT | BF_OUTLETCOMMAND_COLDBOOTALLOWED },
-	{ "outlet.1.load.reboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.1.load.shutdown", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.1.load.canceloperation", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	
-	{ "outlet.2.load.off", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.off.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.on", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.on.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.on.coldboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT | BF_OUTLETCOMMAND_COLDBOOTALLOWED },
-	{ "outlet.2.load.reboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.shutdown", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "outlet.2.load.canceloperation", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-
-	{ "load.off", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.off.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.on", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.on.delay", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.on.coldboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT | BF_OUTLETCOMMAND_COLDBOOTALLOWED },
-	{ "load.reboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.shutdown", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-	{ "load.canceloperation", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_USBPORT },
-
-	{ "outlet.1.delay.shutdown", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1034, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "outlet.1.delay.start", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1035, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "outlet.1.delay.stayoff", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1036, 2, DT_BINARYPOINT_S0, 0x0 },
-
-	{ "outlet.2.delay.shutdown", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1039, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "outlet.2.delay.start", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f",  HU_FLAG_MODBUS, NULL, 1040, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "outlet.2.delay.stayoff", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1041, 2, DT_BINARYPOINT_S0, 0x0 },
-
-	{ "ups.delay.shutdown", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1029, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "ups.delay.start", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1030, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "ups.delay.stayoff", ST_FLAG_RW, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL, 1031, 2, DT_BINARYPOINT_S0, 0x0 },
-
-// Be very careful in case if change variable names. Check usbhid-ups::instcmd
-
-	//{ "shutdown.stayoff", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1538, 2, DT_BITFIELD, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 | BF_OUTLETCOMMAND_USBPORT },
-	//{ "shutdown.return", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1540, 1, DT_BITFIELD, BF_SIMPLESIGNALINGCOMMAND_REQUESTSHUTDOWN },
-	{ "shutdown.reboot", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1540, 1, DT_BITFIELD, BF_SIMPLESIGNALINGCOMMAND_REQUESTSHUTDOWN },
-	{ "shutdown.stop", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1540, 1, DT_BITFIELD, BF_SIMPLESIGNALINGCOMMAND_REQUESTSHUTDOWN },
-
-	{ "test.battery.start.deep", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1542, 1, DT_BITFIELD, BF_RUNTIMECALIBRATIONCOMMAND_START },
-	{ "test.battery.start.quick", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1541, 1, DT_BITFIELD, BF_RUNTIMECALIBRATIONCOMMAND_START },
-	{ "test.battery.stop", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_TYPE_CMD, NULL, 1542, 1, DT_BITFIELD, BF_RUNTIMECALIBRATIONCOMMAND_ABORT },
-
-	{ "ups.test.result", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS, apc_smt_MB_runtimecalibrationstatus_bw, 23, 1, DT_BITFIELD, 0x0 },
-	{ "ups.test.result.deep", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS, apc_smt_MB_runtimecalibrationstatus_bw, 24, 1, DT_BITFIELD, 0x0 },
-	{ "ups.test.result.quick", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS, apc_smt_MB_runtimecalibrationstatus_bw, 23, 1, DT_BITFIELD, 0x0 },
-	{ "ups.test.result.runtimecalibration", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS, apc_smt_MB_runtimecalibrationstatus, 24, 1, DT_BITFIELD, 0x0 },
-	{ "ups.test.result.battery", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS, apc_smt_MB_runtimecalibrationstatus, 23, 1, DT_BITFIELD, 0x0 },
-
-	{ "outlet.1.status", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, apc_smt_MB_outletstatus_bw, 6, 2, DT_BITFIELD, 0x0 },
-	{ "outlet.2.status", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, apc_smt_MB_outletstatus_bw, 9, 2, DT_BITFIELD, 0x0 },
-	{ "outlet.1.status.native", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, apc_smt_MB_outletstatus, 6, 2, DT_BITFIELD, 0x0 },
-	{ "outlet.2.status.native", 0, 0, "UPS.APCModbusRTUTx", NULL, "0", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, apc_smt_MB_outletstatus, 9, 2, DT_BITFIELD, 0x0 },
-
-	// /*
-	{ "output.voltage", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.2f", HU_FLAG_MODBUS, NULL,142, 1, DT_BINARYPOINT_U6, 0x0 },
-	{ "output.current", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.2f", HU_FLAG_MODBUS, NULL,140, 1, DT_BINARYPOINT_U5, 0x0 },
-	{ "output.frequency", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.2f", HU_FLAG_MODBUS, NULL,144, 1, DT_BINARYPOINT_U7, 0x0  },
-
-	{ "ups.realpower", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL,136, 1, DT_BINARYPOINT_U8, 0x0 },
-
-	{ "input.voltage", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.2f", HU_FLAG_MODBUS, NULL,151, 1, DT_BINARYPOINT_U6, 0x0 },
-	
-	{ "battery.temperature", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.2f", HU_FLAG_MODBUS, NULL,135, 1, DT_BINARYPOINT_S7, 0x0 },
-	{ "battery.runtime", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS, NULL,128, 2, DT_BINARYPOINT_U0, 0x0  },
-
-	{ "ups.timer.shutdown", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, NULL, 155, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "ups.timer.start", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, NULL, 156, 1, DT_BINARYPOINT_S0, 0x0 },
-	{ "ups.timer.stayoff", 0, 0, "UPS.APCModbusRTUTx", NULL, "%.0f", HU_FLAG_MODBUS | HU_FLAG_QUICK_POLL, NULL, 157, 2, DT_BINARYPOINT_S0, 0x0 },
+	/* the MODBUS registers of smt_info[] are appended at runtime, see apc_build_hid2nut() */
 
 	/* end of structure. */
 	{ NULL, 0, 0, NULL, NULL, NULL, 0, NULL }
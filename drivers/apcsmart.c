@@ -46,6 +46,9 @@ upsdrv_info_t upsdrv_info = {
 
 static int ups_status = 0;
 
+/* number of variables queried at once by update_info() */
+static int pollbatch = 1;
+
 /* some forwards */
 
 static int sdcmd_S(const void *);
@@ -79,9 +82,63 @@ static int (*sdlist[])(const void *) = {
  * is 1:n and n:1 nut <-> apc mappings, which are not determined prior to the
  * detection
  */
+static apc_vartab_t *vt_bychar[256];
+static apc_vartab_t *vt_byname[APC_VT_HASH];
+static int vt_indexed = 0;
+
+static unsigned int vt_hash_name(const char *name)
+{
+	unsigned int h = 5381;
+
+	while (*name)
+		h = (h * 33) ^ (unsigned char)tolower((unsigned char)*name++);
+
+	return h & (APC_VT_HASH - 1);
+}
+
+/*
+ * once deprecate_vars() has settled which variable is used for each
+ * command character and NUT name, index them: alerts, caps and setvars then
+ * don't have to scan apc_vartab; the first present entry wins, as with the
+ * scan
+ */
+static void vt_index(void)
+{
+	unsigned int	h;
+	int	i;
+	apc_vartab_t *vt;
+
+	memset(vt_bychar, 0, sizeof(vt_bychar));
+	memset(vt_byname, 0, sizeof(vt_byname));
+
+	for (i = 0; apc_vartab[i].name != NULL; i++) {
+		vt = &apc_vartab[i];
+		if (!(vt->flags & APC_PRESENT))
+			continue;
+
+		if (!vt_bychar[(unsigned char)vt->cmd])
+			vt_bychar[(unsigned char)vt->cmd] = vt;
+
+		for (h = vt_hash_name(vt->name); vt_byname[h]; h = (h + 1) & (APC_VT_HASH - 1))
+			if (!strcasecmp(vt_byname[h]->name, vt->name))
+				break;
+		if (!vt_byname[h])
+			vt_byname[h] = vt;
+	}
+
+	vt_indexed = 1;
+}
+
 static apc_vartab_t *vt_lookup_char(char cmdchar)
 {
 	int	i;
+	apc_vartab_t *vt;
+
+	if (vt_indexed) {
+		vt = vt_bychar[(unsigned char)cmdchar];
+		/* variables found unsupported later are not removed from the index */
+		return vt && (vt->flags & APC_PRESENT) ? vt : NULL;
+	}
 
 	for (i = 0; apc_vartab[i].name != NULL; i++)
 		if ((apc_vartab[i].flags & APC_PRESENT) &&
@@ -93,7 +150,16 @@ static apc_vartab_t *vt_lookup_char(char cmdchar)
 
 static apc_vartab_t *vt_lookup_name(const char *var)
 {
+	unsigned int	h;
 	int	i;
+	apc_vartab_t *vt;
+
+	if (vt_indexed) {
+		for (h = vt_hash_name(var); (vt = vt_byname[h]); h = (h + 1) & (APC_VT_HASH - 1))
+			if (!strcasecmp(vt->name, var))
+				return (vt->flags & APC_PRESENT) ? vt : NULL;
+		return NULL;
+	}
 
 	for (i = 0; apc_vartab[i].name != NULL; i++)
 		if ((apc_vartab[i].flags & APC_PRESENT) &&
@@ -114,20 +180,66 @@ static const char *prtchr(char x)
 	return info + curr;
 }
 
+/*
+ * the regexes used by rexhlp() are compiled on first use and kept; the ones
+ * from the tables are compiled by rexhlp_init() already
+ */
+static struct {
+	const char	*rex;
+	regex_t		mbuf;
+} rexcache[APC_REX_MAX];
+static int rexcnt = 0;
+
+static regex_t *rexhlp_get(const char *rex)
+{
+	int i, ret;
+	char err[APC_SBUF * 4];
+
+	for (i = 0; i < rexcnt; i++)
+		if (rexcache[i].rex == rex || !strcmp(rexcache[i].rex, rex))
+			return &rexcache[i].mbuf;
+
+	if (rexcnt == APC_REX_MAX)
+		fatx("too many regexes, increase APC_REX_MAX");
+
+	ret = regcomp(&rexcache[rexcnt].mbuf, rex, REG_EXTENDED|REG_NOSUB);
+	if (ret) {
+		regerror(ret, &rexcache[rexcnt].mbuf, err, sizeof(err));
+		fatx("invalid regex [%s]: %s", rex, err);
+	}
+	rexcache[rexcnt].rex = rex;
+
+	return &rexcache[rexcnt++].mbuf;
+}
+
 static int rexhlp(const char *rex, const char *val)
 {
 	static const char *empty = "";
-	int ret;
-	regex_t mbuf;
 
 	if (!rex || !*rex)
 		return 1;
 	if (!val)
 		val = empty;
-	regcomp(&mbuf, rex, REG_EXTENDED|REG_NOSUB);
-	ret = regexec(&mbuf, val, 0, 0, 0);
-	regfree(&mbuf);
-	return !ret;
+	return !regexec(rexhlp_get(rex), val, 0, 0, 0);
+}
+
+static void rexhlp_init(void)
+{
+	int i;
+
+	for (i = 0; apc_vartab[i].name != NULL; i++)
+		if (apc_vartab[i].regex && *apc_vartab[i].regex)
+			rexhlp_get(apc_vartab[i].regex);
+
+	for (i = 0; apc_cmdtab[i].name != NULL; i++)
+		if (apc_cmdtab[i].ext && *apc_cmdtab[i].ext)
+			rexhlp_get(apc_cmdtab[i].ext);
+}
+
+static void rexhlp_free(void)
+{
+	while (rexcnt > 0)
+		regfree(&rexcache[--rexcnt].mbuf);
 }
 
 /* convert APC formatting to NUT formatting */
@@ -336,7 +448,7 @@ static void apc_ser_set(void)
 	tio.c_cc[VEOL2] = _POSIX_VDISABLE;
 #endif
 
-	if (tcflush(upsfd, TCIOFLUSH))
+	if (ser_flush_io(upsfd))
 		fate("tcflush(%s)", device_path);
 
 	/*
@@ -429,9 +541,18 @@ static void alert_handler(char ch)
 	ups_status_set();
 }
 
+/*
+ * what the UPS sent after the end of the line read last; with several
+ * queries sent at once, these are the next answers
+ */
+static char	apc_pending[APC_LBUF];
+static size_t	apc_pending_len = 0;
+
 /*
  * we need a tiny bit different processing due to '*' and canonical mode; the
- * function is subtly different from generic ser_get_line_alert()
+ * function is subtly different from generic ser_get_line_alert(); as with
+ * ser_get_line_next(), what follows the end of the line is kept for the next
+ * call
  */
 #define apc_read(b, l, f) apc_read_i(b, l, f, __func__, __LINE__)
 static int apc_read_i(char *buf, size_t buflen, int flags, const char *fn, unsigned int ln)
@@ -474,7 +595,13 @@ static int apc_read_i(char *buf, size_t buflen, int flags, const char *fn, unsig
 
 	while (count < buflen - 1) {
 		errno = 0;
-		ret = select_read(upsfd, temp, sizeof(temp), sec, usec);
+		if (apc_pending_len) {
+			/* what was read already goes first */
+			memcpy(temp, apc_pending, apc_pending_len);
+			ret = apc_pending_len;
+			apc_pending_len = 0;
+		} else
+			ret = select_read(upsfd, temp, sizeof(temp), sec, usec);
 
 		/* partial timeout (non-canon only paranoid check) */
 		if (ret == 0 && count) {
@@ -509,11 +636,14 @@ static int apc_read_i(char *buf, size_t buflen, int flags, const char *fn, unsig
 			/* overflow read */
 			if (count == buflen - 1) {
 				ser_comm_fail("serial port read overflow: %u(%s)", ln, fn);
-				tcflush(upsfd, TCIFLUSH);
+				ser_flush_in(upsfd, "", 0);
+				apc_pending_len = 0;
 				return -1;
 			}
 			/* standard "line received" condition */
 			if (temp[i] == ENDCHAR) {
+				apc_pending_len = ret - i - 1;
+				memcpy(apc_pending, temp + i + 1, apc_pending_len);
 				ser_comm_good();
 				return count;
 			}
@@ -653,7 +783,8 @@ static void apc_flush(int flags)
 		/* TODO */
 		while(apc_read(temp, sizeof(temp), SER_D0|SER_TO|SER_AA) > 0);
 	} else {
-		tcflush(upsfd, TCIOFLUSH);
+		ser_flush_io(upsfd);
+		apc_pending_len = 0;
 		/* tcflush(upsfd, TCIFLUSH); */
 		/* while(apc_read(temp, sizeof(temp), SER_D0|SER_TO)); */
 	}
@@ -760,32 +891,48 @@ static const char *preread_data(apc_vartab_t *vt)
 	return temp;
 }
 
-static int poll_data(apc_vartab_t *vt)
+/*
+ * query cnt variables at once: the UPS answers each command character with
+ * one line, in order, so all of them are sent before reading the answers
+ */
+static int poll_batch(apc_vartab_t **vts, int cnt)
 {
 	char temp[APC_LBUF];
-
-	if (!(vt->flags & APC_PRESENT))
-		return 1;
-
-	debx(1, "%s [%s]", vt->name, prtchr(vt->cmd));
+	apc_vartab_t *vt;
+	int i;
 
 	apc_flush(SER_AA);
-	if (apc_write(vt->cmd) != 1)
-		return 0;
-	if (apc_read(temp, sizeof(temp), SER_AA) < 1)
-		return 0;
+	for (i = 0; i < cnt; i++) {
+		debx(1, "%s [%s]", vts[i]->name, prtchr(vts[i]->cmd));
+		if (apc_write(vts[i]->cmd) != 1)
+			return 0;
+	}
 
-	/* automagically no longer supported by the hardware somehow */
-	if (!strcmp(temp, "NA")) {
-		logx(LOG_WARNING, "verified variable %s [%s] returned NA, removing", vt->name, prtchr(vt->cmd));
-		vt->flags &= ~APC_PRESENT;
-		apc_dstate_delinfo(vt, 0);
-	} else
-		apc_dstate_setinfo(vt, temp);
+	for (i = 0; i < cnt; i++) {
+		vt = vts[i];
+		if (apc_read(temp, sizeof(temp), SER_AA) < 1)
+			return 0;
+
+		/* automagically no longer supported by the hardware somehow */
+		if (!strcmp(temp, "NA")) {
+			logx(LOG_WARNING, "verified variable %s [%s] returned NA, removing", vt->name, prtchr(vt->cmd));
+			vt->flags &= ~APC_PRESENT;
+			apc_dstate_delinfo(vt, 0);
+		} else
+			apc_dstate_setinfo(vt, temp);
+	}
 
 	return 1;
 }
 
+static int poll_data(apc_vartab_t *vt)
+{
+	if (!(vt->flags & APC_PRESENT))
+		return 1;
+
+	return poll_batch(&vt, 1);
+}
+
 static int update_status(void)
 {
 	int	ret;
@@ -911,6 +1058,8 @@ static void deprecate_vars(void)
 
 		confirm_cv(vt->cmd, "variable combination", vt->name);
 	}
+
+	vt_index();
 }
 
 static void apc_getcaps(int qco)
@@ -1660,18 +1809,31 @@ void upsdrv_shutdown(void)
 
 static int update_info(int all)
 {
-	int i;
+	apc_vartab_t *vts[APC_BATCH_MAX];
+	int i, cnt = 0;
 
 	debx(1, "starting scan%s", all ? " (all vars)" : "");
 
 	for (i = 0; apc_vartab[i].name != NULL; i++) {
 		if (!all && (apc_vartab[i].flags & APC_POLL) == 0)
 			continue;
+		if (!(apc_vartab[i].flags & APC_PRESENT))
+			continue;
 
-		if (!poll_data(&apc_vartab[i])) {
+		vts[cnt++] = &apc_vartab[i];
+		if (cnt < pollbatch)
+			continue;
+
+		if (!poll_batch(vts, cnt)) {
 			debx(1, "aborting scan");
 			return 0;
 		}
+		cnt = 0;
+	}
+
+	if (cnt && !poll_batch(vts, cnt)) {
+		debx(1, "aborting scan");
+		return 0;
 	}
 
 	debx(1, "scan completed");
@@ -2006,6 +2168,7 @@ void upsdrv_makevartable(void)
 	addvar(VAR_VALUE, "sdtype", "simple shutdown method");
 	addvar(VAR_VALUE, "advorder", "advanced shutdown control");
 	addvar(VAR_VALUE, "cshdelay", "CS hack delay");
+	addvar(VAR_VALUE, "pollbatch", "number of variables queried at once");
 }
 
 void upsdrv_help(void)
@@ -2042,6 +2205,14 @@ void upsdrv_initups(void)
 			fatalx(EXIT_FAILURE, "invalid value (%s) for option 'cshdelay'", val);
 	}
 
+	/* sanitize pollbatch */
+	if ((val = getval("pollbatch"))) {
+		if (!rexhlp(APC_BATCHFMT, val) || (pollbatch = atoi(val)) < 1 || pollbatch > APC_BATCH_MAX)
+			fatalx(EXIT_FAILURE, "invalid value (%s) for option 'pollbatch'", val);
+	}
+
+	rexhlp_init();
+
 	upsfd = extrafd = ser_open(device_path);
 	apc_ser_set();
 
@@ -2054,6 +2225,8 @@ void upsdrv_cleanup(void)
 {
 	char temp[APC_LBUF];
 
+	rexhlp_free();
+
 	if (upsfd == -1)
 		return;
 
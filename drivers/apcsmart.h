@@ -24,7 +24,7 @@
 #define __apcsmart_h__
 
 #define DRIVER_NAME	"APC Smart protocol driver"
-#define DRIVER_VERSION	"3.1"
+#define DRIVER_VERSION	"3.2"
 
 #define ALT_CABLE_1 "940-0095B"
 
@@ -164,6 +164,14 @@
 /* cshdelay format */
 #define APC_CSHDFMT	"^([0-9]\\.?|[0-9]?\\.[0-9])$"
 
+/* pollbatch format, and the most variables queried at once */
+#define APC_BATCHFMT	"^[0-9]{1,2}$"
+#define APC_BATCH_MAX	16
+
+/* regexes compiled by rexhlp(), and size of the variables' name hash */
+#define APC_REX_MAX	16
+#define APC_VT_HASH	128
+
 /* error logging/debug related macros */
 
 #define fatx(fmt, ...) fatalx(EXIT_FAILURE, "%s: " fmt, __func__ , ## __VA_ARGS__)
@@ -498,11 +498,7 @@ static int belkin_std_open_tty(const char *device) {
 	
 	/* flush incoming data again, and read any remaining garbage
 	   bytes. There should not be any. */
-	r = tcflush(fd, TCIFLUSH);
-	if (r == -1) {
-		close(fd);
-		return -1;
-	}
+	ser_flush_in(fd, "", 0);
 	
 	r = read(fd, buf, 127);
 	if (r == -1 && errno != EAGAIN) {
@@ -54,6 +54,29 @@ typedef struct {
 	uint8_t		UsageSize;			/* Design number of usage used	*/
 } HIDParser_t;
 
+/*
+ * HIDIndex struct
+ *
+ * Lookup indexes of a parsed report descriptor, so that FindObject_with_Path
+ * and FindObject_with_ID don't need to scan all the items:
+ * - a trie of the items paths, where each node holds the first item (in
+ *   descriptor order) of each type whose path starts with the node path;
+ * - a hash table of the items, keyed on ReportID, Offset and Type.
+ * -------------------------------------------------------------------------- */
+typedef struct {
+	HIDNode_t	Usage;				/* Path component			*/
+	int		Child;				/* First child node, or -1		*/
+	int		Sibling;			/* Next sibling node, or -1		*/
+	int		First[3];			/* First item by type, or -1		*/
+} HIDTrieNode_t;
+
+struct HIDIndex_s {
+	HIDTrieNode_t	*Node;				/* Node[0] is the root (empty path)	*/
+	int		nnodes;				/* Number of nodes			*/
+	int		*ById;				/* Items numbers, -1 for empty slots	*/
+	unsigned int	IdMask;				/* Number of slots - 1 (power of 2)	*/
+};
+
 /* return 1 + the position of the leftmost "1" bit of an int, or 0 if
    none. */
 static inline unsigned int hibit(unsigned int x)
@@ -367,13 +390,53 @@ int FindObject(HIDDesc_t *pDesc, HIDData_t *pData)
 	return 1;
 }
 
+/* slot of Type in HIDTrieNode_t.First, or -1 if not an item type */
+static int TypeSlot(uint8_t Type)
+{
+	switch (Type)
+	{
+	case ITEM_INPUT:
+		return 0;
+	case ITEM_OUTPUT:
+		return 1;
+	case ITEM_FEATURE:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+static unsigned int HashID(uint8_t ReportID, uint8_t Offset, uint8_t Type)
+{
+	return (((unsigned int)ReportID << 16) | ((unsigned int)Type << 8) | Offset) * 2654435761u;
+}
+
 /*
  * FindObject_with_Path
  * Get pData item with given Path and Type. Return NULL if not found.
  * -------------------------------------------------------------------------- */
 HIDData_t *FindObject_with_Path(HIDDesc_t *pDesc, HIDPath_t *Path, uint8_t Type)
 {
-	int	i;
+	int	i, t = TypeSlot(Type);
+
+	if (pDesc->index && (t >= 0)) {
+		HIDTrieNode_t	*Node = pDesc->index->Node;
+		int		n = 0;
+
+		for (i = 0; i < Path->Size; i++) {
+			for (n = Node[n].Child; n >= 0; n = Node[n].Sibling) {
+				if (Node[n].Usage == Path->Node[i]) {
+					break;
+				}
+			}
+
+			if (n < 0) {
+				return NULL;
+			}
+		}
+
+		return (Node[n].First[t] < 0) ? NULL : &pDesc->item[Node[n].First[t]];
+	}
 
 	for (i = 0; i < pDesc->nitems; i++) {
 		HIDData_t *pData = &pDesc->item[i];
@@ -401,6 +464,21 @@ HIDData_t *FindObject_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset
 {
 	int	i;
 
+	if (pDesc->index) {
+		unsigned int	slot, mask = pDesc->index->IdMask;
+		int		*ById = pDesc->index->ById;
+
+		for (slot = HashID(ReportID, Offset, Type) & mask; ById[slot] >= 0; slot = (slot + 1) & mask) {
+			HIDData_t *pData = &pDesc->item[ById[slot]];
+
+			if ((pData->ReportID == ReportID) && (pData->Offset == Offset) && (pData->Type == Type)) {
+				return pData;
+			}
+		}
+
+		return NULL;
+	}
+
 	for (i = 0; i < pDesc->nitems; i++) {
 		HIDData_t *pData = &pDesc->item[i];
 		
@@ -543,6 +621,109 @@ void SetValue(const HIDData_t *pData, unsigned char *Buf, long Value)
 
 /* ---------------------------------------------------------------------- */
 
+static void Free_Index(struct HIDIndex_s *pIndex)
+{
+	if (!pIndex) {
+		return;
+	}
+
+	free(pIndex->Node);
+	free(pIndex->ById);
+	free(pIndex);
+}
+
+/* build the lookup indexes of a parsed report descriptor. Returns NULL
+   on failure, in which case lookups fall back to scanning the items. */
+static struct HIDIndex_s *Build_Index(HIDDesc_t *pDesc)
+{
+	struct HIDIndex_s	*pIndex;
+	int			i, j, n, t;
+	unsigned int		slot, size = 16;
+
+	pIndex = calloc(1, sizeof(*pIndex));
+	if (!pIndex) {
+		return NULL;
+	}
+
+	/* worst case: no common path prefix at all */
+	pIndex->Node = calloc(pDesc->nitems * PATH_SIZE + 1, sizeof(*pIndex->Node));
+
+	/* keep the load factor below 50% */
+	while (size < 2 * (unsigned int)pDesc->nitems) {
+		size <<= 1;
+	}
+
+	pIndex->ById = malloc(size * sizeof(*pIndex->ById));
+	pIndex->IdMask = size - 1;
+
+	if (!pIndex->Node || !pIndex->ById) {
+		Free_Index(pIndex);
+		return NULL;
+	}
+
+	memset(pIndex->Node[0].First, -1, sizeof(pIndex->Node[0].First));
+	pIndex->Node[0].Child = -1;
+	pIndex->Node[0].Sibling = -1;
+	pIndex->nnodes = 1;
+
+	for (slot = 0; slot < size; slot++) {
+		pIndex->ById[slot] = -1;
+	}
+
+	/* in descriptor order, so that the first matching item wins */
+	for (i = 0; i < pDesc->nitems; i++) {
+		HIDData_t	*pData = &pDesc->item[i];
+
+		t = TypeSlot(pData->Type);
+
+		if (t >= 0 && pIndex->Node[0].First[t] < 0) {
+			pIndex->Node[0].First[t] = i;
+		}
+
+		for (j = 0, n = 0; (j < pData->Path.Size) && (j < PATH_SIZE); j++) {
+			int	c;
+
+			for (c = pIndex->Node[n].Child; c >= 0; c = pIndex->Node[c].Sibling) {
+				if (pIndex->Node[c].Usage == pData->Path.Node[j]) {
+					break;
+				}
+			}
+
+			if (c < 0) {
+				/* new node, as first child of n */
+				c = pIndex->nnodes++;
+				pIndex->Node[c].Usage = pData->Path.Node[j];
+				pIndex->Node[c].Child = -1;
+				pIndex->Node[c].Sibling = pIndex->Node[n].Child;
+				memset(pIndex->Node[c].First, -1, sizeof(pIndex->Node[c].First));
+				pIndex->Node[n].Child = c;
+			}
+
+			n = c;
+
+			if (t >= 0 && pIndex->Node[n].First[t] < 0) {
+				pIndex->Node[n].First[t] = i;
+			}
+		}
+
+		for (slot = HashID(pData->ReportID, pData->Offset, pData->Type) & pIndex->IdMask; pIndex->ById[slot] >= 0; slot = (slot + 1) & pIndex->IdMask) {
+			HIDData_t	*pFound = &pDesc->item[pIndex->ById[slot]];
+
+			if ((pFound->ReportID == pData->ReportID) && (pFound->Offset == pData->Offset) && (pFound->Type == pData->Type)) {
+				break;
+			}
+		}
+
+		if (pIndex->ById[slot] < 0) {
+			pIndex->ById[slot] = i;
+		}
+	}
+
+	upsdebugx(5, "%s: %d items, %d path nodes", __func__, pDesc->nitems, pIndex->nnodes);
+
+	return pIndex;
+}
+
 /* parse HID Report Descriptor. Input: byte array ReportDesc[n].
    Output: parsed data structure. Returns allocated HIDDesc structure
    on success, NULL on failure with errno set. Note: the value
@@ -609,6 +790,8 @@ HIDDesc_t *Parse_ReportDesc(const unsigned char *ReportDesc, const int n)
 
 	pDesc->item = realloc(pDesc->item, pDesc->nitems * sizeof(*pDesc->item));
 
+	pDesc->index = Build_Index(pDesc);
+
 	return pDesc;
 }
 
@@ -619,6 +802,7 @@ void Free_ReportDesc(HIDDesc_t *pDesc)
 		return;
 	}
 
+	Free_Index(pDesc->index);
 	free(pDesc->item);
 	free(pDesc);
 }
@@ -143,6 +143,7 @@ typedef struct {
 	int		nitems;				/* number of items in descriptor */
 	HIDData_t	*item;				/* list of items			*/
 	int		replen[256];			/* list of report lengths, in byte */
+	struct HIDIndex_s	*index;			/* lookup indexes (see hidparser.c) */
 } HIDDesc_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,44 @@
+/* infolkp.h - lookup between device and NUT values
+ *
+ * Copyright (C)
+ *  2003-2009 Arnaud Quette <http://arnaud.quette.free.fr/contact.html>
+ *  2017    Dmitry Togushev <jtprofacc@gmain.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+/*
+ * The lookup tables of usbhid-ups, split out so that the SMT MODBUS
+ * register map (smtmodbus.c) can share them with smt-modbus, which is
+ * built without the USB headers.
+ */
+
+#ifndef INFOLKP_H
+#define INFOLKP_H
+
+/* --------------------------------------------------------------- */
+/* Struct & data for lookup between HID and NUT values             */
+/* (From USB/HID, Power Devices Class standard)                    */
+/* --------------------------------------------------------------- */
+
+typedef struct {
+	const long	hid_value;	/* HID value */
+	const char	*nut_value;	/* NUT value */
+	const char	*(*fun)(double hid_value);	/* optional HID to NUT mapping */
+	double	(*nuf)(const char *nut_value);		/* optional NUT to HID mapping */
+} info_lkp_t;
+
+#endif /* INFOLKP_H */
@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 /* #include <math.h> */
 #include "libhid.h"
 #include "hidparser.h"
@@ -104,6 +105,9 @@ reportbuf_t *new_report_buffer(HIDDesc_t *pDesc)
 		return NULL;
 	}
 
+	/* no report has been retrieved in the first cycle yet */
+	rbuf->cycle = 1;
+
 	/* now go through all items that are part of this report */
 	for (i=0; i<pDesc->nitems; i++) {
 
@@ -140,9 +144,12 @@ reportbuf_t *new_report_buffer(HIDDesc_t *pDesc)
    operate on individual items, not whole reports. */
 
 /* refresh the report with the given id in the report buffer rbuf.  If
-   the report is not yet in the buffer, or if it is older than "age"
-   seconds, then the report is freshly read from the USB
-   device. Otherwise, it is unchanged.
+   the report has not yet been retrieved during the current update cycle
+   (see HIDNewCycle), or if age is 0, then the report is freshly read
+   from the USB device. Otherwise, it is unchanged, so each report is
+   only retrieved once per cycle, even if it holds several items. This
+   also holds for failures, which are not retried in the same cycle
+   (unless the caller expires the report, as the startup walk does).
    Return 0 on success, -1 on error with errno set. */
 /* because buggy firmwares from APC return wrong report size, we either
    ask the report with the found report size or with the whole buffer size
@@ -152,7 +159,12 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 	int	id = pData->ReportID;
 	int	r;
 
-	if (interrupt_only || rbuf->ts[id] + age > time(NULL)) {
+	if (interrupt_only || ((age > 0) && (rbuf->gen[id] == rbuf->cycle))) {
+		if (rbuf->err[id] != 0) {
+			/* already failed during this cycle */
+			errno = rbuf->err[id];
+			return -1;
+		}
 		/* buffered report is still good; nothing to do */
 		upsdebug_hex(3, "Report[buf]", rbuf->data[id], rbuf->len[id]);
 		return 0;
@@ -161,7 +173,13 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 	r = comm_driver->get_report(udev, id, rbuf->data[id],
 		max_report_size ? (int)sizeof(rbuf->data[id]):rbuf->len[id]);
 
+	rbuf->gen[id] = rbuf->cycle;
+	rbuf->xfers++;
+
 	if (r <= 0) {
+		/* errno may not be set on temporary failures */
+		rbuf->err[id] = errno ? errno : EAGAIN;
+		errno = rbuf->err[id];
 		return -1;
 	}
 
@@ -173,7 +191,7 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 	}
 
 	/* have (valid) report */
-	time(&rbuf->ts[id]);
+	rbuf->err[id] = 0;
 
 	return 0;
 }
@@ -215,7 +233,7 @@ static int set_item_buffered(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDData_t
 	upsdebug_hex(3, "Report[set]", rbuf->data[id], rbuf->len[id]);
 
 	/* expire report */
-	rbuf->ts[id] = 0;
+	rbuf->gen[id] = 0;
 
 	return 0;
 }
@@ -239,7 +257,8 @@ static int file_report_buffer(reportbuf_t *rbuf, unsigned char *buf, int buflen)
 	}
 
 	/* have (valid) report */
-	time(&rbuf->ts[id]);
+	rbuf->gen[id] = rbuf->cycle;
+	rbuf->err[id] = 0;
 
 	return 0;
 }
@@ -402,6 +421,25 @@ int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, in
 	return 1;
 }
 
+/* Retrieve the report holding the given HIDData, unless this has already
+ * been done during the current cycle. Used to fetch all the needed reports
+ * in one pass, before decoding their items with HIDGetDataValue().
+ * return 1 if OK, 0 on fail, -errno otherwise (ie disconnect).
+ */
+int HIDRefreshReport(hid_dev_handle_t udev, HIDData_t *hiddata)
+{
+	if (hiddata == NULL) {
+		return 0;
+	}
+
+	if (refresh_report_buffer(reportbuf, udev, hiddata, MAX_TS) < 0) {
+		upsdebug_with_errno(1, "Can't retrieve Report %02x", hiddata->ReportID);
+		return -errno;
+	}
+
+	return 1;
+}
+
 /* Return the physical value associated with the given path.
  * return 1 if OK, 0 on fail, -errno otherwise (ie disconnect).
  */
@@ -466,7 +504,7 @@ int HIDSetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double Value)
 	}
 
 	/* flush the report buffer (data may have changed) */
-	memset(reportbuf->ts, 0, sizeof(reportbuf->ts));
+	memset(reportbuf->gen, 0, sizeof(reportbuf->gen));
 	
 	upsdebugx(4, "Set report succeeded");
 	return 1;
@@ -480,10 +518,29 @@ bool_t HIDSetItemValue(hid_dev_handle_t udev, const char *hidpath, double Value,
 	return TRUE;
 }
 
-/* On success, return item count >0. When no notifications are available,
+/* Start a new update cycle: reports retrieved from now on are considered
+ * fresh until the next call.
+ */
+void HIDNewCycle(void)
+{
+	if (!reportbuf) {
+		return;
+	}
+
+	reportbuf->xfers = 0;
+
+	/* skip 0 on wrap around, which is used to expire reports */
+	if (++reportbuf->cycle == 0) {
+		memset(reportbuf->gen, 0, sizeof(reportbuf->gen));
+		reportbuf->cycle = 1;
+	}
+}
+
+/* Wait at most <timeout> msec for a notification on the interrupt pipe.
+ * On success, return item count >0. When no notifications are available,
  * return 'error' or 'no event' code.
  */
-int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize)
+int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize, int timeout)
 {
 	unsigned char	buf[SMALLBUF];
 	int		itemCount = 0;
@@ -491,7 +548,7 @@ int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize)
 	HIDData_t	*pData;
 
 	/* needs libusb-0.1.8 to work => use ifdef and autoconf */
-	buflen = comm_driver->get_interrupt(udev, buf, interrupt_size ? interrupt_size:sizeof(buf), 250);
+	buflen = comm_driver->get_interrupt(udev, buf, interrupt_size ? interrupt_size:sizeof(buf), timeout);
 	if (buflen <= 0) {
 		return buflen;	/* propagate "error" or "no event" code */
 	}
@@ -718,11 +775,120 @@ static int path_to_string(char *string, size_t size, const HIDPath_t *path, usag
 	return i;
 }
 
+/* Hash indexes of the usage tables, used by the two lookup functions
+ * below. string_to_path() runs for each of the hundreds of hid2nut paths
+ * on (re)connection, so the tables are not scanned for each component.
+ * The indexes are built on first use for a given set of tables, and keep
+ * the first match (in tables order), so that subdrivers tables still
+ * override the defaults. */
+static struct {
+	usage_tables_t	*utab;		/* tables indexed */
+	usage_lkp_t	**by_name;	/* keyed by usage_name (case insensitive) */
+	usage_lkp_t	**by_code;	/* keyed by usage_code */
+	size_t		mask;		/* number of slots - 1 (power of 2) */
+} usage_index = { NULL, NULL, NULL, 0 };
+
+static size_t usage_hash_name(const char *name)
+{
+	size_t	h = 5381;
+
+	while (*name) {
+		h = (h * 33) ^ (unsigned char)tolower((unsigned char)*name++);
+	}
+
+	return h;
+}
+
+static size_t usage_hash_code(const HIDNode_t usage)
+{
+	return usage * 2654435761u;
+}
+
+static int usage_index_build(usage_tables_t *utab)
+{
+	size_t	count = 0, size = 16, k;
+	int	i, j;
+
+	if (usage_index.utab == utab) {
+		return 0;
+	}
+
+	free(usage_index.by_name);
+	free(usage_index.by_code);
+	memset(&usage_index, 0, sizeof(usage_index));
+
+	for (i = 0; utab[i] != NULL; i++) {
+		for (j = 0; utab[i][j].usage_name != NULL; j++) {
+			count++;
+		}
+	}
+
+	/* keep the load factor below 50% */
+	while (size < 2 * count) {
+		size <<= 1;
+	}
+
+	usage_index.by_name = calloc(size, sizeof(*usage_index.by_name));
+	usage_index.by_code = calloc(size, sizeof(*usage_index.by_code));
+
+	if (!usage_index.by_name || !usage_index.by_code) {
+		free(usage_index.by_name);
+		free(usage_index.by_code);
+		memset(&usage_index, 0, sizeof(usage_index));
+		return -1;
+	}
+
+	usage_index.mask = size - 1;
+
+	for (i = 0; utab[i] != NULL; i++) {
+		for (j = 0; utab[i][j].usage_name != NULL; j++) {
+			usage_lkp_t	*lkp = &utab[i][j];
+
+			for (k = usage_hash_name(lkp->usage_name) & usage_index.mask; usage_index.by_name[k]; k = (k + 1) & usage_index.mask) {
+				if (!strcasecmp(usage_index.by_name[k]->usage_name, lkp->usage_name))
+					break;
+			}
+
+			if (!usage_index.by_name[k])
+				usage_index.by_name[k] = lkp;
+
+			for (k = usage_hash_code(lkp->usage_code) & usage_index.mask; usage_index.by_code[k]; k = (k + 1) & usage_index.mask) {
+				if (usage_index.by_code[k]->usage_code == lkp->usage_code)
+					break;
+			}
+
+			if (!usage_index.by_code[k])
+				usage_index.by_code[k] = lkp;
+		}
+	}
+
+	usage_index.utab = utab;
+
+	upsdebugx(5, "%s: %u usages indexed", __func__, (unsigned int)count);
+	return 0;
+}
+
 /* usage conversion string -> numeric */
 static long hid_lookup_usage(const char *name, usage_tables_t *utab)
 {
 	int i, j;
 
+	if (usage_index_build(utab) == 0) {
+		usage_lkp_t	*lkp;
+		size_t		k;
+
+		for (k = usage_hash_name(name) & usage_index.mask; (lkp = usage_index.by_name[k]) != NULL; k = (k + 1) & usage_index.mask) {
+			if (strcasecmp(lkp->usage_name, name))
+				continue;
+
+			upsdebugx(5, "hid_lookup_usage: %s -> %08x", name, (unsigned int)lkp->usage_code);
+			return lkp->usage_code;
+		}
+
+		upsdebugx(5, "hid_lookup_usage: %s -> not found in lookup table", name);
+		return -1;
+	}
+
 	for (i = 0; utab[i] != NULL; i++)
 	{
 		for (j = 0; utab[i][j].usage_name != NULL; j++)
@@ -744,6 +910,22 @@ static const char *hid_lookup_path(const HIDNode_t usage, usage_tables_t *utab)
 {
 	int i, j;
 
+	if (usage_index_build(utab) == 0) {
+		usage_lkp_t	*lkp;
+		size_t		k;
+
+		for (k = usage_hash_code(usage) & usage_index.mask; (lkp = usage_index.by_code[k]) != NULL; k = (k + 1) & usage_index.mask) {
+			if (lkp->usage_code != usage)
+				continue;
+
+			upsdebugx(5, "hid_lookup_path: %08x -> %s", (unsigned int)usage, lkp->usage_name);
+			return lkp->usage_name;
+		}
+
+		upsdebugx(5, "hid_lookup_path: %08x -> not found in lookup table", (unsigned int)usage);
+		return NULL;
+	}
+
 	for (i = 0; utab[i] != NULL; i++)
 	{
 		for (j = 0; utab[i][j].usage_name != NULL; j++)
@@ -60,7 +60,7 @@ typedef int bool_t;
 #define MODE_OPEN	0	/* open a HID device for the first time */
 #define MODE_REOPEN	1	/* reopen a HID device that was opened before */
 
-#define MAX_TS		2	/* validity period of a gotten report (2 sec) */
+#define MAX_TS		1	/* use a report retrieved during the current cycle */
 
 /* ---------------------------------------------------------------------- */
 
@@ -82,9 +82,12 @@ extern HIDDesc_t	*pDesc;	/* parsed Report Descriptor */
 /* report buffer structure: holds data about most recent report for
    each given report id */
 typedef struct reportbuf_s {
-       time_t	ts[256];			/* timestamp when report was retrieved */
+       unsigned int	gen[256];		/* update cycle when report was retrieved */
+       int	err[256];			/* errno, if retrieving it failed */
        int	len[256];			/* size of report data */
        unsigned char	*data[256];		/* report data (allocated) */
+       unsigned int	cycle;			/* current update cycle */
+       unsigned int	xfers;			/* reports retrieved during this cycle */
 } reportbuf_t;
 
 extern reportbuf_t	*reportbuf;	/* buffer for most recent reports */
@@ -124,6 +127,11 @@ char *HIDGetDataItem(const HIDData_t *hiddata, usage_tables_t *utab);
  * -------------------------------------------------------------------------- */
 int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, int age);
 
+/*
+ * HIDRefreshReport
+ * -------------------------------------------------------------------------- */
+int HIDRefreshReport(hid_dev_handle_t udev, HIDData_t *hiddata);
+
 /*
  * HIDSetDataValue
  * -------------------------------------------------------------------------- */
@@ -134,10 +142,15 @@ int HIDSetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double Value);
  * -------------------------------------------------------------------------- */
 char *HIDGetIndexString(hid_dev_handle_t udev, int Index, char *buf, size_t buflen);
 
+/*
+ * HIDNewCycle
+ * -------------------------------------------------------------------------- */
+void HIDNewCycle(void);
+
 /*
  * HIDGetEvents
  * -------------------------------------------------------------------------- */
-int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventlen);
+int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventlen, int timeout);
 
 /*
  * Support functions
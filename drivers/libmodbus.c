@@ -39,26 +39,78 @@
 #include "libmodbus.h"
 #include "modbustypes.h"
 #include "common.h" /* for xmalloc, upsdebugx prototypes */
-#include "usb-common.h"
 
 #ifdef MODBUS_OVER_HID
+#include "usb-common.h"
 #include "libusb.h"
+#else
+#include "serial.h"
 #endif
 
 #define MODBUS_MESSAGES_DEBUG_LEVEL 2
 
 // Support functions. Headers
+#ifdef MODBUS_OVER_HID
 bool CommModbusTx(modbus_dev_handle_t udev, const ModbusFrame *frm, unsigned int sz);
 bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz);
-uint16_t ModbusCrc(const uint8_t *data, unsigned int sz);
 bool CommWaitIdle(modbus_dev_handle_t udev); bool ModbusWaitIdle();
+#endif
+static unsigned int ModbusBuildFrame(ModbusFrame *frm, uint8_t modbusID, uint8_t fc, const uint8_t *pdu, unsigned int sz);
+static int ModbusCheckFrame(const ModbusFrame *frm, unsigned int sz, uint8_t modbusID, uint8_t fc, unsigned int rxsz);
 bool ModbusSendAndWait(modbus_dev_handle_t udev, uint8_t modbusID, uint8_t fc, const ModbusPdu *txpdu, unsigned int txsz, ModbusPdu *rxpdu, unsigned int rxsz);
 
 time_t ModbusRegTotime_t(uint64_t reg);
 uint64_t time_tToModbusReg(time_t t);
 
+/* Register image cache. The ranges of registers used by the driver are
+ * declared with ModbusCacheAddRange(), and grouped into blocks of adjacent
+ * (or nearly adjacent) registers, each read with a single transaction.
+ * The blocks are allocated once, so that ModbusCacheRead() does no heap
+ * allocation. Each register has the update cycle it was read in, so that
+ * the reads within a cycle (see ModbusCacheNewCycle()) are served from the
+ * image, and writes invalidate the registers they touch. */
+
+/* unused registers that may be read to merge two ranges */
+#define MODBUS_BLOCK_MAX_GAP	8
+
+/* update cycles before trying again a block read that was refused */
+#define MODBUS_BLOCK_RETRY	32
+
+typedef struct {
+	uint16_t	reg;		/* first register */
+	uint16_t	nregs;		/* number of registers */
+	unsigned int	split;		/* cycle the block read was refused in (0: never), its ranges are read separately for a while */
+	unsigned int	gen[MODBUS_MAX_READ_REGS];	/* update cycle each register was read in (0: never) */
+	uint8_t		data[MODBUS_MAX_READ_REGS * sizeof(uint16_t)];
+} ModbusBlock;
+
+static struct {
+	uint16_t	(*range)[2];	/* declared ranges: first, last + 1 */
+	int		nranges;
+	ModbusBlock	*block;		/* NULL until planned */
+	int		nblocks;
+	unsigned int	reads;		/* read transactions so far */
+	unsigned int	cycle;		/* current update cycle */
+} mbcache = { NULL, 0, NULL, 0, 0, 1 };
+
+static const modbus_transport_t	*mbtransport =
+#ifdef MODBUS_OVER_HID
+	&modbus_hid_transport;
+#else
+	&modbus_rtu_transport;
+#endif
+
+static uint16_t	mbtid = 0;	/* tag of the last request sent */
+
+static modbus_stats_t	mbstats = { 0, 0, 0, 0 };
+
+/* set when a stream transport lost the frame boundaries (timeout in the
+ * middle of a response, bad header, response nobody asked for): nothing
+ * read from the connection can be trusted until it is reopened */
+static bool	mblost = false;
+
 // Main functions.
-uint8_t *ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs)
+bool ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, uint8_t *data)
 {
    ModbusPdu txpdu;
    ModbusPdu rxpdu;
@@ -71,11 +123,13 @@ uint8_t *ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t
    txpdu[2] = nregs >> 8;
    txpdu[3] = nregs;
 
+   mbcache.reads++;
+
    if (!ModbusSendAndWait(udev, modbusID, MODBUS_FC_READ_HOLDING_REGS, &txpdu, 4,
                     &rxpdu, nbytes+1))
    {
 	   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusReadRegister. Error during read register.");
-	   return NULL;
+	   return false;
    }
 
    if (rxpdu[0] != nbytes)
@@ -84,12 +138,8 @@ uint8_t *ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t
 	   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusReadRegister.  Wrong number of data bytes received (exp=%u, rx=%u)", nbytes, rxpdu[0]);
    }
 
-   uint8_t *ret = calloc(nbytes, sizeof(uint8_t)); //new uint8_t[nbytes];
-   if (!ret) {
-	   return NULL;
-   }
-   memcpy(ret, rxpdu+1, nbytes);
-   return ret;
+   memcpy(data, rxpdu+1, nbytes);
+   return true;
 }
 
 bool ModbusWriteRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, const uint8_t *data)
@@ -107,6 +157,9 @@ bool ModbusWriteRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t re
    txpdu[4] = nbytes;
    memcpy(txpdu+5, data, nbytes);
 
+   // Whatever the outcome, the cached values may be stale now
+   ModbusCacheInvalidate(reg, nregs);
+
    if (!ModbusSendAndWait(udev, modbusID, MODBUS_FC_WRITE_MULTIPLE_REGS, &txpdu, nbytes+5, &rxpdu, 4))
    {
       return false;
@@ -126,98 +179,181 @@ bool ModbusWriteRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t re
 
 // Support functions. Implementation
 
-bool ModbusSendAndWait(modbus_dev_handle_t udev, uint8_t modbusID,
-   uint8_t fc, 
-   const ModbusPdu *txpdu, unsigned int txsz, 
-   ModbusPdu *rxpdu, unsigned int rxsz)
+void ModbusSetTransport(const modbus_transport_t *transport)
 {
-   ModbusFrame txfrm;
-   ModbusFrame rxfrm;
-   unsigned int sz;
+	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSetTransport. %s, maxframe=%u, window=%u", transport->name, transport->maxframe, transport->window);
 
-   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. modbusID: 0x%04x, FC: 0x%04x ", modbusID, fc);
-   upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. txpdu", txpdu, txsz);
-   // Ensure caller isn't trying to send an oversized PDU
-   if (txsz > MODBUS_MAX_PDU_SZ || rxsz > MODBUS_MAX_PDU_SZ)
-      return false;
+	mbtransport = transport;
+
+	/* block sizes depend on the transport: plan again on next read */
+	free(mbcache.block);
+	mbcache.block = NULL;
+	mbcache.nblocks = 0;
+}
 
+/* the connection has to be closed and reopened, see mblost */
+bool ModbusLinkLost(void)
+{
+	return mblost;
+}
+
+/* a new connection is open */
+void ModbusLinkReset(void)
+{
+	mblost = false;
+}
+
+/* build a frame from slave address, function code and PDU, return its
+ * size, CRC included */
+static unsigned int ModbusBuildFrame(ModbusFrame *frm, uint8_t modbusID, uint8_t fc, const uint8_t *pdu, unsigned int sz)
+{
    // Prepend slave address and function code
-   txfrm[0] = modbusID;//_slaveaddr;
-   txfrm[1] = fc;
+   (*frm)[0] = modbusID;//_slaveaddr;
+   (*frm)[1] = fc;
 
    // Add PDU
-   memcpy(txfrm+2, txpdu, txsz);
+   memcpy(*frm+2, pdu, sz);
 
    // Calculate crc
-   uint16_t crc = ModbusCrc(txfrm, txsz+2);
-   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. CRC: 0x%04x ", crc);
+   uint16_t crc = ModbusCrc(*frm, sz+2);
+   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusBuildFrame. CRC: 0x%04x ", crc);
    // CRC goes out LSB first, unlike other MODBUS fields
-   txfrm[txsz+2] = crc;
-   txfrm[txsz+3] = crc >> 8;
+   (*frm)[sz+2] = crc;
+   (*frm)[sz+3] = crc >> 8;
 
-   int retries = 2;
-   do
-   {
-	  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Iteration %d.", 2 - retries);
-	  if (!CommModbusTx(udev, &txfrm, txsz+4))
-      {
-         // Failure to send is immediately fatal
-		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Failure to send is immediately fatal.");
-         return false;
-      }
+   return sz+4;
+}
 
-      if (!CommModbusRx(udev, &rxfrm, &sz))
-      {
-         // Rx timeout: Retry
-		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. CommModbusRx retutn FALSE.");
-         continue;
-      }
+/* check a response of sz bytes (CRC included) to function fc, expected to
+ * carry rxsz bytes of PDU: return 1 if good, 0 to retry, -1 if fatal */
+static int ModbusCheckFrame(const ModbusFrame *frm, unsigned int sz, uint8_t modbusID, uint8_t fc, unsigned int rxsz)
+{
+      uint16_t crc;
 
       if (sz < 4)
       {
          // Runt frame: Retry
-		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Runt frame %u.", sz);
-         continue;
+		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. Runt frame %u.", sz);
+         return 0;
       }
 
-      crc = ModbusCrc(rxfrm, sz-2);
-      if (rxfrm[sz-2] != (crc & 0xff) ||
-          rxfrm[sz-1] != (crc >> 8))
+      crc = ModbusCrc(*frm, sz-2);
+      if ((*frm)[sz-2] != (crc & 0xff) ||
+          (*frm)[sz-1] != (crc >> 8))
       {
          // CRC error: Retry
-		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. CRC error.");
-         continue;
+		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. CRC error.");
+         return 0;
       }
 
-      if (rxfrm[0] != modbusID) //_slaveaddr)
+      if ((*frm)[0] != modbusID) //_slaveaddr)
       {
          // Not from expected slave: Retry
-         // TODO! change function Dmsg(0, "%s: Bad address (exp=%u, rx=%u)\n", __func__, _slaveaddr, rxfrm[0]);
-		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Bad address (exp=%u, rx=%u).", modbusID, rxfrm[0]);
-		  continue;
+		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. Bad address (exp=%u, rx=%u).", modbusID, (*frm)[0]);
+		  return 0;
       }
 
-      if (rxfrm[1] == (fc | MODBUS_FC_ERROR))
+      if ((*frm)[1] == (fc | MODBUS_FC_ERROR))
       {
          // Exception response: Immediately fatal
- 		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Exception (code=%u).", modbusID, rxfrm[2]);
-		  return false;
+ 		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. Exception (code=%u).", (*frm)[2]);
+		  return -1;
       }
 
-      if (rxfrm[1] != fc)
+      if ((*frm)[1] != fc)
       {
          // Unknown response: Retry
-		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Unexpected response 0x%02x.", modbusID, rxfrm[1]);
-		  continue;
+		  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. Unexpected response 0x%02x.", (*frm)[1]);
+		  return 0;
       }
 
       if (sz != rxsz+4)
       {
          // Wrong size: Retry
-		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Wrong size (exp=%u, rx=%u).", rxsz + 4, sz);
+		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCheckFrame. Wrong size (exp=%u, rx=%u).", rxsz + 4, sz);
+         return 0;
+      }
+
+      return 1;
+}
+
+/* receive the response to request tid. With several requests outstanding
+ * on a connection, a response to another one means that the connection
+ * is out of step with its requests */
+static bool ModbusRecv(modbus_dev_handle_t udev, uint16_t tid, ModbusFrame *frm, unsigned int *sz)
+{
+	uint16_t	rxtid;
+
+	if (!mbtransport->recv(udev, &rxtid, frm, sz))
+		return false;
+
+	if (mbtransport->window <= 1 || rxtid == tid)
+		return true;
+
+	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusRecv. Response to request %u (exp=%u)", rxtid, tid);
+	mblost = true;
+	return false;
+}
+
+bool ModbusSendAndWait(modbus_dev_handle_t udev, uint8_t modbusID,
+   uint8_t fc, 
+   const ModbusPdu *txpdu, unsigned int txsz, 
+   ModbusPdu *rxpdu, unsigned int rxsz)
+{
+   ModbusFrame txfrm;
+   ModbusFrame rxfrm;
+   unsigned int frmsz, sz;
+   uint16_t tid;
+   int ret;
+
+   upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. modbusID: 0x%04x, FC: 0x%04x ", modbusID, fc);
+   upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. txpdu", txpdu, txsz);
+   // Ensure caller isn't trying to send an oversized PDU, or expecting a
+   // response the transport can't carry
+   if (txsz > MODBUS_MAX_PDU_SZ || rxsz > MODBUS_MAX_PDU_SZ)
+      return false;
+
+   if (txsz + 2 > mbtransport->maxframe || rxsz + 2 > mbtransport->maxframe)
+   {
+      upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Frame too large for %s transport.", mbtransport->name);
+      return false;
+   }
+
+   frmsz = ModbusBuildFrame(&txfrm, modbusID, fc, *txpdu, txsz);
+
+   int retries = 2;
+   do
+   {
+	  upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Iteration %d.", 2 - retries);
+	  tid = ++mbtid;
+	  mbstats.transactions++;
+	  if (retries < 2)
+		 mbstats.retries++;
+	  if (!mbtransport->send(udev, tid, &txfrm, frmsz))
+      {
+         // Failure to send is immediately fatal
+		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. Failure to send is immediately fatal.");
+         return false;
+      }
+
+      if (!ModbusRecv(udev, tid, &rxfrm, &sz))
+      {
+         // Rx timeout: Retry
+		 upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusSendAndWait. %s receive returned FALSE.", mbtransport->name);
+		 mbstats.timeouts++;
          continue;
       }
 
+      ret = ModbusCheckFrame(&rxfrm, sz, modbusID, fc, rxsz);
+      if (ret < 1)
+         mbstats.errors++;
+
+      if (ret < 0)
+         return false;
+
+      if (ret == 0)
+         continue;
+
       // Everything is ok
       memcpy(rxpdu, rxfrm+2, rxsz);
       return true;
@@ -239,6 +375,60 @@ uint64_t time_tToModbusReg(time_t t)
 	return (t - MODBUS_BASE_TIMESTAMP) / 60 / 60 / 24;
 }
 
+#ifdef MODBUS_OVER_HID
+#define S_TO_NS(x)  ( (x) * 1000000000ULL )
+#define MS_TO_NS(x) ( (x) * 1000000ULL )
+#define US_TO_NS(x) ( (x) * 1000ULL )
+#define NS_TO_MS(x) ( ((x)+999999) / 1000000ULL )
+
+/* MODBUS/USB receive state. The request in flight is recorded when sent,
+ * so that a response left over from an earlier request (that timed out)
+ * is recognised and dropped as it arrives. The line is only waited on
+ * for silence after such a desync, a timeout or an error, rather than
+ * before every request. */
+static struct {
+	bool	idle;		/* no response can be on its way */
+	bool	pending;	/* a request waits for its response */
+	uint8_t	slave;		/* slave address of the request */
+	uint8_t	fc;		/* function code of the request */
+	uint8_t	nbytes;		/* FC3: byte count of the response */
+	uint8_t	echo[4];	/* FC16: register and count of the response */
+} mbhid = { false, false, 0, 0, 0, { 0 } };
+
+/* time in ns, from a clock that doesn't jump with the time of day */
+uint64_t CommGetTod()
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+		return S_TO_NS((uint64_t)now.tv_sec) + now.tv_nsec;
+#endif
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return S_TO_NS((uint64_t)tv.tv_sec) + US_TO_NS(tv.tv_usec);
+}
+
+/* whether frm (slave address onwards) answers the request in flight */
+static bool CommModbusExpected(const uint8_t *frm)
+{
+	if (!mbhid.pending || frm[0] != mbhid.slave)
+		return false;
+
+	if (frm[1] == (mbhid.fc | MODBUS_FC_ERROR))
+		return true;
+
+	if (frm[1] != mbhid.fc)
+		return false;
+
+	if (mbhid.fc == MODBUS_FC_READ_HOLDING_REGS)
+		return frm[2] == mbhid.nbytes;
+
+	if (mbhid.fc == MODBUS_FC_WRITE_MULTIPLE_REGS)
+		return memcmp(frm + 2, mbhid.echo, sizeof(mbhid.echo)) == 0;
+
+	return true;
+}
+
 bool CommModbusTx(modbus_dev_handle_t udev, const ModbusFrame *frm, unsigned int sz)
 {
 	// MODBUS/USB is limited to 63 bytes of payload (we don't bother with
@@ -253,12 +443,20 @@ bool CommModbusTx(modbus_dev_handle_t udev, const ModbusFrame *frm, unsigned int
 		return false;
 	}
 
-	// Wait for idle 
-	if (!CommWaitIdle(udev)) {
+	// Wait for idle, only if a response may still be on its way
+	if (!mbhid.idle && !CommWaitIdle(udev)) {
 		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusTx. CommWaitIdle return FALSE.");
 		return false;
 	}
 
+	// Record the request, to match its response
+	mbhid.idle = false;
+	mbhid.pending = true;
+	mbhid.slave = (*frm)[0];
+	mbhid.fc = (*frm)[1];
+	mbhid.nbytes = 2 * (((*frm)[4] << 8) | (*frm)[5]);
+	memcpy(mbhid.echo, *frm + 2, sizeof(mbhid.echo));
+
 	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusTx. Sending frame.");
 
 	// We add HID report id as the first byte of the report, then at most 63
@@ -267,46 +465,42 @@ bool CommModbusTx(modbus_dev_handle_t udev, const ModbusFrame *frm, unsigned int
 	rpt[0] = ModbusHIDTxID; // _txrpt;
 	
 	memcpy(rpt + 1, frm, sz - 2);
-#ifdef MODBUS_OVER_HID
 	ret = interrupt_write(udev, EP_Tx, &rpt, MODBUS_USB_REPORT_SIZE, MODBUS_RESPONSE_TIMEOUT_MS);
 	
 	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusTx. interrupt_write processed %d bytes.", ret);
 	upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusTx. interrupt_write return buffer", &rpt, MODBUS_USB_REPORT_SIZE);
 
-#endif
-	return ret == (int)MODBUS_USB_REPORT_SIZE;
+	if (ret != (int)MODBUS_USB_REPORT_SIZE) {
+		mbhid.pending = false;
+		return false;
+	}
+
+	return true;
 }
 
 bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 {
-	struct timeval now, exittime;
-	
 	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx...");
 
 	// Determine time at which we need to exit
-	gettimeofday(&exittime, NULL);
-	exittime.tv_sec += MODBUS_RESPONSE_TIMEOUT_MS / 1000;
-	exittime.tv_usec += (MODBUS_RESPONSE_TIMEOUT_MS % 1000) * 1000;
-	if (exittime.tv_usec >= 1000000)
-	{
-		++exittime.tv_sec;
-		exittime.tv_usec -= 1000000;
-	}
+	uint64_t start = CommGetTod();
+	uint64_t exittime = start + MS_TO_NS(MODBUS_RESPONSE_TIMEOUT_MS);
 
 	int ret = -ETIMEDOUT;
 	uint8_t rpt[MODBUS_USB_REPORT_SIZE] = { 0 };
 	while (1)
 	{
-		gettimeofday(&now, NULL);
-		int timeout = TV_DIFF_MS(now, exittime);//NS_TO_MS(target - now)
-#ifdef MODBUS_OVER_HID
-		ret = interrupt_read(udev, EP_Rx, &rpt, MODBUS_USB_REPORT_SIZE, timeout);
-#endif
-		upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read returned buffer", &rpt, MODBUS_USB_REPORT_SIZE); 
+		uint64_t now = CommGetTod();
+		int timeout = (now < exittime) ? (int)NS_TO_MS(exittime - now) : 0;
+
+		if (timeout > 0)
+			ret = interrupt_read(udev, EP_Rx, &rpt, MODBUS_USB_REPORT_SIZE, timeout);
+
 		if (timeout <= 0 || ret == -ETIMEDOUT)
 		{
+			// The response may still come: wait for silence before next request
 			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read return %d. TIMEOUT %d. ETIMEDOUT %d", ret, timeout, ETIMEDOUT);
-			upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read return buffer", &rpt, MODBUS_USB_REPORT_SIZE);
+			mbhid.pending = false;
 			return false;
 		}
 
@@ -318,6 +512,7 @@ bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 		if (ret <= 0)
 		{
 			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Read error: %d", ret);
+			mbhid.pending = false;
 			return false;
 		}
 
@@ -328,10 +523,13 @@ bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 			continue;
 		}
 
+		upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read returned buffer", &rpt, MODBUS_USB_REPORT_SIZE); 
+
 		// Bad report size ... fatal
 		if (ret != (int)MODBUS_USB_REPORT_SIZE)
 		{
 			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Bad size %d", ret);
+			mbhid.pending = false;
 			return false;
 		}
 
@@ -341,7 +539,12 @@ bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 		// here. Which byte(s) we look at and how we calculate the length depends
 		// on the opcode.
 		unsigned frmsz;
-		if (rpt[2] == MODBUS_FC_READ_HOLDING_REGS)
+		if (rpt[2] & MODBUS_FC_ERROR)
+		{
+			// Exception response: frame header and exception code
+			frmsz = 3;
+		}
+		else if (rpt[2] == MODBUS_FC_READ_HOLDING_REGS)
 		{
 			// READ_HOLDING_REGS response includes a size byte.
 			// Add 3 bytes to PDU size to account for size byte itself 
@@ -359,18 +562,24 @@ bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 		else
 		{
 			// Unsupported response message...we can't calculate its length
-			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx.  Unknown response type %x", rpt[2]);
-
-			upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read return buffer", &rpt, MODBUS_USB_REPORT_SIZE);
-			return false;
+			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Discarding unknown response type %x", rpt[2]);
+			continue;
 		}
 
 		if (frmsz > MODBUS_USB_REPORT_MAX_FRAME_SIZE)
 		{
 			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Fragmented PDU received...not supported");
+			mbhid.pending = false;
 			return false;
 		}
 
+		// A response to an earlier request: drop it, and keep waiting
+		if (!CommModbusExpected(rpt + 1))
+		{
+			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Out of sync, discarding response (slave=%u, fc=0x%02x)", rpt[1], rpt[2]);
+			continue;
+		}
+
 		// Copy data to caller's buffer. Live data starts after USB report id byte.
 		memcpy(frm, rpt + 1, frmsz);
 
@@ -381,23 +590,15 @@ bool CommModbusRx(modbus_dev_handle_t udev, ModbusFrame *frm, unsigned int *sz)
 		(*frm)[frmsz + 1] = crc >> 8;
 
 		*sz = frmsz + 2;
-		//upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. interrupt_read return buffer", &rpt, MODBUS_USB_REPORT_SIZE);
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommModbusRx. Response in %u ms", (unsigned int)NS_TO_MS(CommGetTod() - start));
+
+		// The response is in: nothing else should follow
+		mbhid.pending = false;
+		mbhid.idle = true;
 		return true;
 	}
 }
 
-#define S_TO_NS(x)  ( (x) * 1000000000ULL )
-#define MS_TO_NS(x) ( (x) * 1000000ULL )
-#define US_TO_NS(x) ( (x) * 1000ULL )
-#define NS_TO_MS(x) ( ((x)+999999) / 1000000ULL )
-
-uint64_t CommGetTod()
-{
-	struct timeval now;
-	gettimeofday(&now, NULL);
-	return S_TO_NS(now.tv_sec) + US_TO_NS(now.tv_usec);
-}
-
 bool CommWaitIdle(modbus_dev_handle_t udev)
 {
 	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::CommWaitIdle...");
@@ -419,16 +620,15 @@ bool CommWaitIdle(modbus_dev_handle_t udev)
 		MODBUS_USB_REPORT_SIZE, NS_TO_MS(target-now));
 		//
 		*/
-#ifdef MODBUS_OVER_HID
-		int timeout = NS_TO_MS(target - now); //TV_DIFF_MS(now, exittime);//
+		int timeout = (target > now) ? (int)NS_TO_MS(target - now) : 0;
 		if (timeout <= 0) { 
 			timeout = 5;
 		}
 		rc = interrupt_read(udev, 1, &rpt, MODBUS_USB_REPORT_SIZE, timeout);
-#endif
 		if (rc == -ETIMEDOUT)
 		{
 			// timeout: line is now idle
+			mbhid.idle = true;
 			return true;
 		}
 		else if (rc <= 0 && rc != -EINTR && rc != -EAGAIN)
@@ -463,27 +663,491 @@ bool CommWaitIdle(modbus_dev_handle_t udev)
 	return false;
 }
 
-uint16_t ModbusCrc(const uint8_t *data, unsigned int sz)
+/* MODBUS/USB: one request at a time, see CommModbusTx/CommModbusRx */
+static bool ModbusHidSend(modbus_dev_handle_t udev, uint16_t tid, const ModbusFrame *frm, unsigned int sz)
 {
-	// 1 + x^2 + x^15 + x^16
-	static const uint16_t MODBUS_CRC_POLY = 0xA001;
-	uint16_t crc = 0xffff;
+	return CommModbusTx(udev, frm, sz);
+}
+
+static bool ModbusHidRecv(modbus_dev_handle_t udev, uint16_t *tid, ModbusFrame *frm, unsigned int *sz)
+{
+	*tid = mbtid;
+	return CommModbusRx(udev, frm, sz);
+}
+
+const modbus_transport_t modbus_hid_transport = {
+	"USB/HID", MODBUS_USB_REPORT_MAX_FRAME_SIZE, 1, ModbusHidSend, ModbusHidRecv
+};
 
-	while (sz--)
+#else	/* !MODBUS_OVER_HID */
+
+/* read exactly len bytes, or fail on timeout */
+static bool ModbusReadFull(int fd, uint8_t *buf, unsigned int len)
+{
+	int	ret;
+
+	ret = ser_get_buf_len(fd, buf, len, MODBUS_RESPONSE_TIMEOUT_MS / 1000, (MODBUS_RESPONSE_TIMEOUT_MS % 1000) * 1000);
+
+	if (ret != (int)len) {
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusReadFull. Read %d of %u bytes", ret, len);
+		return false;
+	}
+
+	return true;
+}
+
+/* MODBUS RTU over a serial line: frames are sent as they are, and the size
+ * of a response is worked out from its function code as it comes in */
+static bool ModbusRtuSend(modbus_dev_handle_t fd, uint16_t tid, const ModbusFrame *frm, unsigned int sz)
+{
+	// Drop what is left of a response that came too late
+	ser_flush_in(fd, "", 0);
+
+	return ser_send_buf(fd, *frm, sz) == (int)sz;
+}
+
+static bool ModbusRtuRecv(modbus_dev_handle_t fd, uint16_t *tid, ModbusFrame *frm, unsigned int *sz)
+{
+	unsigned int	frmsz;
+
+	*tid = mbtid;
+
+	// Slave address, function code and first byte of the PDU
+	if (!ModbusReadFull(fd, *frm, 3))
+		return false;
+
+	if ((*frm)[1] & MODBUS_FC_ERROR)
 	{
-		crc ^= *data++;
-		unsigned int i;
-		for (i = 0; i < 8; ++i)
-		{
-			if (crc & 0x1)
-				crc = (crc >> 1) ^ MODBUS_CRC_POLY;
-			else
-				crc >>= 1;
+		// Exception code
+		frmsz = 3;
+	}
+	else if ((*frm)[1] == MODBUS_FC_READ_HOLDING_REGS)
+	{
+		// Size byte, then the registers
+		frmsz = (*frm)[2] + 3;
+	}
+	else if ((*frm)[1] == MODBUS_FC_WRITE_MULTIPLE_REGS || (*frm)[1] == MODBUS_FC_WRITE_REG)
+	{
+		// Register address, then register count or value
+		frmsz = 6;
+	}
+	else
+	{
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusRtuRecv. Unknown response type %x", (*frm)[1]);
+		return false;
+	}
+
+	if (frmsz + 2 > MODBUS_MAX_FRAME_SZ)
+	{
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusRtuRecv. Bad size %u", frmsz);
+		return false;
+	}
+
+	// The rest of the frame, and the CRC
+	if (!ModbusReadFull(fd, *frm + 3, frmsz + 2 - 3))
+		return false;
+
+	*sz = frmsz + 2;
+	return true;
+}
+
+const modbus_transport_t modbus_rtu_transport = {
+	"RTU", MODBUS_MAX_FRAME_SZ - 2, 1, ModbusRtuSend, ModbusRtuRecv
+};
+
+/* MODBUS/TCP: the frame without its CRC, the slave address standing for
+ * the unit identifier, behind a header holding the transaction identifier,
+ * protocol identifier (0) and the size of what follows. Responses come
+ * back in order, tagged with the transaction identifier of their request,
+ * so that several requests may be outstanding on the connection. */
+#define MODBUS_TCP_HEADER_SIZE	6
+#define MODBUS_TCP_WINDOW	4
+
+static bool ModbusTcpSend(modbus_dev_handle_t fd, uint16_t tid, const ModbusFrame *frm, unsigned int sz)
+{
+	uint8_t		adu[MODBUS_TCP_HEADER_SIZE + MODBUS_MAX_FRAME_SZ];
+	unsigned int	len = sz - 2;
+
+	if (mblost)
+		return false;
+
+	adu[0] = tid >> 8;
+	adu[1] = tid;
+	adu[2] = 0;
+	adu[3] = 0;
+	adu[4] = len >> 8;
+	adu[5] = len;
+	memcpy(adu + MODBUS_TCP_HEADER_SIZE, *frm, len);
+
+	return ser_send_buf(fd, adu, MODBUS_TCP_HEADER_SIZE + len) == (int)(MODBUS_TCP_HEADER_SIZE + len);
+}
+
+static bool ModbusTcpRecv(modbus_dev_handle_t fd, uint16_t *tid, ModbusFrame *frm, unsigned int *sz)
+{
+	uint8_t		hdr[MODBUS_TCP_HEADER_SIZE];
+	unsigned int	len;
+	uint16_t	crc;
+
+	/* a response that doesn't come in time may still come later, or in
+	 * part: either way the next header would be read at the wrong place */
+	if (mblost || !ModbusReadFull(fd, hdr, sizeof(hdr)))
+	{
+		mblost = true;
+		return false;
+	}
+
+	len = (hdr[4] << 8) | hdr[5];
+
+	if (hdr[2] || hdr[3] || (len < 2) || (len + 2 > MODBUS_MAX_FRAME_SZ))
+	{
+		upsdebug_hex(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusTcpRecv. Bad header", hdr, sizeof(hdr));
+		mblost = true;
+		return false;
+	}
+
+	if (!ModbusReadFull(fd, *frm, len))
+	{
+		mblost = true;
+		return false;
+	}
+
+	*tid = (hdr[0] << 8) | hdr[1];
+
+	// MODBUS/TCP doesn't provide a CRC.
+	// Fill one in to make upper layer happy.
+	crc = ModbusCrc(*frm, len);
+	(*frm)[len] = crc & 0xff;
+	(*frm)[len + 1] = crc >> 8;
+
+	*sz = len + 2;
+	return true;
+}
+
+const modbus_transport_t modbus_tcp_transport = {
+	"TCP", MODBUS_MAX_FRAME_SZ - 2, MODBUS_TCP_WINDOW, ModbusTcpSend, ModbusTcpRecv
+};
+
+#endif	/* MODBUS_OVER_HID */
+
+static int ModbusRangeCmp(const void *a, const void *b)
+{
+	const uint16_t	*ra = a, *rb = b;
+
+	return (int)ra[0] - (int)rb[0];
+}
+
+/* largest FC3 read the transport can carry: the response holds the slave
+ * address, function code and byte count, then 2 bytes per register */
+static unsigned int ModbusBlockMaxRegs(void)
+{
+	unsigned int	nregs = (mbtransport->maxframe - 3) / 2;
+
+	return (nregs < MODBUS_MAX_READ_REGS) ? nregs : MODBUS_MAX_READ_REGS;
+}
+
+/* group the declared ranges into blocks */
+static void ModbusCachePlan(void)
+{
+	unsigned int	maxregs = ModbusBlockMaxRegs();
+	int	i;
+
+	qsort(mbcache.range, mbcache.nranges, sizeof(*mbcache.range), ModbusRangeCmp);
+
+	mbcache.block = xcalloc(mbcache.nranges ? mbcache.nranges : 1, sizeof(*mbcache.block));
+	mbcache.nblocks = 0;
+
+	for (i = 0; i < mbcache.nranges; i++) {
+		ModbusBlock	*block;
+		unsigned int	first = mbcache.range[i][0], last = mbcache.range[i][1];
+
+		if (mbcache.nblocks > 0) {
+			unsigned int	end;
+
+			block = &mbcache.block[mbcache.nblocks - 1];
+			end = block->reg + block->nregs;
+
+			if (last <= end)
+				continue;
+
+			if ((first <= end + MODBUS_BLOCK_MAX_GAP) && (last - block->reg <= maxregs)) {
+				block->nregs = last - block->reg;
+				continue;
+			}
 		}
+
+		block = &mbcache.block[mbcache.nblocks++];
+		block->reg = first;
+		block->nregs = last - first;
 	}
 
-	return crc;
+	for (i = 0; i < mbcache.nblocks; i++) {
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCachePlan. block %d: reg=%u, nregs=%u", i, mbcache.block[i].reg, mbcache.block[i].nregs);
+	}
+
+	upsdebugx(1, "%d MODBUS register range(s) read in %d transaction(s)", mbcache.nranges, mbcache.nblocks);
+}
+
+/* declare a range of registers that will be read through the cache */
+void ModbusCacheAddRange(uint16_t reg, unsigned int nregs)
+{
+	if ((nregs == 0) || (nregs > MODBUS_MAX_READ_REGS)) {
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCacheAddRange. Range not cached: reg=%u, nregs=%u", reg, nregs);
+		return;
+	}
+
+	/* plan again on next read */
+	free(mbcache.block);
+	mbcache.block = NULL;
+	mbcache.nblocks = 0;
+
+	mbcache.range = xrealloc(mbcache.range, (mbcache.nranges + 1) * sizeof(*mbcache.range));
+	mbcache.range[mbcache.nranges][0] = reg;
+	mbcache.range[mbcache.nranges][1] = reg + nregs;
+	mbcache.nranges++;
 }
 
+void ModbusCacheFree(void)
+{
+	free(mbcache.range);
+	free(mbcache.block);
 
+	mbcache.range = NULL;
+	mbcache.nranges = 0;
+	mbcache.block = NULL;
+	mbcache.nblocks = 0;
+}
 
+/* forget the cached values of these registers */
+void ModbusCacheInvalidate(uint16_t reg, unsigned int nregs)
+{
+	int	i;
+	unsigned int	r;
+
+	for (i = 0; i < mbcache.nblocks; i++) {
+		ModbusBlock	*block = &mbcache.block[i];
+
+		for (r = reg; r < reg + nregs; r++) {
+			if ((r >= block->reg) && (r < (unsigned int)(block->reg + block->nregs)))
+				block->gen[r - block->reg] = 0;
+		}
+	}
+}
+
+/* start a new update cycle: the registers read from now on are served from
+ * the image until the next one */
+void ModbusCacheNewCycle(void)
+{
+	if (++mbcache.cycle == 0) {
+		int	i;
+
+		/* wrapped around, forget everything rather than risk a match */
+		for (i = 0; i < mbcache.nblocks; i++) {
+			memset(mbcache.block[i].gen, 0, sizeof(mbcache.block[i].gen));
+			mbcache.block[i].split = 0;
+		}
+
+		mbcache.cycle = 1;
+	}
+}
+
+/* with age > 0, registers read during the current cycle are good */
+static bool ModbusCacheFresh(const ModbusBlock *block, unsigned int first, unsigned int nregs, int age)
+{
+	unsigned int	r;
+
+	if (age <= 0)
+		return false;
+
+	for (r = first; r < first + nregs; r++) {
+		if (block->gen[r] != mbcache.cycle)
+			return false;
+	}
+
+	return true;
+}
+
+/* read the block at once, unless that was refused not long ago */
+static bool ModbusBlockMerged(ModbusBlock *block)
+{
+	if (block->split && (mbcache.cycle - block->split >= MODBUS_BLOCK_RETRY)) {
+		upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusBlockMerged. Trying block read again (reg=%u, nregs=%u)", block->reg, block->nregs);
+		block->split = 0;
+	}
+
+	return (block->split == 0);
+}
+
+/* return the values of nregs registers from reg, read from the device
+ * unless they were read during the current cycle and age > 0, or NULL on
+ * failure. The returned buffer is only valid until the next call. */
+const uint8_t *ModbusCacheRead(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, int age)
+{
+	static uint8_t	uncached[MODBUS_MAX_PDU_SZ];
+	ModbusBlock	*block = NULL;
+	unsigned int	first, r;
+	int		i;
+
+	if (!mbcache.block && mbcache.nranges) {
+		ModbusCachePlan();
+	}
+
+	for (i = 0; i < mbcache.nblocks; i++) {
+		if ((reg >= mbcache.block[i].reg) && (reg + nregs <= (unsigned int)(mbcache.block[i].reg + mbcache.block[i].nregs))) {
+			block = &mbcache.block[i];
+			break;
+		}
+	}
+
+	if (!block) {
+		if (nregs * sizeof(uint16_t) > sizeof(uncached))
+			return NULL;
+
+		return ModbusReadRegister(udev, modbusID, reg, nregs, uncached) ? uncached : NULL;
+	}
+
+	first = reg - block->reg;
+
+	if (ModbusCacheFresh(block, first, nregs, age)) {
+		return block->data + first * sizeof(uint16_t);
+	}
+
+	if (ModbusBlockMerged(block)) {
+
+		if (ModbusReadRegister(udev, modbusID, block->reg, block->nregs, block->data)) {
+			for (r = 0; r < block->nregs; r++)
+				block->gen[r] = mbcache.cycle;
+
+			return block->data + first * sizeof(uint16_t);
+		}
+
+		/* the gaps may hold registers the device doesn't allow to
+		 * read: if this range can be read alone, stop merging for
+		 * a while (the failure may as well have been transient) */
+		if (nregs == block->nregs)
+			return NULL;
+
+		if (!ModbusReadRegister(udev, modbusID, reg, nregs, block->data + first * sizeof(uint16_t)))
+			return NULL;
+
+		upsdebugx(1, "MODBUS block read refused (reg=%u, nregs=%u), reading its ranges separately", block->reg, block->nregs);
+		block->split = mbcache.cycle;
+	} else if (!ModbusReadRegister(udev, modbusID, reg, nregs, block->data + first * sizeof(uint16_t))) {
+		return NULL;
+	}
+
+	for (r = first; r < first + nregs; r++)
+		block->gen[r] = mbcache.cycle;
+
+	return block->data + first * sizeof(uint16_t);
+}
+
+/* read all the blocks holding registers not read during this cycle (all of
+ * them if age <= 0), keeping
+ * as many requests outstanding as the transport allows. Return the number
+ * of blocks read, or -1 if a request couldn't be sent or the connection
+ * was lost (see ModbusLinkLost()). Blocks that failed
+ * are left to ModbusCacheRead(), which retries and splits them. */
+int ModbusCacheRefresh(modbus_dev_handle_t udev, uint8_t modbusID, int age)
+{
+	struct {
+		uint16_t	tid;
+		ModbusBlock	*block;
+	} pending[MODBUS_MAX_WINDOW];
+	unsigned int	npending = 0, window, i, r;
+	int		next = 0, count = 0;
+
+	if (mblost)
+		return -1;
+
+	if (!mbcache.block && mbcache.nranges) {
+		ModbusCachePlan();
+	}
+
+	window = mbtransport->window;
+	if (window < 1)
+		window = 1;
+	if (window > MODBUS_MAX_WINDOW)
+		window = MODBUS_MAX_WINDOW;
+
+	while ((next < mbcache.nblocks) || (npending > 0)) {
+		ModbusFrame	frm;
+		ModbusBlock	*block;
+		unsigned int	sz;
+		uint16_t	tid;
+
+		while ((npending < window) && (next < mbcache.nblocks)) {
+			uint8_t	pdu[4];
+
+			block = &mbcache.block[next++];
+
+			if (!ModbusBlockMerged(block) || ModbusCacheFresh(block, 0, block->nregs, age))
+				continue;
+
+			pdu[0] = block->reg >> 8;
+			pdu[1] = block->reg;
+			pdu[2] = block->nregs >> 8;
+			pdu[3] = block->nregs;
+
+			sz = ModbusBuildFrame(&frm, modbusID, MODBUS_FC_READ_HOLDING_REGS, pdu, sizeof(pdu));
+			tid = ++mbtid;
+			mbcache.reads++;
+			mbstats.transactions++;
+
+			if (!mbtransport->send(udev, tid, &frm, sz)) {
+				upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCacheRefresh. Failed to send request %u", tid);
+				return -1;
+			}
+
+			pending[npending].tid = tid;
+			pending[npending].block = block;
+			npending++;
+		}
+
+		if (npending == 0)
+			break;
+
+		if (!mbtransport->recv(udev, &tid, &frm, &sz)) {
+			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCacheRefresh. %u response(s) missing", npending);
+			mbstats.timeouts += npending;
+			break;
+		}
+
+		for (i = 0; (i < npending) && (pending[i].tid != tid); i++);
+
+		if (i == npending) {
+			upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCacheRefresh. Response to request %u, which isn't pending", tid);
+			mblost = true;
+			break;
+		}
+
+		block = pending[i].block;
+		pending[i] = pending[--npending];
+
+		if ((ModbusCheckFrame(&frm, sz, modbusID, MODBUS_FC_READ_HOLDING_REGS, block->nregs * sizeof(uint16_t) + 1) != 1) ||
+			(frm[2] != block->nregs * sizeof(uint16_t))) {
+			mbstats.errors++;
+			continue;
+		}
+
+		memcpy(block->data, frm + 3, block->nregs * sizeof(uint16_t));
+		for (r = 0; r < block->nregs; r++)
+			block->gen[r] = mbcache.cycle;
+
+		count++;
+	}
+
+	upsdebugx(MODBUS_MESSAGES_DEBUG_LEVEL, "libmodbus::ModbusCacheRefresh. %d of %d block(s) read", count, mbcache.nblocks);
+	return count;
+}
+
+/* number of read transactions so far */
+unsigned int ModbusReadCount(void)
+{
+	return mbcache.reads;
+}
+
+/* transaction counters since startup */
+const modbus_stats_t *ModbusGetStats(void)
+{
+	return &mbstats;
+}
@@ -65,12 +65,65 @@
 
 #ifdef MODBUS_OVER_HID
 typedef usb_dev_handle *		modbus_dev_handle_t;
+#else
+typedef int			modbus_dev_handle_t;	/* serial port or socket */
 #endif
 
+/* largest number of registers in a FC3 read (MODBUS application protocol) */
+#define MODBUS_MAX_READ_REGS	125
+
+/* largest number of requests a transport may keep outstanding */
+#define MODBUS_MAX_WINDOW	8
+
+/* A transport carries RTU frames (slave address, function code, PDU and
+ * CRC) to and from the device. Transports without a CRC of their own
+ * strip it on send and fill it in on receive. Transports that can keep
+ * several requests outstanding ('window' > 1) tag them with 'tid', and
+ * return the tag of each response they receive. */
+typedef struct {
+	const char	*name;
+	unsigned int	maxframe;	/* largest frame, without CRC */
+	unsigned int	window;		/* requests that may be outstanding */
+	bool	(*send)(modbus_dev_handle_t udev, uint16_t tid, const ModbusFrame *frm, unsigned int sz);
+	bool	(*recv)(modbus_dev_handle_t udev, uint16_t *tid, ModbusFrame *frm, unsigned int *sz);
+} modbus_transport_t;
+
+#ifdef MODBUS_OVER_HID
+extern const modbus_transport_t	modbus_hid_transport;
+#else
+extern const modbus_transport_t	modbus_rtu_transport;
+extern const modbus_transport_t	modbus_tcp_transport;
+#endif
+
+/* transaction counters, for statistics and benchmarking */
+typedef struct {
+	unsigned int	transactions;	/* requests sent, retries included */
+	unsigned int	retries;	/* requests sent again by ModbusSendAndWait() */
+	unsigned int	timeouts;	/* requests left without a response */
+	unsigned int	errors;		/* responses with a bad CRC, exception or size */
+} modbus_stats_t;
+
 
 /* ---------------------------------------------------------------------- */
 
-uint8_t *ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs);
+void ModbusSetTransport(const modbus_transport_t *transport);
+bool ModbusLinkLost(void);
+void ModbusLinkReset(void);
+
+bool ModbusReadRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, uint8_t *data);
 bool ModbusWriteRegister(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, const uint8_t *data);
 
+/* CRC-16/MODBUS of a frame, sent LSB first */
+uint16_t ModbusCrc(const uint8_t *data, unsigned int sz);
+
+/* register image cache */
+void ModbusCacheAddRange(uint16_t reg, unsigned int nregs);
+const uint8_t *ModbusCacheRead(modbus_dev_handle_t udev, uint8_t modbusID, uint16_t reg, unsigned int nregs, int age);
+int ModbusCacheRefresh(modbus_dev_handle_t udev, uint8_t modbusID, int age);
+void ModbusCacheNewCycle(void);
+void ModbusCacheInvalidate(uint16_t reg, unsigned int nregs);
+void ModbusCacheFree(void);
+unsigned int ModbusReadCount(void);
+const modbus_stats_t *ModbusGetStats(void);
+
 #endif /* _LIBMODBUS_H */
@@ -498,6 +498,70 @@ static void setup_signals(void)
 	sigaction(SIGPIPE, &sa, NULL);
 }
 
+/* return 1 if extrafd has data waiting, without blocking */
+static int extrafd_ready(void)
+{
+	fd_set	rfds;
+	struct timeval	tv;
+
+	if (extrafd == -1) {
+		return 0;
+	}
+
+	FD_ZERO(&rfds);
+	FD_SET(extrafd, &rfds);
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	return (select(extrafd + 1, &rfds, NULL, NULL, &tv) > 0);
+}
+
+/* wait until <timeout> while servicing the driver socket. If the driver
+ * installed an idle handler, it is called repeatedly with the number of
+ * msec left, to service its device for (part of) that time, and the
+ * sockets are checked in between. The handler returns 0 to keep waiting,
+ * > 0 to request an update right away and < 0 if it can't be used now */
+static void main_wait(struct timeval timeout)
+{
+	struct timeval	now;
+	long		left;
+	int		ret;
+
+	while (upsh.idle && !exit_flag) {
+
+		gettimeofday(&now, NULL);
+
+		left = (timeout.tv_sec - now.tv_sec) * 1000 + (timeout.tv_usec - now.tv_usec) / 1000;
+
+		if (left <= 0) {
+			return;
+		}
+
+		ret = upsh.idle(left);
+
+		if (ret > 0) {
+			return;
+		}
+
+		if (ret < 0) {
+			break;
+		}
+
+		/* time is already up, so this won't block */
+		dstate_poll_fds(now, extrafd);
+
+		/* dstate_poll_fds() can't tell this from the time being up */
+		if (extrafd_ready()) {
+			return;
+		}
+	}
+
+	while (!dstate_poll_fds(timeout, extrafd) && !exit_flag) {
+		/* repeat until time is up or extrafd has data */
+	}
+}
+
 int main(int argc, char **argv)
 {
 	struct	passwd	*new_uid = NULL;
@@ -740,9 +804,7 @@ int main(int argc, char **argv)
 				update_count++;
 		}
 
-		while (!dstate_poll_fds(timeout, extrafd) && !exit_flag) {
-			/* repeat until time is up or extrafd has data */
-		}
+		main_wait(timeout);
 	}
 
 	/* if we get here, the exit flag was set by a signal handler */
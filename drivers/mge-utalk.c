@@ -879,7 +879,7 @@ static int mge_command(char *reply, int replylen, const char *fmt, ...)
 	usleep(500000);
 	
 	/* flush received, unread data */
-	tcflush(upsfd, TCIFLUSH);
+	ser_flush_in(upsfd, "", 0);
 	
 	/* send command */
 	for (p = command; *p; p++) {
@@ -20,6 +20,7 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,7 +34,7 @@
 #include "mge-xml.h"
 #include "main.h" /* for testvar() */
 
-#define MGE_XML_VERSION		"MGEXML/0.28"
+#define MGE_XML_VERSION		"MGEXML/0.30"
 
 #define MGE_XML_INITUPS		"/"
 #define MGE_XML_INITINFO	"/mgeups/product.xml /product.xml /ws/product.xml"
@@ -1114,277 +1115,327 @@ static xml_info_t mge_xml2nut[] = {
 	{ NULL, 0, 0, NULL, 0, 0, NULL }
 };
 
-/* A start-element callback for element with given namespace/name. */
-static int mge_xml_startelm_cb(void *userdata, int parent, const char *nspace, const char *name, const char **atts)
+/* Elements expected under each parent, and the resulting state */
+typedef struct {
+	int		parent;		/* state of the parent element */
+	const char	*name;		/* element name */
+	int		state;		/* state of the element */
+} xml_elm_t;
+
+static const xml_elm_t mge_xml_elements[] = {
+	{ ROOTPARENT, "PRODUCT_INFO", PRODUCT_INFO },
+	{ ROOTPARENT, "SUMMARY", SUMMARY },
+	{ ROOTPARENT, "GET_OBJECT", GET_OBJECT },
+	{ ROOTPARENT, "SET_OBJECT", SET_OBJECT },
+	{ ROOTPARENT, "ALARM", ALARM },
+	{ ROOTPARENT, "XML-CLIENT", XML_CLIENT },
+
+	{ PRODUCT_INFO, "SUMMARY", PI_SUMMARY },
+	{ PRODUCT_INFO, "ALARMS", PI_ALARMS },
+	{ PRODUCT_INFO, "MANAGEMENT", PI_MANAGEMENT },
+	{ PRODUCT_INFO, "UPS_DATA", PI_UPS_DATA },
+	{ PRODUCT_INFO, "DEV_DATA", PI_UPS_DATA },
+
+	{ PI_SUMMARY, "HTML_PROPERTIES_PAGE", PI_HTML_PROPERTIES_PAGE },
+	{ PI_SUMMARY, "XML_SUMMARY_PAGE", PI_XML_SUMMARY_PAGE },
+	{ PI_SUMMARY, "CENTRAL_CFG", PI_CENTRAL_CFG },
+	{ PI_SUMMARY, "CSV_LOGS", PI_CSV_LOGS },
+
+	{ PI_ALARMS, "SUBSCRIPTION", PI_SUBSCRIPTION },
+	{ PI_ALARMS, "POLLING", PI_POLLING },
+
+	{ PI_MANAGEMENT, "MANAGEMENT_PAGE", PI_MANAGEMENT_PAGE },
+	{ PI_MANAGEMENT, "XML_MANAGEMENT_PAGE", PI_XML_MANAGEMENT_PAGE },
+
+	{ PI_UPS_DATA, "GET_OBJECT", PI_GET_OBJECT },
+	{ PI_UPS_DATA, "SET_OBJECT", PI_SET_OBJECT },
+
+	{ SUMMARY, "OBJECT", SU_OBJECT },
+
+	{ GET_OBJECT, "OBJECT", GO_OBJECT },
+
+	{ XML_CLIENT, "GENERAL", XC_GENERAL },
+	/* the XC_GENERAL elements are accepted right under XML_CLIENT too */
+	{ XML_CLIENT, "STARTUP", XC_STARTUP },
+	{ XML_CLIENT, "SHUTDOWN", XC_SHUTDOWN },
+	{ XML_CLIENT, "BROADCAST", XC_BROADCAST },
+
+	{ XC_GENERAL, "STARTUP", XC_STARTUP },
+	{ XC_GENERAL, "SHUTDOWN", XC_SHUTDOWN },
+	{ XC_GENERAL, "BROADCAST", XC_BROADCAST },
+
+	{ 0, NULL, 0 }
+};
+
+/* Open addressing hash tables for the element names (keyed by parent state
+ * and name) and for mge_xml2nut (keyed by XML name and by NUT name), built
+ * on first use; the names are compared case insensitively and the first
+ * table entry wins, as the linear scans did. They are sized from the
+ * tables, twice their entry count, which keeps the load factor below 50%. */
+#define MGE_XML_ELM_HASH	(2 * sizeof(mge_xml_elements) / sizeof(xml_elm_t))
+#define MGE_XML_VAR_HASH	(2 * sizeof(mge_xml2nut) / sizeof(xml_info_t))
+
+static const xml_elm_t	*mge_xml_elm_hash[MGE_XML_ELM_HASH];
+static xml_info_t	*mge_xml_byxml[MGE_XML_VAR_HASH];
+static xml_info_t	*mge_xml_bynut[MGE_XML_VAR_HASH];
+static int	mge_xml_hashed = 0;
+
+static unsigned int mge_xml_hash(const char *name, int seed)
 {
-	int	state = _UNEXPECTED;
+	unsigned int	h = 5381 + seed;
 
-	switch(parent)
-	{
-	case ROOTPARENT:
-		if (!strcasecmp(name, "PRODUCT_INFO")) {
-			/* name="Network Management Card" type="Mosaic M" version="BA" */
-			/* name="Network Management Card" type="Transverse" version="GB (SN 49EH29101)" */
-			/* name="Monitored ePDU" type="Monitored ePDU" version="Version Upgrade" */
-			/* name="PDU Network Management Card" type="SCOB" version="02.00.0036" signature="34008876" protocol="XML.V4" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "name")) {
-					snprintf(val, sizeof(val), "%s", atts[i+1]);
-				}
-				if (!strcasecmp(atts[i], "type")) {
-					snprintfcat(val, sizeof(val), "/%s", atts[i+1]);
-					if (!strcasecmp(atts[i+1], "Transverse")) {
-						mge_ambient_value = 1;
-					} else if (strstr(atts[i+1], "ePDU")) {
-						dstate_setinfo("device.type", "pdu");
-					}
-				}
-				if (!strcasecmp(atts[i], "version")) {
-					char	*s;
-					snprintfcat(val, sizeof(val), "/%s", atts[i+1]);
-					s = strstr(val, " (SN ");
-					if (s) {
-						dstate_setinfo("ups.serial", "%s", str_rtrim(s + 5, ')'));
-						s[0] = '\0';
-					}
-					dstate_setinfo("ups.firmware.aux", "%s", val);
-				}
-				/* netxml-ups currently only supports XML version 3 (for UPS),
-				 * and not version 4 (for UPS and PDU)! */
-				if (!strcasecmp(atts[i], "protocol")) {
-					if (!strcasecmp(atts[i+1], "XML.V4")) {
-						fatalx(EXIT_FAILURE, "XML v4 protocol is not supported!");
-					}
+	while (*name) {
+		h = (h * 33) ^ (unsigned char)tolower((unsigned char)*name++);
+	}
+
+	return h;
+}
+
+static void mge_xml_hash_init(void)
+{
+	const xml_elm_t	*elm;
+	xml_info_t	*info;
+	unsigned int	h;
+	size_t	count = sizeof(mge_xml2nut) / sizeof(xml_info_t);
+
+	for (elm = mge_xml_elements; elm->name != NULL; elm++) {
+		for (h = mge_xml_hash(elm->name, elm->parent) % MGE_XML_ELM_HASH; mge_xml_elm_hash[h]; h = (h + 1) % MGE_XML_ELM_HASH);
+		mge_xml_elm_hash[h] = elm;
+	}
+
+	for (info = mge_xml2nut; info < mge_xml2nut + count; info++) {
+
+		if (info->xmlname != NULL) {
+			for (h = mge_xml_hash(info->xmlname, 0) % MGE_XML_VAR_HASH; mge_xml_byxml[h]; h = (h + 1) % MGE_XML_VAR_HASH) {
+				if (!strcasecmp(mge_xml_byxml[h]->xmlname, info->xmlname)) {
+					break;
 				}
 			}
-			state = PRODUCT_INFO;
-			break;
-		}
-		if (!strcasecmp(name, "SUMMARY")) {
-			state = SUMMARY;
-			break;
-		}
-		if (!strcasecmp(name, "GET_OBJECT")) {
-			state = GET_OBJECT;
-			break;
-		}
-		if (!strcasecmp(name, "SET_OBJECT")) {
-			state = SET_OBJECT;
-			break;
+
+			if (!mge_xml_byxml[h]) {
+				mge_xml_byxml[h] = info;
+			}
 		}
-		if (!strcasecmp(name, "ALARM")) {
-			int	i;
-			var[0] = val[0] = '\0';
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "object")) {
-					snprintf(var, sizeof(var), "%s", atts[i+1]);
-				}
-				if (!strcasecmp(atts[i], "value")) {
-					snprintf(val, sizeof(var), "%s", atts[i+1]);
-				}
-				if (!strcasecmp(atts[i], "date")) {
-					dstate_setinfo("ups.time", "%s", split_date_time(atts[i+1]));
+
+		if (info->nutname != NULL) {
+			for (h = mge_xml_hash(info->nutname, 0) % MGE_XML_VAR_HASH; mge_xml_bynut[h]; h = (h + 1) % MGE_XML_VAR_HASH) {
+				if (!strcasecmp(mge_xml_bynut[h]->nutname, info->nutname)) {
+					break;
 				}
 			}
-			state = ALARM;
-			break;
-		}
-		if (!strcasecmp(name, "XML-CLIENT")) {
-			state = XML_CLIENT;
-			break;
-		}
-		break;
 
-	case PRODUCT_INFO:
-		if (!strcasecmp(name, "SUMMARY")) {
-			state = PI_SUMMARY;
-			break;
+			if (!mge_xml_bynut[h]) {
+				mge_xml_bynut[h] = info;
+			}
 		}
+	}
 
-		if (!strcasecmp(name, "ALARMS")) {
-			state = PI_ALARMS;
-			break;
-		}
+	mge_xml_hashed = 1;
+}
+
+/* Return the state of element name under parent, or _UNEXPECTED */
+static int mge_xml_elm_state(int parent, const char *name)
+{
+	const xml_elm_t	*elm;
+	unsigned int	h;
+
+	if (!mge_xml_hashed) {
+		mge_xml_hash_init();
+	}
 
-		if (!strcasecmp(name, "MANAGEMENT")) {
-			state = PI_MANAGEMENT;
-			break;
+	for (h = mge_xml_hash(name, parent) % MGE_XML_ELM_HASH; (elm = mge_xml_elm_hash[h]) != NULL; h = (h + 1) % MGE_XML_ELM_HASH) {
+		if ((elm->parent == parent) && !strcasecmp(elm->name, name)) {
+			return elm->state;
 		}
+	}
+
+	return _UNEXPECTED;
+}
+
+/* Return the first mge_xml2nut entry for the XML variable name, or NULL */
+static xml_info_t *mge_xml_find_xmlname(const char *name)
+{
+	xml_info_t	*info;
+	unsigned int	h;
+
+	if (!mge_xml_hashed) {
+		mge_xml_hash_init();
+	}
 
-		if ( (!strcasecmp(name, "UPS_DATA"))
-			|| (!strcasecmp(name, "DEV_DATA")) ) {
-			state = PI_UPS_DATA;
-			break;
+	for (h = mge_xml_hash(name, 0) % MGE_XML_VAR_HASH; (info = mge_xml_byxml[h]) != NULL; h = (h + 1) % MGE_XML_VAR_HASH) {
+		if (!strcasecmp(info->xmlname, name)) {
+			return info;
 		}
-		break;
+	}
+
+	return NULL;
+}
+
+/* Return the first mge_xml2nut entry for the NUT variable name, or NULL */
+static xml_info_t *mge_xml_find_nutname(const char *name)
+{
+	xml_info_t	*info;
+	unsigned int	h;
+
+	if (!mge_xml_hashed) {
+		mge_xml_hash_init();
+	}
 
-	case PI_SUMMARY:
-		if (!strcasecmp(name, "HTML_PROPERTIES_PAGE")) {
-			/* url="mgeups/default.htm" */
-			state = PI_HTML_PROPERTIES_PAGE;
-			break;
+	for (h = mge_xml_hash(name, 0) % MGE_XML_VAR_HASH; (info = mge_xml_bynut[h]) != NULL; h = (h + 1) % MGE_XML_VAR_HASH) {
+		if (!strcasecmp(info->nutname, name)) {
+			return info;
 		}
-		if (!strcasecmp(name, "XML_SUMMARY_PAGE")) {
-			/* url="upsprop.xml" or url="ws/summary.xml" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "url")) {
-					free(mge_xml_subdriver.summary);
-					mge_xml_subdriver.summary = strdup(url_convert(atts[i+1]));
+	}
+
+	return NULL;
+}
+
+/* A start-element callback for element with given namespace/name. */
+static int mge_xml_startelm_cb(void *userdata, int parent, const char *nspace, const char *name, const char **atts)
+{
+	int	i, state = mge_xml_elm_state(parent, name);
+
+	/* handle the attributes of the elements that have interesting ones */
+	switch(state)
+	{
+	case PRODUCT_INFO:
+		/* name="Network Management Card" type="Mosaic M" version="BA" */
+		/* name="Network Management Card" type="Transverse" version="GB (SN 49EH29101)" */
+		/* name="Monitored ePDU" type="Monitored ePDU" version="Version Upgrade" */
+		/* name="PDU Network Management Card" type="SCOB" version="02.00.0036" signature="34008876" protocol="XML.V4" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "name")) {
+				snprintf(val, sizeof(val), "%s", atts[i+1]);
+			}
+			if (!strcasecmp(atts[i], "type")) {
+				snprintfcat(val, sizeof(val), "/%s", atts[i+1]);
+				if (!strcasecmp(atts[i+1], "Transverse")) {
+					mge_ambient_value = 1;
+				} else if (strstr(atts[i+1], "ePDU")) {
+					dstate_setinfo("device.type", "pdu");
 				}
 			}
-			state = PI_XML_SUMMARY_PAGE;
-			break;
-		}
-		if (!strcasecmp(name, "CENTRAL_CFG")) {
-			/* url="config.xml" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "url")) {
-					free(mge_xml_subdriver.configure);
-					mge_xml_subdriver.configure = strdup(url_convert(atts[i+1]));
+			if (!strcasecmp(atts[i], "version")) {
+				char	*s;
+				snprintfcat(val, sizeof(val), "/%s", atts[i+1]);
+				s = strstr(val, " (SN ");
+				if (s) {
+					dstate_setinfo("ups.serial", "%s", str_rtrim(s + 5, ')'));
+					s[0] = '\0';
 				}
+				dstate_setinfo("ups.firmware.aux", "%s", val);
 			}
-			state = PI_CENTRAL_CFG;
-			break;
-		}
-		if (!strcasecmp(name, "CSV_LOGS")) {
-			/* url="logevent.csv" dateRange="no" eventFiltering="no" */
-			state = PI_CSV_LOGS;
-			break;
-		}
-		break;
-
-	case PI_ALARMS:
-		if (!strcasecmp(name, "SUBSCRIPTION")) {
-			/* url="subscribe.cgi" security="basic" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "url")) {
-					free(mge_xml_subdriver.subscribe);
-					mge_xml_subdriver.subscribe = strdup(url_convert(atts[i+1]));
+			/* netxml-ups currently only supports XML version 3 (for UPS),
+			 * and not version 4 (for UPS and PDU)! */
+			if (!strcasecmp(atts[i], "protocol")) {
+				if (!strcasecmp(atts[i+1], "XML.V4")) {
+					fatalx(EXIT_FAILURE, "XML v4 protocol is not supported!");
 				}
 			}
-			state = PI_SUBSCRIPTION;
-			break;
 		}
+		break;
 
-		if (!strcasecmp(name, "POLLING")) {
-			/* url="mgeups/lastalarms.cgi" security="none" */
-			state = PI_POLLING;
-			break;
+	case ALARM:
+		var[0] = val[0] = '\0';
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "object")) {
+				snprintf(var, sizeof(var), "%s", atts[i+1]);
+			}
+			if (!strcasecmp(atts[i], "value")) {
+				snprintf(val, sizeof(var), "%s", atts[i+1]);
+			}
+			if (!strcasecmp(atts[i], "date")) {
+				dstate_setinfo("ups.time", "%s", split_date_time(atts[i+1]));
+			}
 		}
 		break;
 
-
-	case PI_MANAGEMENT:
-		if (!strcasecmp(name, "MANAGEMENT_PAGE")) {
-			/* name="Manager list" id="ManagerList" url="FS/FLASH0/TrapReceiverList.cfg" security="none" */
-			/* name="Shutdown criteria settings" id="Shutdown" url="FS/FLASH0/ShutdownParameters.cfg" security="none" */
-			/* name="Network settings" id="Network" url="FS/FLASH0/NetworkSettings.cfg" security="none" */
-			/* name="Centralized configuration settings" id="ClientCfg" url="FS/FLASH0/CentralizedConfig.cfg" security="none" */
-			state = PI_MANAGEMENT_PAGE;
-			break;
-		}
-		if (!strcasecmp(name, "XML_MANAGEMENT_PAGE")) {
-			/* name="Set Card Time" id="SetTime" url="management/set_time.xml" security="none" */
-			state = PI_XML_MANAGEMENT_PAGE;
-			break;
+	case PI_XML_SUMMARY_PAGE:
+		/* url="upsprop.xml" or url="ws/summary.xml" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "url")) {
+				free(mge_xml_subdriver.summary);
+				mge_xml_subdriver.summary = strdup(url_convert(atts[i+1]));
+			}
 		}
 		break;
 
-	case PI_UPS_DATA:
-		if (!strcasecmp(name, "GET_OBJECT")) {
-			/* url="getvalue.cgi" security="none" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "url")) {
-					free(mge_xml_subdriver.getobject);
-					mge_xml_subdriver.getobject = strdup(url_convert(atts[i+1]));
-				}
+	case PI_CENTRAL_CFG:
+		/* url="config.xml" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "url")) {
+				free(mge_xml_subdriver.configure);
+				mge_xml_subdriver.configure = strdup(url_convert(atts[i+1]));
 			}
-			state = PI_GET_OBJECT;
-			break;
 		}
-		if (!strcasecmp(name, "SET_OBJECT")) {
-			/* url="setvalue.cgi" security="ssl" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "url")) {
-					free(mge_xml_subdriver.setobject);
-					mge_xml_subdriver.setobject = strdup(url_convert(atts[i+1]));
-				}
+		break;
+
+	case PI_SUBSCRIPTION:
+		/* url="subscribe.cgi" security="basic" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "url")) {
+				free(mge_xml_subdriver.subscribe);
+				mge_xml_subdriver.subscribe = strdup(url_convert(atts[i+1]));
 			}
-			state = PI_SET_OBJECT;
-			break;
 		}
 		break;
 
-	case SUMMARY:
-		if (!strcasecmp(name, "OBJECT")) {
-			/* name="UPS.PowerSummary.iProduct" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "name")) {
-					snprintf(var, sizeof(var), "%s", atts[i+1]);
-					val[0] = '\0';	/*don't inherit something from another object */
-				}
+	case PI_GET_OBJECT:
+		/* url="getvalue.cgi" security="none" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "url")) {
+				free(mge_xml_subdriver.getobject);
+				mge_xml_subdriver.getobject = strdup(url_convert(atts[i+1]));
 			}
-			state = SU_OBJECT;
-			break;
 		}
 		break;
 
-	case GET_OBJECT:
-		if (!strcasecmp(name, "OBJECT")) {
-			/* name="System.RunTimeToEmptyLimit" unit="s" access="RW" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "name")) {
-					snprintf(var, sizeof(var), "%s", atts[i+1]);
-					val[0] = '\0';	/*don't inherit something from another object */
-				}
-				if (!strcasecmp(atts[i], "access")) {
-					/* do something with RO/RW access? */
-				}
+	case PI_SET_OBJECT:
+		/* url="setvalue.cgi" security="ssl" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "url")) {
+				free(mge_xml_subdriver.setobject);
+				mge_xml_subdriver.setobject = strdup(url_convert(atts[i+1]));
 			}
-			state = GO_OBJECT;
-			break;
 		}
 		break;
 
-	case XML_CLIENT:
-		if (!strcasecmp(name, "GENERAL")) {
-			state = XC_GENERAL;
-			break;
+	case SU_OBJECT:
+		/* name="UPS.PowerSummary.iProduct" */
+	case GO_OBJECT:
+		/* name="System.RunTimeToEmptyLimit" unit="s" access="RW" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "name")) {
+				snprintf(var, sizeof(var), "%s", atts[i+1]);
+				val[0] = '\0';	/*don't inherit something from another object */
+			}
+			/* do something with RO/RW access? */
 		}
+		break;
 
-	case XC_GENERAL:
-		if (!strcasecmp(name, "STARTUP")) {
-			/* config="CENTRALIZED" */
-			state = XC_STARTUP;
-			break;
-		}
-		if (!strcasecmp(name, "SHUTDOWN")) {
-			/* shutdownTimer="NONE" shutdownDuration="150" */
-			int	i;
-			for (i = 0; atts[i] && atts[i+1]; i += 2) {
-				if (!strcasecmp(atts[i], "shutdownTimer")) {
-					dstate_setinfo("driver.timer.shutdown", "%s", atts[i+1]);
-				}
-				if (!strcasecmp(atts[i], "shutdownDuration")) {
-					dstate_setinfo("driver.delay.shutdown", "%s", atts[i+1]);
-				}
+	case XC_SHUTDOWN:
+		/* shutdownTimer="NONE" shutdownDuration="150" */
+		for (i = 0; atts[i] && atts[i+1]; i += 2) {
+			if (!strcasecmp(atts[i], "shutdownTimer")) {
+				dstate_setinfo("driver.timer.shutdown", "%s", atts[i+1]);
+			}
+			if (!strcasecmp(atts[i], "shutdownDuration")) {
+				dstate_setinfo("driver.delay.shutdown", "%s", atts[i+1]);
 			}
-			state = XC_SHUTDOWN;
-			break;
-		}
-		if (!strcasecmp(name, "BROADCAST")) {
-			/* admins="ON" users="ON" */
-			state = XC_BROADCAST;
-			break;
 		}
+		break;
+
+	/* The other ones, for reference:
+	 * PI_HTML_PROPERTIES_PAGE: url="mgeups/default.htm"
+	 * PI_CSV_LOGS: url="logevent.csv" dateRange="no" eventFiltering="no"
+	 * PI_POLLING: url="mgeups/lastalarms.cgi" security="none"
+	 * PI_MANAGEMENT_PAGE: name="Shutdown criteria settings" id="Shutdown" url="FS/FLASH0/ShutdownParameters.cfg" security="none"
+	 * PI_XML_MANAGEMENT_PAGE: name="Set Card Time" id="SetTime" url="management/set_time.xml" security="none"
+	 * XC_STARTUP: config="CENTRALIZED"
+	 * XC_BROADCAST: admins="ON" users="ON"
+	 */
+	default:
+		break;
 	}
 
 	upsdebugx(3, "%s: name <%s> (parent = %d, state = %d)", __func__, name, parent, state);
@@ -1436,17 +1487,20 @@ static int mge_xml_endelm_cb(void *userdata, int state, const char *nspace, cons
 	case ALARM:
 	case SU_OBJECT:
 	case GO_OBJECT:
-		for (info = mge_xml2nut; info->xmlname != NULL; info++) {
-			if (strcasecmp(var, info->xmlname)) {
-				continue;
-			}
+		info = mge_xml_find_xmlname(var);
 
+		if (info != NULL) {
 			upsdebugx(3, "-> XML variable %s [%s] maps to NUT variable %s", var, val, info->nutname);
 
 			if ((info->nutflags & ST_FLAG_STATIC) && dstate_getinfo(info->nutname)) {
 				return 0;
 			}
 
+			if ((state == ALARM) && (info->nutname != NULL) && !dstate_getinfo(info->nutname)) {
+				upsdebugx(2, "-> alarm on NUT variable %s not reported yet", info->nutname);
+				ups_alarm_unseen = 1;
+			}
+
 			if (info->convert) {
 				value = info->convert(val);
 				upsdebugx(4, "-> XML variable %s [%s] which maps to NUT variable %s was converted to value %s for the NUT driver state", var, val, info->nutname, value);
@@ -1504,15 +1558,10 @@ subdriver_t mge_xml_subdriver = {
 const char *vname_nut2mge_xml(const char *name) {
 	assert(NULL != name);
 
-	size_t i = 0;
-
-	for (; i < sizeof(mge_xml2nut) / sizeof(xml_info_t); ++i) {
-		xml_info_t *info = mge_xml2nut + i;
+	xml_info_t *info = mge_xml_find_nutname(name);
 
-		if (NULL != info->nutname)
-			if (0 == strcasecmp(name, info->nutname))
-				return info->xmlname;
-	}
+	if (NULL != info)
+		return info->xmlname;
 
 	return NULL;
 }
@@ -1520,15 +1569,10 @@ const char *vname_nut2mge_xml(const char *name) {
 const char *vname_mge_xml2nut(const char *name) {
 	assert(NULL != name);
 
-	size_t i = 0;
-
-	for (; i < sizeof(mge_xml2nut) / sizeof(xml_info_t); ++i) {
-		xml_info_t *info = mge_xml2nut + i;
+	xml_info_t *info = mge_xml_find_xmlname(name);
 
-		if (NULL != info->xmlname)
-			if (0 == strcasecmp(name, info->xmlname))
-				return info->nutname;
-	}
+	if (NULL != info)
+		return info->nutname;
 
 	return NULL;
 }
@@ -1536,33 +1580,28 @@ const char *vname_mge_xml2nut(const char *name) {
 char *vvalue_mge_xml2nut(const char *name, const char *value, size_t len) {
 	assert(NULL != name);
 
-	size_t i = 0;
-
-	for (; i < sizeof(mge_xml2nut) / sizeof(xml_info_t); ++i) {
-		xml_info_t *info = mge_xml2nut + i;
+	xml_info_t *info = mge_xml_find_nutname(name);
 
-		if (NULL != info->nutname)
-			if (0 == strcasecmp(name, info->nutname)) {
-				/* Copy value */
-				char *vcpy = (char *)malloc((len + 1) * sizeof(char));
+	if (NULL != info) {
+		/* Copy value */
+		char *vcpy = (char *)malloc((len + 1) * sizeof(char));
 
-				if (NULL == vcpy)
-					return vcpy;
+		if (NULL == vcpy)
+			return vcpy;
 
-				memcpy(vcpy, value, len * sizeof(char));
-				vcpy[len] = '\0';
+		memcpy(vcpy, value, len * sizeof(char));
+		vcpy[len] = '\0';
 
-				/* Convert */
-				if (NULL != info->convert) {
-					char *vconv = (char *)info->convert(vcpy);
+		/* Convert */
+		if (NULL != info->convert) {
+			char *vconv = (char *)info->convert(vcpy);
 
-					free(vcpy);
+			free(vcpy);
 
-					return vconv;
-				}
-				else
-					return vcpy;
-			}
+			return vconv;
+		}
+		else
+			return vcpy;
 	}
 
 	return NULL;
@@ -95,9 +95,12 @@ bool scaleDT(MB_DataType dt, uint8_t *scale) {
 		case DT_ENUMERATION: {*scale = 0; return false; }
 
 	}
+
+	*scale = 0;
+	return false;
 }
 
-uint64_t BE2LE(uint8_t *reg, uint8_t sz) {
+uint64_t BE2LE(const uint8_t *reg, uint8_t sz) {
 	uint64_t value = 0; int i;
 	for (i = 0; i < sz ; i++) {
 		value = value << 8;
@@ -106,6 +109,37 @@ uint64_t BE2LE(uint8_t *reg, uint8_t sz) {
 	return value;
 }
 
+/* value of nregs registers holding data of type dt; enumerations and
+ * strings are left alone */
+void MBDecodeValue(MB_DataType dt, const uint8_t *reg, uint8_t nregs, double *Value) {
+	uint8_t nbytes = nregs * sizeof(uint16_t);
+	uint64_t v = BE2LE(reg, nbytes);
+	uint8_t scale = 9;
+
+	switch (decodeDT(dt)) {
+		case 1: {			//DT_BINARYPOINT
+			if (scaleDT(dt, &scale))
+			{
+				// Sign extend
+				int64_t sint = v;
+				sint <<= (8 * (sizeof(v) - nbytes));
+				sint >>= (8 * (sizeof(v) - nbytes));
+				*Value = (double)sint / (1ULL << scale);
+			}
+			else
+			{
+				*Value = (double)v / (1ULL << scale);
+			}
+			break;
+		}
+		case 2: break;		//DT_ENUMERATION
+		case 3: break;		//DT_STRING
+		case 0:				//DT_BITFIELD
+		default:
+			*Value = (double)v;
+	}
+}
+
 void LE2BE(uint64_t val, uint8_t *reg, uint8_t sz) {
 	unsigned int i;
 	for (i = 0; i < sz; ++i)
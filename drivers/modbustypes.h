@@ -45,7 +45,9 @@
 #include <time.h>
 
 #include <stdbool.h>
+#ifdef MODBUS_OVER_HID
 #include <usb.h>
+#endif
 
 // MODBUS message sizes
 #define MODBUS_MAX_FRAME_SZ 256
@@ -96,8 +98,9 @@ typedef enum {
 bool scaleDT(MB_DataType dt, uint8_t *scale);
 int decodeDT(MB_DataType dt);
 
-uint64_t BE2LE(uint8_t *reg, uint8_t sz);
+uint64_t BE2LE(const uint8_t *reg, uint8_t sz);
 void LE2BE(uint64_t val, uint8_t *reg, uint8_t sz);
+void MBDecodeValue(MB_DataType dt, const uint8_t *reg, uint8_t nregs, double *Value);
 
 
 // Dates in APC MODBUS registers are expressed as number of days since 
@@ -110,7 +113,9 @@ static const time_t MODBUS_BASE_TIMESTAMP = 946684800;
 typedef uint8_t ModbusFrame[MODBUS_MAX_FRAME_SZ];
 typedef uint8_t ModbusPdu[MODBUS_MAX_PDU_SZ];
 
+#ifdef MODBUS_OVER_HID
 typedef usb_dev_handle *		usb_dev_handle_t;
+#endif
 
 #define TV_DIFF_MS(a, b) (((b).tv_sec - (a).tv_sec) * 1000 + ((b).tv_usec - (a).tv_usec) / 1000) 
 
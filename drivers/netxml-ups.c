@@ -24,6 +24,7 @@
 #include "mge-xml.h"
 #include "dstate.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,7 +41,7 @@
 #include <ne_socket.h>
 
 #define DRIVER_NAME	"network XML UPS"
-#define DRIVER_VERSION	"0.42"
+#define DRIVER_VERSION	"0.44"
 
 /** *_OBJECT query multi-part body boundary */
 #define FORM_POST_BOUNDARY "NUT-NETXML-UPS-OBJECTS"
@@ -227,21 +228,60 @@ static ne_buffer *set_object_serialise_form(object_query_t *handle);
 
 /* Global vars */
 uint32_t		ups_status = 0;
+int			ups_alarm_unseen = 0;
 static int		timeout = 5;
 int			shutdown_duration = 120;
 static int		shutdown_timer = 0;
 static time_t		lastheard = 0;
+static int		eventonly = 0;
+static int		refresh = 300;
+static time_t		lastrefresh = 0;
 static subdriver_t	*subdriver = &mge_xml_subdriver;
 static ne_session	*session = NULL;
 static ne_socket	*sock = NULL;
 static ne_uri		uri;
 
+/** Validators of the pages got last, for conditional requests */
+typedef struct {
+	char	*page;		/**< Page path                     */
+	char	*etag;		/**< ETag header, or \c NULL          */
+	char	*lastmod;	/**< Last-Modified header, or \c NULL */
+} page_cache_t;
+
+#define PAGE_CACHE_SIZE	8
+
+static page_cache_t	page_cache[PAGE_CACHE_SIZE];
+
+/** Alarm channel: the messages are reassembled across reads, and each one
+ *  is parsed once its root element is complete */
+typedef enum {
+	ALARM_TEXT = 0,  /**< Between tags                  */
+	ALARM_LT,        /**< Just after '<'                */
+	ALARM_STAG,      /**< In a start (or empty) tag     */
+	ALARM_ETAG,      /**< In an end tag                 */
+	ALARM_DECL,      /**< In a <?...?> or <!...> markup */
+	ALARM_QUOTE,     /**< In an attribute value         */
+} alarm_scan_t;  /* end of typedef enum */
+
+static struct {
+	char		buf[LARGEBUF];  /**< Message received so far    */
+	size_t		len;            /**< Length of the message      */
+	alarm_scan_t	scan;           /**< Scanner state              */
+	char		quote;          /**< Quote of the attribute     */
+	int		slash;          /**< Last tag character was '/' */
+	int		depth;          /**< Open elements              */
+} alarm_msg;
+
 /* Support functions */
 static void netxml_alarm_set(void);
 static void netxml_status_set(void);
 static int netxml_authenticate(void *userdata, const char *realm, int attempt, char *username, char *password);
-static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser);
+static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser, page_cache_t *cache);
 static int netxml_get_page(const char *page);
+static page_cache_t *netxml_page_cache(const char *page);
+static void netxml_alarm_reset(void);
+static void netxml_alarm_feed(const char *data, size_t len);
+static void netxml_alarm_parse(const char *msg, size_t len);
 
 static int instcmd(const char *cmdname, const char *extra);
 static int setvar(const char *varname, const char *val);
@@ -275,6 +315,9 @@ void upsdrv_initinfo(void)
 		if (testvar("subscribe") && (netxml_alarm_subscribe(subdriver->subscribe) == NE_OK)) {
 			extrafd = ne_sock_fd(sock);
 			time(&lastheard);
+		} else if (eventonly) {
+			upslogx(LOG_WARNING, "NSM subscription failed, event-only mode disabled");
+			eventonly = 0;
 		}
 
 		/* Register r/w variables */
@@ -298,20 +341,23 @@ void upsdrv_updateinfo(void)
 	 * processing of alarms and polling for data separated. Currently, this isn't supported by the
 	 * driver main body, so we'll have to revert to polling each time we're called, unless the
 	 * socket indicates we're no longer connected.
+	 * The alarm socket is the extrafd though, so the main loop calls us as soon as it is readable.
 	 */
 	if (testvar("subscribe")) {
 		char	buf[LARGEBUF];
 
-		ret = ne_sock_read(sock, buf, sizeof(buf));
+		if (eventonly && (ne_sock_block(sock, 0) == NE_SOCK_TIMEOUT)) {
+			/* nothing received yet, don't wait for it */
+			ret = NE_SOCK_TIMEOUT;
+		} else {
+			ret = ne_sock_read(sock, buf, sizeof(buf));
+		}
 
 		if (ret > 0) {
-			/* alarm message received */
+			/* alarm message(s) received, maybe partly */
 
-			ne_xml_parser	*parser = ne_xml_create();
-			upsdebugx(2, "%s: ne_sock_read(%d bytes) => %s", __func__, ret, buf);
-			ne_xml_push_handler(parser, subdriver->startelm_cb, subdriver->cdata_cb, subdriver->endelm_cb, NULL);
-			ne_xml_parse(parser, buf, strlen(buf));
-			ne_xml_destroy(parser);
+			upsdebugx(2, "%s: ne_sock_read(%d bytes) => %.*s", __func__, ret, ret, buf);
+			netxml_alarm_feed(buf, ret);
 			time(&lastheard);
 
 		} else if ((ret == NE_SOCK_TIMEOUT) && (difftime(time(NULL), lastheard) < 180)) {
@@ -330,6 +376,8 @@ void upsdrv_updateinfo(void)
 			if (netxml_alarm_subscribe(subdriver->subscribe) == NE_OK) {
 				extrafd = ne_sock_fd(sock);
 				time(&lastheard);
+				/* alarms may have been missed in between */
+				lastrefresh = 0;
 				return;
 			}
 
@@ -339,20 +387,30 @@ void upsdrv_updateinfo(void)
 		}
 	}
 
-	/* get additional data */
-	ret = netxml_get_page(subdriver->getobject);
-	if (ret != NE_OK) {
-		errors++;
-	}
+	/* in event-only mode, the alarms keep the status up to date, and the
+	 * pages are only read again every 'refresh' seconds, or when an alarm
+	 * was about a variable they didn't report yet */
+	if (eventonly && !ups_alarm_unseen && (difftime(time(NULL), lastrefresh) < refresh)) {
+		upsdebugx(2, "%s: no refresh of the pages needed", __func__);
+	} else {
+		/* get additional data */
+		ret = netxml_get_page(subdriver->getobject);
+		if (ret != NE_OK) {
+			errors++;
+		}
 
-	ret = netxml_get_page(subdriver->summary);
-	if (ret != NE_OK) {
-		errors++;
-	}
+		ret = netxml_get_page(subdriver->summary);
+		if (ret != NE_OK) {
+			errors++;
+		}
 
-	if (errors > 1) {
-		dstate_datastale();
-		return;
+		if (errors > 1) {
+			dstate_datastale();
+			return;
+		}
+
+		ups_alarm_unseen = 0;
+		time(&lastrefresh);
 	}
 
 	status_init();
@@ -500,6 +558,11 @@ void upsdrv_makevartable(void)
 
 	addvar(VAR_FLAG, "subscribe", "authenticated subscription on NMC");
 
+	addvar(VAR_FLAG, "eventonly", "with subscribe, update the status from the alarms only");
+
+	snprintf(buf, sizeof(buf), "interval between full refreshes in event-only mode (default: %d seconds)", refresh);
+	addvar(VAR_VALUE, "refresh", buf);
+
 	addvar(VAR_VALUE | VAR_SENSITIVE, "login", "login value for authenticated mode");
 	addvar(VAR_VALUE | VAR_SENSITIVE, "password", "password value for authenticated mode");
 
@@ -545,6 +608,22 @@ void upsdrv_initups(void)
 		}
 	}
 
+	if (testvar("eventonly")) {
+		if (!testvar("subscribe")) {
+			fatalx(EXIT_FAILURE, "eventonly requires subscribe");
+		}
+		eventonly = 1;
+	}
+
+	val = getval("refresh");
+	if (val) {
+		refresh = atoi(val);
+
+		if (refresh < 1) {
+			fatalx(EXIT_FAILURE, "refresh must be greater than 0");
+		}
+	}
+
 	val = getval("shutdown_duration");
 	if (val) {
 		shutdown_duration = atoi(val);
@@ -636,6 +715,8 @@ void upsdrv_initups(void)
 
 void upsdrv_cleanup(void)
 {
+	int	i;
+
 	free(subdriver->configure);
 	free(subdriver->subscribe);
 	free(subdriver->summary);
@@ -646,6 +727,12 @@ void upsdrv_cleanup(void)
 		ne_sock_close(sock);
 	}
 
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+		free(page_cache[i].page);
+		free(page_cache[i].etag);
+		free(page_cache[i].lastmod);
+	}
+
 	if (session) {
 		ne_session_destroy(session);
 	}
@@ -662,17 +749,29 @@ static int netxml_get_page(const char *page)
 	int		ret = NE_ERROR;
 	ne_request	*request;
 	ne_xml_parser	*parser;
+	page_cache_t	*cache;
 
 	upsdebugx(2, "%s: %s", __func__, (page != NULL)?page:"(null)");
 
 	if (page != NULL) {
 		request = ne_request_create(session, "GET", page);
 
+		/* only get the page if it changed since the last time */
+		cache = netxml_page_cache(page);
+
+		if (cache && cache->etag) {
+			ne_add_request_header(request, "If-None-Match", cache->etag);
+		}
+
+		if (cache && cache->lastmod) {
+			ne_add_request_header(request, "If-Modified-Since", cache->lastmod);
+		}
+
 		parser = ne_xml_create();
 
 		ne_xml_push_handler(parser, subdriver->startelm_cb, subdriver->cdata_cb, subdriver->endelm_cb, NULL);
 
-		ret = netxml_dispatch_request(request, parser);
+		ret = netxml_dispatch_request(request, parser, cache);
 
 		if (ret) {
 			upsdebugx(2, "%s: %s", __func__, ne_get_error(session));
@@ -688,6 +787,7 @@ static int netxml_alarm_subscribe(const char *page)
 {
 	int	ret, port = -1, secret = -1;
 	char	buf[LARGEBUF], *s;
+	const char	*answer = "<Subscription Answer=\"ok\"></Subscription>";
 	ne_request	*request;
 	ne_sock_addr	*addr;
 	const ne_inet_addr	*ai;
@@ -699,6 +799,7 @@ static int netxml_alarm_subscribe(const char *page)
 	upsdebugx(2, "%s: %s", __func__, page);
 
 	sock = ne_sock_create();
+	netxml_alarm_reset();
 
 	if (gethostname(buf, sizeof(buf)) == 0) {
 		dstate_setinfo("driver.hostname", "%s", buf);
@@ -825,25 +926,33 @@ static int netxml_alarm_subscribe(const char *page)
 		return NE_RETRY;
 	}
 
-	ret = ne_sock_read(sock, buf, sizeof(buf));
+	ret = ne_sock_read(sock, buf, sizeof(buf) - 1);
 
 	if (ret < 1) {
 		upsdebugx(2, "%s: read failed: %s", __func__, ne_sock_error(sock));
 		return NE_RETRY;
 	}
 
-	if (strcasecmp(buf, "<Subscription Answer=\"ok\"></Subscription>")) {
+	buf[ret] = '\0';
+
+	if (strncasecmp(buf, answer, strlen(answer))) {
 		upsdebugx(2, "%s: subscription rejected", __func__);
 		return NE_RETRY;
 	}
 
+	/* the first alarms may have been read along with the answer */
+	netxml_alarm_feed(buf + strlen(answer), ret - strlen(answer));
+
 	upslogx(LOG_INFO, "NSM connection to '%s' established", uri.host);
 	return NE_OK;
 }
 
-static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser)
+static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser, page_cache_t *cache)
 {
 	int ret;
+#ifdef HAVE_NE_GET_RESPONSE_HEADER
+	const char	*etag, *lastmod;
+#endif
 
 	/*
 	 * Starting with neon-0.27.0 the ne_xml_dispatch_request() function will check
@@ -864,8 +973,35 @@ static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser)
 			break;
 		}
 
+		/* not modified, the values got last time still hold */
+		if (cache && (ne_get_status(request)->code == 304)) {
+			upsdebugx(3, "%s: not modified", __func__);
+
+			ret = ne_discard_response(request);
+
+			if (ret == NE_OK) {
+				ret = ne_end_request(request);
+			}
+
+			continue;
+		}
+
 		ret = ne_xml_parse_response(request, parser);
 
+#ifdef HAVE_NE_GET_RESPONSE_HEADER
+		/* keep the validators for the next request of this page */
+		if (cache) {
+			free(cache->etag);
+			free(cache->lastmod);
+
+			etag = ne_get_response_header(request, "ETag");
+			lastmod = ne_get_response_header(request, "Last-Modified");
+
+			cache->etag = (ret == NE_OK && etag) ? xstrdup(etag) : NULL;
+			cache->lastmod = (ret == NE_OK && lastmod) ? xstrdup(lastmod) : NULL;
+		}
+#endif
+
 		if (ret == NE_OK) {
 			ret = ne_end_request(request);
 		}
@@ -875,6 +1011,146 @@ static int netxml_dispatch_request(ne_request *request, ne_xml_parser *parser)
 	return ret;
 }
 
+/* Return the validators of page, creating them if needed, or NULL if
+ * conditional requests can't be used */
+static page_cache_t *netxml_page_cache(const char *page)
+{
+#ifdef HAVE_NE_GET_RESPONSE_HEADER
+	int	i;
+
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+
+		if (page_cache[i].page == NULL) {
+			page_cache[i].page = xstrdup(page);
+			return &page_cache[i];
+		}
+
+		if (!strcmp(page_cache[i].page, page)) {
+			return &page_cache[i];
+		}
+	}
+#endif
+	/* this page will always be got in full */
+	return NULL;
+}
+
+/* Start over reading alarm messages, on a new subscription */
+static void netxml_alarm_reset(void)
+{
+	memset(&alarm_msg, 0, sizeof(alarm_msg));
+}
+
+/* Add what was read from the alarm channel to the message being received,
+ * and parse each message as soon as its root element is closed. The NMC
+ * ends each message with a '\0', which is not part of the XML document;
+ * the end is found by following the tags instead, so that messages split
+ * across reads, or read several at once, are handled alike. */
+static void netxml_alarm_feed(const char *data, size_t len)
+{
+	size_t	i;
+	char	c;
+	int	done;
+
+	for (i = 0; i < len; i++) {
+		c = data[i];
+		done = 0;
+
+		/* message separator, or white space before the message */
+		if ((c == '\0') || ((alarm_msg.len == 0) && isspace((unsigned char)c))) {
+			continue;
+		}
+
+		if (alarm_msg.len == sizeof(alarm_msg.buf) - 1) {
+			upslogx(LOG_WARNING, "%s: alarm message too long, discarded", __func__);
+			netxml_alarm_reset();
+			continue;
+		}
+
+		alarm_msg.buf[alarm_msg.len++] = c;
+
+		switch (alarm_msg.scan)
+		{
+		case ALARM_TEXT:
+			if (c == '<') {
+				alarm_msg.scan = ALARM_LT;
+			}
+			break;
+
+		case ALARM_LT:
+			if (c == '/') {
+				alarm_msg.scan = ALARM_ETAG;
+			} else if ((c == '?') || (c == '!')) {
+				alarm_msg.scan = ALARM_DECL;
+			} else {
+				alarm_msg.scan = ALARM_STAG;
+				alarm_msg.slash = 0;
+			}
+			break;
+
+		case ALARM_STAG:
+			if ((c == '"') || (c == '\'')) {
+				alarm_msg.scan = ALARM_QUOTE;
+				alarm_msg.quote = c;
+			} else if (c == '>') {
+				alarm_msg.scan = ALARM_TEXT;
+				if (!alarm_msg.slash) {
+					alarm_msg.depth++;
+				} else if (alarm_msg.depth == 0) {
+					/* empty root element */
+					done = 1;
+				}
+			} else if (!isspace((unsigned char)c)) {
+				alarm_msg.slash = (c == '/');
+			}
+			break;
+
+		case ALARM_QUOTE:
+			if (c == alarm_msg.quote) {
+				alarm_msg.scan = ALARM_STAG;
+				alarm_msg.slash = 0;
+			}
+			break;
+
+		case ALARM_ETAG:
+			if (c == '>') {
+				alarm_msg.scan = ALARM_TEXT;
+				if (--alarm_msg.depth <= 0) {
+					done = 1;
+				}
+			}
+			break;
+
+		case ALARM_DECL:
+			if (c == '>') {
+				alarm_msg.scan = ALARM_TEXT;
+			}
+			break;
+		}
+
+		if (done) {
+			netxml_alarm_parse(alarm_msg.buf, alarm_msg.len);
+			netxml_alarm_reset();
+		}
+	}
+}
+
+/* Parse a complete alarm message */
+static void netxml_alarm_parse(const char *msg, size_t len)
+{
+	ne_xml_parser	*parser = ne_xml_create();
+
+	upsdebugx(2, "%s: %.*s", __func__, (int)len, msg);
+
+	ne_xml_push_handler(parser, subdriver->startelm_cb, subdriver->cdata_cb, subdriver->endelm_cb, NULL);
+
+	/* a zero length marks the end of the document */
+	if (ne_xml_parse(parser, msg, len) || ne_xml_parse(parser, "", 0) || ne_xml_failed(parser)) {
+		upsdebugx(2, "%s: %s", __func__, ne_xml_get_error(parser));
+	}
+
+	ne_xml_destroy(parser);
+}
+
 /* Supply the 'login' and 'password' when authentication is required */
 static int netxml_authenticate(void *userdata, const char *realm, int attempt, char *username, char *password)
 {
@@ -72,4 +72,7 @@ typedef enum {
 
 extern uint32_t	ups_status;
 
+/* set when an alarm was about a variable the pages didn't report yet */
+extern int	ups_alarm_unseen;
+
 #endif /* NETXML_UPS_H */
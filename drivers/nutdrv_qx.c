@@ -130,10 +130,21 @@ static time_t	lastpoll;	/* Timestamp the last polling */
 static int	is_usb = 0;	/* Whether the device is connected through USB (1) or serial (0) */
 #endif	/* QX_USB && QX_SERIAL */
 
+static int	semistaticfreq = DEFAULT_SEMISTATICFREQ;
+
+/* Answers got from the UPS during the walks, reused by the items sharing the same command */
+#define QX_CACHE_SIZE	32
+
 static struct {
-	char	command[SMALLBUF];	/* Command sent to the UPS to get answer/to execute an instant command */
-	char	answer[SMALLBUF];	/* Answer from the UPS, filled at runtime */
-} previous_item = { "", "" };	/* Hold the values of the item processed just before the actual one */
+	char		command[SMALLBUF];	/* Command sent to the UPS to get answer */
+	char		answer[SMALLBUF];	/* Answer from the UPS, as processed by the item that sent the command */
+	unsigned int	walk;			/* Walk during which the answer was got */
+	time_t		time;			/* Time the answer was got */
+} answer_cache[QX_CACHE_SIZE];
+
+static unsigned int	walk_count = 0;		/* Number of walks done so far */
+static int	walk_queries = 0;		/* Commands sent to the UPS during the current walk */
+static int	walk_queries_saved = 0;		/* Commands answered from the cache during the current walk */
 
 
 /* == Support functions == */
@@ -141,6 +152,8 @@ static int	subdriver_matcher(void);
 static int	qx_command(const char *cmd, char *buf, size_t buflen);
 static int	qx_process_answer(item_t *item, const int len);
 static bool_t	qx_ups_walk(walkmode_t mode);
+static const char	*qx_cache_get(item_t *item);
+static void	qx_cache_set(item_t *item);
 static void	ups_status_set(void);
 static void	ups_alarm_set(void);
 static void	qx_set_var(item_t *item);
@@ -1638,6 +1651,8 @@ void	upsdrv_makevartable(void)
 	snprintf(temp, sizeof(temp), "Set polling frequency, in seconds, to reduce data flow (default=%d)", DEFAULT_POLLFREQ);
 	addvar(VAR_VALUE, QX_VAR_POLLFREQ, temp);
 
+	addvar(VAR_VALUE, QX_VAR_SEMISTATICFREQ, "Set polling frequency of the data that seldom changes, in seconds (default=only after a change)");
+
 	addvar(VAR_VALUE, "protocol", "Preselect communication protocol (skip autodetection)");
 
 	/* battery.{charge,runtime} guesstimation */
@@ -1794,6 +1809,16 @@ void	upsdrv_initinfo(void)
 
 	dstate_setinfo("driver.parameter.pollfreq", "%d", pollfreq);
 
+	val = getval(QX_VAR_SEMISTATICFREQ);
+	if (val)
+		semistaticfreq = strtol(val, NULL, 10);
+
+	if (semistaticfreq < 0)
+		fatalx(EXIT_FAILURE, "Invalid value '%s' for %s", val, QX_VAR_SEMISTATICFREQ);
+
+	if (semistaticfreq)
+		dstate_setinfo("driver.parameter.semistaticfreq", "%d", semistaticfreq);
+
 	time(&lastpoll);
 
 	/* Install handlers */
@@ -2426,8 +2451,9 @@ static void	qx_set_var(item_t *item)
 /* Walk UPS variables and set elements of the qx2nut array. */
 static bool_t	qx_ups_walk(walkmode_t mode)
 {
-	item_t	*item;
-	int	retcode;
+	item_t		*item;
+	const char	*answer;
+	int		retcode;
 
 	/* Clear batt.{chrg,runt}.act for guesstimation */
 	if (mode == QX_WALKMODE_FULL_UPDATE) {
@@ -2435,9 +2461,13 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 		batt.chrg.act = -1;
 	}
 
-	/* Clear data from previous_item */
-	memset(previous_item.command, 0, sizeof(previous_item.command));
-	memset(previous_item.answer, 0, sizeof(previous_item.answer));
+	/* Answers got during a previous walk are only reused by SEMI_STATIC items, and not after user changes (setvar / instcmd) */
+	walk_count++;
+	walk_queries = 0;
+	walk_queries_saved = 0;
+
+	if (data_has_changed == TRUE)
+		memset(answer_cache, 0, sizeof(answer_cache));
 
 	/* 3 modes: QX_WALKMODE_INIT, QX_WALKMODE_QUICK_UPDATE and QX_WALKMODE_FULL_UPDATE */
 
@@ -2495,8 +2525,8 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 			if (item->qxflags & (QX_FLAG_ABSENT | QX_FLAG_CMD | QX_FLAG_SETVAR | QX_FLAG_STATIC))
 				continue;
 
-			/* These need to be polled after user changes (setvar / instcmd) */
-			if ((item->qxflags & QX_FLAG_SEMI_STATIC) && (data_has_changed == FALSE))
+			/* These need to be polled after user changes (setvar / instcmd), and every semistaticfreq, if set */
+			if ((item->qxflags & QX_FLAG_SEMI_STATIC) && (data_has_changed == FALSE) && !semistaticfreq)
 				continue;
 
 			break;
@@ -2525,10 +2555,11 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 
 		}
 
-		/* Check whether the previous item uses the same command and then use its answer, if available.. */
-		if (strlen(previous_item.command) > 0 && strlen(previous_item.answer) > 0 && !strcasecmp(previous_item.command, item->command)) {
+		/* Check whether an item already got the answer to the same command and then use it, if available.. */
+		if ((answer = qx_cache_get(item)) != NULL) {
 
-			snprintf(item->answer, sizeof(item->answer), "%s", previous_item.answer);
+			snprintf(item->answer, sizeof(item->answer), "%s", answer);
+			walk_queries_saved++;
 
 			/* Process the answer */
 			retcode = qx_process_answer(item, strlen(item->answer));
@@ -2537,12 +2568,12 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 		} else {
 
 			retcode = qx_process(item, NULL);
+			walk_queries++;
 
-		}
+			/* Record the answer for the next items */
+			qx_cache_set(item);
 
-		/* Record item as previous_item */
-		snprintf(previous_item.command, sizeof(previous_item.command), "%s", item->command);
-		snprintf(previous_item.answer, sizeof(previous_item.answer), "%s", item->answer);
+		}
 
 		if (retcode) {
 
@@ -2628,9 +2659,68 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 		}
 	}
 
+	upsdebugx(3, "%s: %d queries sent, %d answered from cache", __func__, walk_queries, walk_queries_saved);
+
 	return TRUE;
 }
 
+/* Return the answer to item's command got before, if it can be reused by item, or NULL. */
+static const char	*qx_cache_get(item_t *item)
+{
+	time_t	now;
+	int	i;
+
+	/* The command actually sent may depend on the item */
+	if (item->preprocess_command != NULL || item->command == NULL || !strlen(item->command))
+		return NULL;
+
+	for (i = 0; i < QX_CACHE_SIZE; i++) {
+
+		if (strcasecmp(answer_cache[i].command, item->command))
+			continue;
+
+		/* Got during this walk */
+		if (answer_cache[i].walk == walk_count)
+			return answer_cache[i].answer;
+
+		/* SEMI_STATIC data, got less than semistaticfreq seconds ago */
+		time(&now);
+		if ((item->qxflags & QX_FLAG_SEMI_STATIC) && difftime(now, answer_cache[i].time) < semistaticfreq)
+			return answer_cache[i].answer;
+
+		return NULL;
+
+	}
+
+	return NULL;
+}
+
+/* Record the answer just got by item, replacing the one to the same command or else the oldest one. */
+static void	qx_cache_set(item_t *item)
+{
+	int	i, slot = 0;
+
+	if (item->preprocess_command != NULL || item->command == NULL || !strlen(item->command) || !strlen(item->answer))
+		return;
+
+	for (i = 0; i < QX_CACHE_SIZE; i++) {
+
+		if (!strcasecmp(answer_cache[i].command, item->command)) {
+			slot = i;
+			break;
+		}
+
+		if (answer_cache[i].walk < answer_cache[slot].walk)
+			slot = i;
+
+	}
+
+	snprintf(answer_cache[slot].command, sizeof(answer_cache[slot].command), "%s", item->command);
+	snprintf(answer_cache[slot].answer, sizeof(answer_cache[slot].answer), "%s", item->answer);
+	answer_cache[slot].walk = walk_count;
+	time(&answer_cache[slot].time);
+}
+
 /* Convert the local status information to NUT format and set NUT alarms. */
 static void	ups_alarm_set(void)
 {
@@ -39,11 +39,13 @@
 #define QX_VAR_ONDELAY	"ondelay"
 #define QX_VAR_OFFDELAY	"offdelay"
 #define QX_VAR_POLLFREQ	"pollfreq"
+#define QX_VAR_SEMISTATICFREQ	"semistaticfreq"
 
 /* Parameters default values */
 #define DEFAULT_ONDELAY		"180"	/* Delay between return of utility power and powering up of load, in seconds */
 #define DEFAULT_OFFDELAY	"30"	/* Delay before power off, in seconds */
 #define DEFAULT_POLLFREQ	30	/* Polling interval between full updates, in seconds; the driver will do quick polls in the meantime */
+#define DEFAULT_SEMISTATICFREQ	0	/* Polling interval of SEMI_STATIC data, in seconds; 0 = only after setvar/instcmd */
 
 #ifndef TRUE
 typedef enum { FALSE, TRUE } bool_t;
@@ -36,6 +36,126 @@
 
 	static unsigned int	comm_failures = 0;
 
+/* bytes received from a port and not read by the driver yet: the reads
+ * below fill it with what the port has, and only read() again once it
+ * has been used up, instead of once per character or per line */
+#define SER_RBUF_SIZE	SMALLBUF
+
+/* ser_get_line() and ser_get_line_alert() discard what follows the end of
+ * a line up to the end of the SER_LINE_CHUNK bytes it came in, as they
+ * did when they read the port that many bytes at a time */
+#define SER_LINE_CHUNK	64
+
+typedef struct ser_rbuf_s {
+	int	fd;
+	size_t	head;		/* first byte not read yet */
+	size_t	tail;		/* end of the received bytes */
+	unsigned char	data[SER_RBUF_SIZE];
+	struct ser_rbuf_s	*next;
+} ser_rbuf_t;
+
+static ser_rbuf_t	*ser_rbufs = NULL;
+
+/* set of characters, one bit each, for the ignore and alert sets */
+typedef struct {
+	unsigned char	bits[32];
+} ser_charset_t;
+
+#define ser_charset_has(set, ch) \
+	((set)->bits[(unsigned char)(ch) >> 3] & (1 << ((unsigned char)(ch) & 7)))
+
+static void ser_charset_init(ser_charset_t *set, const char *chars)
+{
+	memset(set, 0, sizeof(*set));
+
+	/* '\0' always matches, as it did with strchr() */
+	set->bits[0] = 1;
+
+	for (; chars && *chars; chars++)
+		set->bits[(unsigned char)*chars >> 3] |= 1 << ((unsigned char)*chars & 7);
+}
+
+static ser_rbuf_t *ser_rbuf_get(int fd)
+{
+	ser_rbuf_t	*rb;
+
+	for (rb = ser_rbufs; rb; rb = rb->next) {
+		if (rb->fd == fd)
+			return rb;
+	}
+
+	rb = xcalloc(1, sizeof(*rb));
+	rb->fd = fd;
+	rb->next = ser_rbufs;
+	ser_rbufs = rb;
+
+	return rb;
+}
+
+static void ser_rbuf_clear(int fd)
+{
+	ser_rbuf_t	*rb;
+
+	for (rb = ser_rbufs; rb; rb = rb->next) {
+		if (rb->fd == fd)
+			rb->head = rb->tail = 0;
+	}
+}
+
+/* forget what was received from fd: ser_close() does it, descriptors closed
+ * otherwise (sockets) need it before the same number is used again */
+void ser_release(int fd)
+{
+	ser_rbuf_t	**rbp, *rb;
+
+	for (rbp = &ser_rbufs; (rb = *rbp) != NULL; ) {
+		if (rb->fd == fd) {
+			*rbp = rb->next;
+			free(rb);
+		} else {
+			rbp = &rb->next;
+		}
+	}
+}
+
+/* read what the port has into the buffer, waiting up to d_sec + d_usec
+ * for it; returns like select_read() */
+static int ser_rbuf_fill(ser_rbuf_t *rb, long d_sec, long d_usec)
+{
+	int	ret;
+
+	if (rb->head == rb->tail) {
+		rb->head = rb->tail = 0;
+	} else if (rb->head > 0) {
+		memmove(rb->data, &rb->data[rb->head], rb->tail - rb->head);
+		rb->tail -= rb->head;
+		rb->head = 0;
+	}
+
+	if (rb->tail == sizeof(rb->data))
+		return rb->tail;
+
+	ret = select_read(rb->fd, &rb->data[rb->tail], sizeof(rb->data) - rb->tail,
+		d_sec, d_usec);
+
+	if (ret > 0)
+		rb->tail += ret;
+
+	return ret;
+}
+
+/* move up to len received bytes to buf */
+static size_t ser_rbuf_take(ser_rbuf_t *rb, void *buf, size_t len)
+{
+	if (len > rb->tail - rb->head)
+		len = rb->tail - rb->head;
+
+	memcpy(buf, &rb->data[rb->head], len);
+	rb->head += len;
+
+	return len;
+}
+
 static void ser_open_error(const char *port)
 {
 	struct	stat	fs;
@@ -135,6 +255,9 @@ int ser_open_nf(const char *port)
 		return -1;
 	}
 
+	/* the fd of a port closed without ser_close() */
+	ser_rbuf_clear(fd);
+
 	lock_set(fd, port);
 
 	return fd;
@@ -237,6 +360,8 @@ int ser_get_dcd(int fd)
 
 int ser_flush_io(int fd)
 {
+	ser_rbuf_clear(fd);
+
 	return tcflush(fd, TCIOFLUSH);
 }
 
@@ -245,6 +370,8 @@ int ser_close(int fd, const char *port)
 	if (fd < 0)
 		fatal_with_errno(EXIT_FAILURE, "ser_close: programming error: fd=%d port=%s", fd, port);
 
+	ser_release(fd);
+
 	if (close(fd) != 0)
 		return -1;
 
@@ -335,14 +462,36 @@ int ser_send_buf_pace(int fd, unsigned long d_usec, const void *buf,
 
 int ser_get_char(int fd, void *ch, long d_sec, long d_usec)
 {
-	return select_read(fd, ch, 1, d_sec, d_usec);
+	int	ret;
+	ser_rbuf_t	*rb = ser_rbuf_get(fd);
+
+	if (rb->head == rb->tail) {
+		ret = ser_rbuf_fill(rb, d_sec, d_usec);
+
+		if (ret < 1) {
+			return ret;
+		}
+	}
+
+	return ser_rbuf_take(rb, ch, 1);
 }
 
 int ser_get_buf(int fd, void *buf, size_t buflen, long d_sec, long d_usec)
 {
+	int	ret;
+	ser_rbuf_t	*rb = ser_rbuf_get(fd);
+
 	memset(buf, '\0', buflen);
 
-	return select_read(fd, buf, buflen, d_sec, d_usec);
+	if (rb->head == rb->tail) {
+		ret = ser_rbuf_fill(rb, d_sec, d_usec);
+
+		if (ret < 1) {
+			return ret;
+		}
+	}
+
+	return ser_rbuf_take(rb, buf, buflen);
 }
 
 /* keep reading until buflen bytes are received or a timeout occurs */
@@ -351,66 +500,106 @@ int ser_get_buf_len(int fd, void *buf, size_t buflen, long d_sec, long d_usec)
 	int	ret;
 	size_t	recv;
 	char	*data = buf;
+	ser_rbuf_t	*rb = ser_rbuf_get(fd);
 
 	memset(buf, '\0', buflen);
 
-	for (recv = 0; recv < buflen; recv += ret) {
+	for (recv = 0; recv < buflen; ) {
 
-		ret = select_read(fd, &data[recv], buflen - recv, d_sec, d_usec);
+		if (rb->head == rb->tail) {
+			ret = ser_rbuf_fill(rb, d_sec, d_usec);
 
-		if (ret < 1) {
-			return ret;
+			if (ret < 1) {
+				return ret;
+			}
 		}
+
+		recv += ser_rbuf_take(rb, &data[recv], buflen - recv);
 	}
 
 	return recv;
 }
 
-/* reads a line up to <endchar>, discarding anything else that may follow,
-   with callouts to the handler if anything matches the alertset */
-int ser_get_line_alert(int fd, void *buf, size_t buflen, char endchar,
-	const char *ignset, const char *alertset, void handler(char ch), 
-	long d_sec, long d_usec)
+/* common part of ser_get_line_alert() and ser_get_line_next(): the bytes
+   following endchar are discarded up to the end of their SER_LINE_CHUNK,
+   unless keep is set */
+static int ser_get_line_rbuf(int fd, void *buf, size_t buflen, char endchar,
+	const char *ignset, const char *alertset, void handler(char ch),
+	long d_sec, long d_usec, int keep)
 {
-	int	i, ret;
-	char	tmp[64];
+	int	ret;
+	unsigned char	ch;
 	char	*data = buf;
 	size_t	count = 0, maxcount;
+	size_t	chunk;		/* end of the chunk holding the current byte */
+	ser_charset_t	ign, alert;
+	ser_rbuf_t	*rb = ser_rbuf_get(fd);
 
 	memset(buf, '\0', buflen);
 
 	maxcount = buflen - 1;		/* for trailing \0 */
 
+	ser_charset_init(&ign, ignset);
+	ser_charset_init(&alert, alertset);
+
+	chunk = rb->head;
+
 	while (count < maxcount) {
-		ret = select_read(fd, tmp, sizeof(tmp), d_sec, d_usec);
 
-		if (ret < 1) {
-			return ret;
+		if (rb->head == rb->tail) {
+			ret = ser_rbuf_fill(rb, d_sec, d_usec);
+
+			if (ret < 1) {
+				return ret;
+			}
+
+			chunk = rb->head;
 		}
 
-		for (i = 0; i < ret; i++) {
+		while ((rb->head < rb->tail) && (count < maxcount)) {
+
+			if (rb->head >= chunk)
+				chunk = rb->head + SER_LINE_CHUNK;
+
+			ch = rb->data[rb->head++];
+
+			if (ch == (unsigned char)endchar) {
+				if (!keep)
+					rb->head = (chunk < rb->tail) ? chunk : rb->tail;
 
-			if ((count == maxcount) || (tmp[i] == endchar)) {
 				return count;
 			}
 
-			if (strchr(ignset, tmp[i]))
+			if (ser_charset_has(&ign, ch))
 				continue;
 
-			if (strchr(alertset, tmp[i])) {
+			if (ser_charset_has(&alert, ch)) {
 				if (handler)
-					handler(tmp[i]);
+					handler(ch);
 
 				continue;
 			}
 
-			data[count++] = tmp[i];
+			data[count++] = ch;
 		}
 	}
 
+	if (!keep)
+		rb->head = (chunk < rb->tail) ? chunk : rb->tail;
+
 	return count;
 }
 
+/* reads a line up to <endchar>, discarding anything else that may follow,
+   with callouts to the handler if anything matches the alertset */
+int ser_get_line_alert(int fd, void *buf, size_t buflen, char endchar,
+	const char *ignset, const char *alertset, void handler(char ch), 
+	long d_sec, long d_usec)
+{
+	return ser_get_line_rbuf(fd, buf, buflen, endchar, ignset, alertset,
+		handler, d_sec, d_usec, 0);
+}
+
 /* as above, only with no alertset handling (just a wrapper) */
 int ser_get_line(int fd, void *buf, size_t buflen, char endchar,
 	const char *ignset, long d_sec, long d_usec)
@@ -419,14 +608,40 @@ int ser_get_line(int fd, void *buf, size_t buflen, char endchar,
 		d_sec, d_usec);
 }
 
+/* reads a line up to <endchar> like ser_get_line_alert, but keeps what
+   follows for the next reads */
+int ser_get_line_next(int fd, void *buf, size_t buflen, char endchar,
+	const char *ignset, const char *alertset, void handler(char ch),
+	long d_sec, long d_usec)
+{
+	return ser_get_line_rbuf(fd, buf, buflen, endchar, ignset, alertset,
+		handler, d_sec, d_usec, 1);
+}
+
+/* number of bytes received and not read yet */
+size_t ser_get_pending(int fd)
+{
+	ser_rbuf_t	*rb;
+
+	for (rb = ser_rbufs; rb; rb = rb->next) {
+		if (rb->fd == fd)
+			return rb->tail - rb->head;
+	}
+
+	return 0;
+}
+
 int ser_flush_in(int fd, const char *ignset, int verbose)
 {
 	int	ret, extra = 0;
 	char	ch;
+	ser_charset_t	ign;
+
+	ser_charset_init(&ign, ignset);
 
 	while ((ret = ser_get_char(fd, &ch, 0, 0)) > 0) {
 
-		if (strchr(ignset, ch))
+		if (ser_charset_has(&ign, ch))
 			continue;
 
 		extra++;
@@ -34,6 +34,10 @@ int ser_flush_io(int fd);
 
 int ser_close(int fd, const char *port);
 
+/* forget the received bytes not read yet, for a descriptor closed without
+   ser_close(), such as a socket */
+void ser_release(int fd);
+
 int ser_send_char(int fd, unsigned char ch);
 
 /* send the results of the format string with d_usec delay after each char */
@@ -68,6 +72,16 @@ int ser_get_line_alert(int fd, void *buf, size_t buflen, char endchar,
 int ser_get_line(int fd, void *buf, size_t buflen, char endchar,
 	const char *ignset, long d_sec, long d_usec);
 
+/* reads a line up to <endchar> like ser_get_line_alert, but keeps anything
+   that follows for the next reads, so that several answers received at once
+   are all returned, one line per call */
+int ser_get_line_next(int fd, void *buf, size_t buflen, char endchar,
+	const char *ignset, const char *alertset, void handler (char ch),
+	long d_sec, long d_usec);
+
+/* number of bytes received and not read yet */
+size_t ser_get_pending(int fd);
+
 int ser_flush_in(int fd, const char *ignset, int verbose);
 
 /* unified failure reporting: call these often */
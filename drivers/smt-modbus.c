@@ -0,0 +1,486 @@
+/*  smt-modbus.c - driver for APC Smart-UPS (SMT/SRT) over MODBUS RTU or TCP
+*
+*  Copyright (C)
+*      2017            Dmitry Togushev <jtprofacc@gmain.com>
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*
+*/
+
+/*
+*	Talks to Schneider Electric SMT and SRT family models through the
+*	MODBUS register map of smtmodbus.c, over a serial line (MODBUS RTU,
+*	on the RJ45 port or through a RS-485 gateway) or over the network
+*	(MODBUS/TCP, through a network management card or a gateway).
+*	Check
+*	APPLICATION NOTE #176 (http://www.apc.com/salestools/MPAO-98KJ7F/MPAO-98KJ7F_R1_EN.pdf)
+*	for more information
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "main.h"
+#include "serial.h"
+#include "libmodbus.h"
+#include "smtmodbus.h"
+#include "smt-modbus.h"
+
+#define DRIVER_NAME	"APC Smart-UPS MODBUS driver"
+#define DRIVER_VERSION	"0.01"
+
+#define SMT_MODBUS_DEBUG_LEVEL	2
+
+/* driver description structure */
+upsdrv_info_t upsdrv_info = {
+	DRIVER_NAME,
+	DRIVER_VERSION,
+	"Dmitry Togushev <jtprofacc@gmain.com>",
+	DRV_EXPERIMENTAL,
+	{ NULL }
+};
+
+static uint8_t	slave = DEFAULT_SLAVE_ADDR;
+static bool	network = false;	/* MODBUS/TCP rather than RTU */
+
+/* source of the outlet commands, as seen by the UPS */
+static uint64_t	outlet_cmd_source = BF_OUTLETCOMMAND_RJ45PORT;
+
+/* connect to host[:port] (or [address]:port), return the socket or -1 */
+static int smt_connect(const char *addr)
+{
+	char	host[SMALLBUF], *port = NULL, *p;
+	struct addrinfo	hints, *res, *ai;
+	int	fd = -1, rc, one = 1;
+
+	snprintf(host, sizeof(host), "%s", addr);
+
+	if ((host[0] == '[') && ((p = strchr(host, ']')) != NULL)) {
+		*p++ = '\0';
+		memmove(host, host + 1, strlen(host));
+		if (*p == ':')
+			port = p + 1;
+	} else if ((p = strchr(host, ':')) != NULL) {
+		*p = '\0';
+		port = p + 1;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	rc = getaddrinfo(host, (port && *port) ? port : SMT_MODBUS_PORT, &hints, &res);
+	if (rc != 0) {
+		upslogx(LOG_ERR, "Can't resolve %s: %s", host, gai_strerror(rc));
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd < 0) {
+		upslog_with_errno(LOG_ERR, "Can't connect to %s", addr);
+		return -1;
+	}
+
+	/* requests are small and pipelined: don't hold them back */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+static speed_t smt_baudrate(void)
+{
+	const char	*val = getval("baudrate");
+
+	switch (val ? atoi(val) : SMT_MODBUS_BAUDRATE)
+	{
+	case 9600:
+		return B9600;
+	case 19200:
+		return B19200;
+	case 38400:
+		return B38400;
+#ifdef B57600
+	case 57600:
+		return B57600;
+#endif
+#ifdef B115200
+	case 115200:
+		return B115200;
+#endif
+	default:
+		fatalx(EXIT_FAILURE, "Unsupported baudrate %s", val);
+	}
+}
+
+/* open the serial port or the connection, return -1 on failure */
+static int smt_open(void)
+{
+	int	fd;
+
+	if (network)
+		return smt_connect(device_path);
+
+	/* a USB serial adapter may be gone for a while, don't exit on reconnect */
+	fd = ser_open_nf(device_path);
+	if (fd < 0)
+		return -1;
+
+	if (ser_set_speed_nf(fd, device_path, smt_baudrate()) < 0) {
+		ser_close(fd, device_path);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void smt_close(void)
+{
+	if (upsfd < 0)
+		return;
+
+	if (network) {
+		ser_release(upsfd);
+		close(upsfd);
+	} else
+		ser_close(upsfd, device_path);
+
+	upsfd = -1;
+	ModbusLinkReset();
+}
+
+/* drop a connection that lost track of its responses, reopen it on the
+ * next update */
+static void smt_lost(void)
+{
+	upslogx(LOG_WARNING, "Communications with UPS lost");
+	smt_close();
+	dstate_datastale();
+}
+
+static const char *smt_lookup(info_lkp_t *lookup, double value)
+{
+	info_lkp_t	*lkp;
+
+	if (lookup->fun != NULL)
+		return lookup->fun(value);
+
+	for (lkp = lookup; lkp->nut_value != NULL; lkp++) {
+		if (lkp->hid_value == (long)value)
+			return lkp->nut_value;
+	}
+
+	return NULL;
+}
+
+/* publish one item from its registers, return 0 if it couldn't be read */
+static int smt_process(smt_info_t *item, int age)
+{
+	const uint8_t	*reg;
+	const char	*nutvalue;
+	double		value = 0;
+
+	reg = ModbusCacheRead(upsfd, slave, item->reg, item->nregs, age);
+	if (reg == NULL) {
+		upsdebugx(SMT_MODBUS_DEBUG_LEVEL, "smt-modbus::smt_process. Can't read %s (reg=%u, nregs=%u)", item->info_type, item->reg, item->nregs);
+		return 0;
+	}
+
+	if (item->datatype == DT_STRING) {
+		char	buf[2 * UINT8_MAX + 1];
+
+		memcpy(buf, reg, item->nregs * sizeof(uint16_t));
+		buf[item->nregs * sizeof(uint16_t)] = '\0';
+		if (*str_trim_space(buf) != '\0')
+			dstate_setinfo(item->info_type, item->dfl, buf);
+		return 1;
+	}
+
+	MBDecodeValue(item->datatype, reg, item->nregs, &value);
+
+	if (item->flags & SMT_FLAG_STATUS) {
+		if ((uint64_t)value & item->command)
+			status_set(item->info_type);
+		return 1;
+	}
+
+	if (item->lookup == NULL) {
+		dstate_setinfo(item->info_type, item->dfl, value);
+		return 1;
+	}
+
+	nutvalue = smt_lookup(item->lookup, value);
+	if (nutvalue != NULL)
+		dstate_setinfo(item->info_type, item->dfl, nutvalue);
+
+	return 1;
+}
+
+static int instcmd(const char *cmdname, const char *extra)
+{
+	smt_info_t	*item;
+	uint8_t		data[sizeof(uint64_t)];
+	uint64_t	command;
+
+	for (item = smt_info; item->info_type != NULL; item++) {
+
+		if (!(item->flags & SMT_FLAG_CMD) || strcasecmp(item->info_type, cmdname))
+			continue;
+
+		command = item->command;
+		if (item->flags & SMT_FLAG_OUTLET_CMD)
+			command |= outlet_cmd_source;
+
+		upsdebugx(SMT_MODBUS_DEBUG_LEVEL, "smt-modbus::instcmd. %s: reg=%u, value=0x%08llx", cmdname, item->reg, (unsigned long long)command);
+
+		LE2BE(command, data, item->nregs * sizeof(uint16_t));
+
+		if (!ModbusWriteRegister(upsfd, slave, item->reg, item->nregs, data)) {
+			upslogx(LOG_ERR, "instcmd: %s failed", cmdname);
+			return STAT_INSTCMD_FAILED;
+		}
+
+		return STAT_INSTCMD_HANDLED;
+	}
+
+	upslogx(LOG_NOTICE, "instcmd: unknown command [%s] [%s]", cmdname, extra);
+	return STAT_INSTCMD_UNKNOWN;
+}
+
+static int setvar(const char *varname, const char *val)
+{
+	smt_info_t	*item;
+	uint8_t		data[sizeof(uint64_t)];
+	uint8_t		scale = 0;
+	int64_t		value;
+
+	for (item = smt_info; item->info_type != NULL; item++) {
+
+		if (!(item->info_flags & ST_FLAG_RW) || strcasecmp(item->info_type, varname))
+			continue;
+
+		scaleDT(item->datatype, &scale);
+		value = llround(strtod(val, NULL) * (1ULL << scale));
+
+		LE2BE((uint64_t)value, data, item->nregs * sizeof(uint16_t));
+
+		if (!ModbusWriteRegister(upsfd, slave, item->reg, item->nregs, data)) {
+			upslogx(LOG_ERR, "setvar: can't set %s to %s", varname, val);
+			return STAT_SET_FAILED;
+		}
+
+		smt_process(item, 0);
+		return STAT_SET_HANDLED;
+	}
+
+	upslogx(LOG_NOTICE, "setvar: unknown variable [%s]", varname);
+	return STAT_SET_UNKNOWN;
+}
+
+void upsdrv_initinfo(void)
+{
+	smt_info_t	*item;
+
+	dstate_setinfo("ups.mfr", "American Power Conversion");
+	dstate_setinfo("device.mfr", "American Power Conversion");
+
+	for (item = smt_info; item->info_type != NULL; item++) {
+
+		if (item->flags & SMT_FLAG_CMD) {
+			dstate_addcmd(item->info_type);
+			continue;
+		}
+
+		if (item->flags & SMT_FLAG_STATIC) {
+			smt_process(item, 0);
+		}
+	}
+
+	upsh.instcmd = instcmd;
+	upsh.setvar = setvar;
+}
+
+void upsdrv_updateinfo(void)
+{
+	static bool	flagged = false;
+	smt_info_t	*item;
+	modbus_stats_t	stats = *ModbusGetStats();
+	struct timeval	start, end;
+	int		ok = 0;
+
+	if (upsfd < 0) {
+		upsfd = smt_open();
+		if (upsfd < 0) {
+			dstate_datastale();
+			return;
+		}
+		upslogx(LOG_NOTICE, "Communications with UPS re-established");
+	}
+
+	gettimeofday(&start, NULL);
+
+	/* each register is read once per update */
+	ModbusCacheNewCycle();
+
+	if (ModbusCacheRefresh(upsfd, slave, 1) < 0) {
+		smt_lost();
+		return;
+	}
+
+	status_init();
+
+	for (item = smt_info; item->info_type != NULL; item++) {
+
+		if (item->flags & (SMT_FLAG_CMD | SMT_FLAG_STATIC))
+			continue;
+
+		ok += smt_process(item, 1);
+	}
+
+	if (ModbusLinkLost()) {
+		smt_lost();
+		return;
+	}
+
+	gettimeofday(&end, NULL);
+	upsdebugx(1, "Update took %.3f seconds, %u MODBUS transaction(s), %u retries, %u timeout(s), %u error(s)",
+		end.tv_sec - start.tv_sec + ((double)(end.tv_usec - start.tv_usec)) / 1000000,
+		ModbusGetStats()->transactions - stats.transactions,
+		ModbusGetStats()->retries - stats.retries,
+		ModbusGetStats()->timeouts - stats.timeouts,
+		ModbusGetStats()->errors - stats.errors);
+
+	if (!ok) {
+		dstate_datastale();
+		return;
+	}
+
+	status_commit();
+
+	/* flag the settings once they exist */
+	if (!flagged) {
+		for (item = smt_info; item->info_type != NULL; item++) {
+			if ((item->info_flags & ST_FLAG_RW) && dstate_getinfo(item->info_type))
+				dstate_setflags(item->info_type, ST_FLAG_RW);
+		}
+		flagged = true;
+	}
+
+	dstate_dataok();
+}
+
+void upsdrv_shutdown(void)
+{
+	/* Try to shutdown with delay */
+	if (instcmd("shutdown.return", NULL) == STAT_INSTCMD_HANDLED) {
+		/* Shutdown successful */
+		return;
+	}
+
+	/* If the above doesn't work, try load.off.delay */
+	if (instcmd("load.off.delay", NULL) == STAT_INSTCMD_HANDLED) {
+		/* Shutdown successful */
+		return;
+	}
+
+	fatalx(EXIT_FAILURE, "Shutdown failed!");
+}
+
+void upsdrv_help(void)
+{
+	printf("\nThe port is either a serial device (MODBUS RTU), or host[:port]\n");
+	printf("for MODBUS/TCP (default port %s).\n", SMT_MODBUS_PORT);
+}
+
+void upsdrv_makevartable(void)
+{
+	char	temp[SMALLBUF];
+
+	snprintf(temp, sizeof(temp), "MODBUS slave address (default=%d)", DEFAULT_SLAVE_ADDR);
+	addvar(VAR_VALUE, "slave", temp);
+
+	snprintf(temp, sizeof(temp), "Serial line speed (default=%d)", SMT_MODBUS_BAUDRATE);
+	addvar(VAR_VALUE, "baudrate", temp);
+}
+
+void upsdrv_initups(void)
+{
+	smt_info_t	*item;
+	const uint8_t	*reg;
+	const char	*val;
+
+	val = getval("slave");
+	if (val) {
+		int	id = atoi(val);
+
+		if ((id < 1) || (id > 247))
+			fatalx(EXIT_FAILURE, "Invalid slave address %s", val);
+
+		slave = id;
+	}
+
+	network = (device_path[0] != '/');
+
+	if (network) {
+		ModbusSetTransport(&modbus_tcp_transport);
+		outlet_cmd_source = BF_OUTLETCOMMAND_SMARTSLOT1;
+	} else {
+		ModbusSetTransport(&modbus_rtu_transport);
+		outlet_cmd_source = BF_OUTLETCOMMAND_RJ45PORT;
+	}
+
+	upsfd = smt_open();
+	if (upsfd < 0)
+		fatalx(EXIT_FAILURE, "Can't connect to %s", device_path);
+
+	/* the registers polled on each update */
+	for (item = smt_info; item->info_type != NULL; item++) {
+
+		if (item->flags & (SMT_FLAG_CMD | SMT_FLAG_STATIC))
+			continue;
+
+		ModbusCacheAddRange(item->reg, item->nregs);
+	}
+
+	reg = ModbusCacheRead(upsfd, slave, 0, 2, 0);
+	if (reg == NULL)
+		fatalx(EXIT_FAILURE, "No MODBUS response from slave %u on %s", slave, device_path);
+}
+
+void upsdrv_cleanup(void)
+{
+	ModbusCacheFree();
+	smt_close();
+}
@@ -0,0 +1,32 @@
+/*  smt-modbus.h - driver for APC Smart-UPS (SMT/SRT) over MODBUS RTU or TCP
+*
+*  Copyright (C)
+*      2017            Dmitry Togushev <jtprofacc@gmain.com>
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*
+*/
+
+#ifndef SMT_MODBUS_H
+#define SMT_MODBUS_H
+
+/* default MODBUS/TCP port */
+#define SMT_MODBUS_PORT		"502"
+
+/* default serial line speed */
+#define SMT_MODBUS_BAUDRATE	9600
+
+#endif /* SMT_MODBUS_H */
@@ -1100,7 +1100,6 @@ static const char *apc_smt_MB_voltageacsetting_fun(double value) {
 };
 
 static const char *apc_smt_MB_acceptablefrequencysetting_fun(double value) {
-	uint64_t v = (uint64_t)value;
 	static char ret[255] = {0};
 	uint8_t bp = 0;
 	bool ff = false;
@@ -1304,7 +1303,7 @@ static const char *apc_smt_MB_outletstatus_fun_bw(double value) {
 
 	}
 	upsdebugx(SMT_MESSAGES_DEBUG_LEVEL, "smtmodbus::apc_smt_MB_outletstatus_fun. S01 bp = %d", bp);
-	if (v & (uint64_t)BF_OUTLETSTATUS_STATEOFF)
+	if (v & (uint64_t)BF_OUTLETSTATUS_STATEOFF) {
 		if (ff) {
 			bp = snprintf(&ret[bp], sizeof(ret) - bp, "-%s", "off");
 		}
@@ -1312,6 +1311,7 @@ static const char *apc_smt_MB_outletstatus_fun_bw(double value) {
 			bp = snprintf(&ret[bp], sizeof(ret) - bp, "%s", "off");
 			ff = true;
 		}
+	}
 
 	if (!ff) snprintf(&ret[bp], sizeof(ret) - bp, "unknown");
 	return ret;
@@ -1739,3 +1739,100 @@ info_lkp_t apc_smt_MB_outletcommand[] = {
 info_lkp_t apc_smt_MB_i_sogrelayconfigsetting[] = {
 	{ 0, NULL, apc_smt_MB_i_sogrelayconfigsetting_fun }
 };
+
+/* SMT/SRT register map (APPLICATION NOTE #176). smt-modbus reads all of
+ * it; apc-modbus-hid adds to its HID table the entries that the USB/HID
+ * reports don't provide (see apc_build_hid2nut()). Outlet commands get
+ * the bit of the port they are sent through from the driver. */
+smt_info_t smt_info[] = {
+	/* identification */
+	{ "ups.firmware", 0, 0, 516, 8, DT_STRING, "%s", SMT_FLAG_STATIC, NULL, 0 },
+	{ "ups.model", 0, 0, 532, 16, DT_STRING, "%s", SMT_FLAG_STATIC, NULL, 0 },
+	{ "ups.serial", 0, 0, 564, 8, DT_STRING, "%s", SMT_FLAG_STATIC, NULL, 0 },
+
+	/* status */
+	{ "OL", 0, 0, 0, 2, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_UPSSTATUS_STATEONLINE },
+	{ "OB", 0, 0, 0, 2, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_UPSSTATUS_STATEONBATTERY },
+	{ "OFF", 0, 0, 0, 2, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_UPSSTATUS_STATEOUTPUTOFF },
+	{ "LB", 0, 0, 18, 1, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_SIMPLESIGNALINGSTATUS_SHUTDOWNIMMINENT },
+	{ "OVER", 0, 0, 20, 2, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_POWERSYSTEMERROR_OUTPUTOVERLOAD },
+	{ "RB", 0, 0, 22, 1, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_BATTERYSYSTEMERROR_NEEDSREPLACEMENT },
+	{ "CAL", 0, 0, 24, 1, DT_BITFIELD, NULL, SMT_FLAG_STATUS, NULL, BF_RUNTIMECALIBRATIONSTATUS_INPROGRESS },
+
+	{ "ups.test.result", 0, 0, 23, 1, DT_BITFIELD, "%s", 0, apc_smt_MB_runtimecalibrationstatus_bw, 0 },
+	{ "ups.test.result.deep", 0, 0, 24, 1, DT_BITFIELD, "%s", 0, apc_smt_MB_runtimecalibrationstatus_bw, 0 },
+	{ "ups.test.result.quick", 0, 0, 23, 1, DT_BITFIELD, "%s", 0, apc_smt_MB_runtimecalibrationstatus_bw, 0 },
+	{ "ups.test.result.runtimecalibration", 0, 0, 24, 1, DT_BITFIELD, "%s", 0, apc_smt_MB_runtimecalibrationstatus, 0 },
+	{ "ups.test.result.battery", 0, 0, 23, 1, DT_BITFIELD, "%s", 0, apc_smt_MB_runtimecalibrationstatus, 0 },
+
+	{ "outlet.1.status", 0, 0, 6, 2, DT_BITFIELD, "%s", SMT_FLAG_QUICK_POLL, apc_smt_MB_outletstatus_bw, 0 },
+	{ "outlet.2.status", 0, 0, 9, 2, DT_BITFIELD, "%s", SMT_FLAG_QUICK_POLL, apc_smt_MB_outletstatus_bw, 0 },
+	{ "outlet.1.status.native", 0, 0, 6, 2, DT_BITFIELD, "%s", SMT_FLAG_QUICK_POLL, apc_smt_MB_outletstatus, 0 },
+	{ "outlet.2.status.native", 0, 0, 9, 2, DT_BITFIELD, "%s", SMT_FLAG_QUICK_POLL, apc_smt_MB_outletstatus, 0 },
+
+	/* measurements */
+	{ "battery.runtime", 0, 0, 128, 2, DT_BINARYPOINT_U0, "%.0f", 0, NULL, 0 },
+	{ "battery.charge", 0, 0, 130, 1, DT_BINARYPOINT_U9, "%.0f", SMT_FLAG_NOHID, NULL, 0 },
+	{ "battery.voltage", 0, 0, 131, 1, DT_BINARYPOINT_S5, "%.1f", SMT_FLAG_NOHID, NULL, 0 },
+	{ "battery.temperature", 0, 0, 135, 1, DT_BINARYPOINT_S7, "%.2f", 0, NULL, 0 },
+	{ "ups.realpower", 0, 0, 136, 1, DT_BINARYPOINT_U8, "%.0f", 0, NULL, 0 },
+	{ "output.current", 0, 0, 140, 1, DT_BINARYPOINT_U5, "%.2f", 0, NULL, 0 },
+	{ "output.voltage", 0, 0, 142, 1, DT_BINARYPOINT_U6, "%.2f", 0, NULL, 0 },
+	{ "output.frequency", 0, 0, 144, 1, DT_BINARYPOINT_U7, "%.2f", 0, NULL, 0 },
+	{ "input.voltage", 0, 0, 151, 1, DT_BINARYPOINT_U6, "%.2f", 0, NULL, 0 },
+	{ "ups.timer.shutdown", 0, 0, 155, 1, DT_BINARYPOINT_S0, "%.0f", SMT_FLAG_QUICK_POLL, NULL, 0 },
+	{ "ups.timer.start", 0, 0, 156, 1, DT_BINARYPOINT_S0, "%.0f", SMT_FLAG_QUICK_POLL, NULL, 0 },
+	{ "ups.timer.stayoff", 0, 0, 157, 2, DT_BINARYPOINT_S0, "%.0f", SMT_FLAG_QUICK_POLL, NULL, 0 },
+
+	/* settings */
+	{ "ups.delay.shutdown", ST_FLAG_RW, 0, 1029, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "ups.delay.start", ST_FLAG_RW, 0, 1030, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "ups.delay.stayoff", ST_FLAG_RW, 0, 1031, 2, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.1.delay.shutdown", ST_FLAG_RW, 0, 1034, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.1.delay.start", ST_FLAG_RW, 0, 1035, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.1.delay.stayoff", ST_FLAG_RW, 0, 1036, 2, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.2.delay.shutdown", ST_FLAG_RW, 0, 1039, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.2.delay.start", ST_FLAG_RW, 0, 1040, 1, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+	{ "outlet.2.delay.stayoff", ST_FLAG_RW, 0, 1041, 2, DT_BINARYPOINT_S0, "%.0f", 0, NULL, 0 },
+
+	/* instant commands, apc-modbus-hid relies on these names (see usbhid-ups::instcmd) */
+	{ "outlet.1.load.off", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.off.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.on", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.on.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.on.coldboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_COLDBOOTALLOWED | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.reboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.shutdown", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+	{ "outlet.1.load.canceloperation", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 },
+
+	{ "outlet.2.load.off", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.off.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.on", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.on.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.on.coldboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_COLDBOOTALLOWED | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.reboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.shutdown", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "outlet.2.load.canceloperation", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+
+	{ "load.off", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.off.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTOFF | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.on", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.on.delay", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.on.coldboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTON | BF_OUTLETCOMMAND_COLDBOOTALLOWED | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.reboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.shutdown", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "load.canceloperation", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+
+	{ "shutdown.return", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTSHUTDOWN | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "shutdown.reboot", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_OUTPUTREBOOT | BF_OUTLETCOMMAND_USEOFFDELAY | BF_OUTLETCOMMAND_USEONDELAY | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+	{ "shutdown.stop", 0, 0, 1538, 2, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_OUTLET_CMD, NULL, BF_OUTLETCOMMAND_CANCEL | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP0 | BF_OUTLETCOMMAND_SWITCHEDOUTLETGROUP1 },
+
+	{ "test.battery.start.quick", 0, 0, 1541, 1, DT_BITFIELD, NULL, SMT_FLAG_CMD, NULL, BF_RUNTIMECALIBRATIONCOMMAND_START },
+	{ "test.battery.start.deep", 0, 0, 1542, 1, DT_BITFIELD, NULL, SMT_FLAG_CMD, NULL, BF_RUNTIMECALIBRATIONCOMMAND_START },
+	{ "test.battery.stop", 0, 0, 1542, 1, DT_BITFIELD, NULL, SMT_FLAG_CMD, NULL, BF_RUNTIMECALIBRATIONCOMMAND_ABORT },
+	{ "test.panel.start", 0, 0, 1543, 1, DT_BITFIELD, NULL, SMT_FLAG_CMD, NULL, BF_USERINTERFACECOMMAND_SHORTTEST },
+	{ "beeper.mute", 0, 0, 1543, 1, DT_BITFIELD, NULL, SMT_FLAG_CMD | SMT_FLAG_NOHID, NULL, BF_USERINTERFACECOMMAND_MUTEALLACTIVEAUDIBLEALARMS },
+
+	/* end of structure. */
+	{ NULL, 0, 0, 0, 0, DT_BITFIELD, NULL, 0, NULL, 0 }
+};
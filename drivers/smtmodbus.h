@@ -33,9 +33,11 @@
 #ifndef APC_SMT_MB_H
 #define APC_SMT_MB_H
 
-#include "usbhid-ups.h"
+#include <stdint.h>
+
+#include "main.h"
+#include "infolkp.h"
 #include "modbustypes.h"
-#include "usb-common.h"
 
 // Code is generated automatically upon 'Modbus Implementation in APC Smart-UPS' (http://www.apc.com/salestools/MPAO-98KJ7F/MPAO-98KJ7F_R1_EN.pdf)
 
@@ -196,4 +198,31 @@ extern info_lkp_t apc_smt_MB_outletstatus_bw[];
 extern info_lkp_t apc_smt_MB_outletcommand[];
 extern info_lkp_t apc_smt_MB_i_sogrelayconfigsetting[];
 
+/* --------------------------------------------------------------- */
+/* Register map, shared by smt-modbus and apc-modbus-hid           */
+/* --------------------------------------------------------------- */
+
+/* register map flags */
+#define SMT_FLAG_STATIC		0x0001	/* read once, at startup */
+#define SMT_FLAG_STATUS		0x0002	/* ups.status flag, set when 'command' bits are set */
+#define SMT_FLAG_CMD		0x0004	/* instant command, writes 'command' */
+#define SMT_FLAG_OUTLET_CMD	0x0008	/* outlet command, the driver adds the command source */
+#define SMT_FLAG_QUICK_POLL	0x0010	/* changes often, poll it between updates too */
+#define SMT_FLAG_NOHID		0x0020	/* the USB/HID reports already provide it */
+
+typedef struct {
+	const char	*info_type;	/* NUT variable, status flag or command name */
+	int		info_flags;	/* ST_FLAG_* */
+	int		info_len;	/* length of strings */
+	uint16_t	reg;		/* first register */
+	uint8_t		nregs;		/* number of registers */
+	MB_DataType	datatype;
+	const char	*dfl;		/* printf format of the value */
+	unsigned long	flags;		/* SMT_FLAG_* */
+	info_lkp_t	*lookup;	/* optional conversion of the value */
+	uint64_t	command;	/* value written by commands, status bits */
+} smt_info_t;
+
+extern smt_info_t smt_info[];
+
 #endif /* APC_HID_H */
@@ -124,7 +124,7 @@ const char *mibname;
 const char *mibvers;
 
 #define DRIVER_NAME	"Generic SNMP UPS driver"
-#define DRIVER_VERSION		"1.02"
+#define DRIVER_VERSION		"1.08"
 
 /* driver description structure */
 upsdrv_info_t	upsdrv_info = {
@@ -152,8 +152,31 @@ int template_index_base = -1;
 
 /* Forward functions declarations */
 static void disable_transfer_oids(void);
+static void nut_snmp_batch_init(void);
+static void nut_snmp_batch_free(void);
+static bool_t su_oid_compile(const char *OID, const oid **name, size_t *name_len);
+static void su_oid_free(void);
+static void su_sysoid_free(void);
+static void su_instances_free(void);
+static void nut_snmp_trap_init(void);
+static void nut_snmp_trap_free(void);
+static void su_trap_apply(void);
+static bool_t su_is_status_info(const snmp_info_t *su_info_p);
+static bool_t su_may_rest(const snmp_info_t *su_info_p);
+static void su_batch_backoff_check(void);
+static void su_caps_init(void);
+static bool_t su_caps_restore(void);
+static void su_caps_save(bool_t walked);
+static void su_caps_drop(void);
+static void su_caps_revalidate(void);
+static void su_caps_add_count(const char *name, int value);
+static bool_t su_caps_cmd_supported(const snmp_info_t *su_info_p);
+static void su_caps_set_found(const snmp_info_t *su_info_p);
+static bool_t su_caps_skipped(const snmp_info_t *su_info_p);
+static void su_caps_free(void);
 bool_t get_and_process_data(int mode, snmp_info_t *su_info_p);
 int extract_template_number(int template_type, const char* varname);
+int base_nut_template_offset(void);
 
 /* ---------------------------------------------
  * driver functions implementations
@@ -161,16 +184,23 @@ int extract_template_number(int template_type, const char* varname);
 void upsdrv_initinfo(void)
 {
 	snmp_info_t *su_info_p;
+	bool_t restored, status;
 
 	upsdebugx(1, "SNMP UPS driver: entering %s()", __func__);
 
 	dstate_setinfo("driver.version.data", "%s MIB %s", mibname, mibvers);
 
+	/* only walk what the device is known to support, if it was seen before,
+	 * and take the commands it supports from the cache too */
+	restored = su_caps_restore();
+
 	/* add instant commands to the info database.
 	 * outlet (and groups) commands are processed later, during initial walk */
 	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL ; su_info_p++)
 	{
-		su_info_p->flags |= SU_FLAG_OK;
+		/* the cache restores the flags of all the entries */
+		if (restored == FALSE)
+			su_info_p->flags |= SU_FLAG_OK;
 		if ((SU_TYPE(su_info_p) == SU_TYPE_CMD)
 			&& !(su_info_p->flags & SU_OUTLET)
 			&& !(su_info_p->flags & SU_OUTLET_GROUP)) {
@@ -189,10 +219,15 @@ su_addcmd(su_info_p);
 		disable_transfer_oids();
 
 	/* initialize all other INFO_ fields from list */
-	if (snmp_ups_walk(SU_WALKMODE_INIT) == TRUE)
+	nut_snmp_batch_begin(SU_WALKMODE_INIT);
+	status = snmp_ups_walk(SU_WALKMODE_INIT);
+	if (status == TRUE)
 		dstate_dataok();
 	else
 		dstate_datastale();
+	nut_snmp_batch_end();
+
+	su_caps_save(status);
 
 	/* setup handlers for instcmd and setvar functions */
 	upsh.setvar = su_setvar;
@@ -201,30 +236,52 @@ su_addcmd(su_info_p);
 
 void upsdrv_updateinfo(void)
 {
+	struct timeval received, now;
+	int mode, traps;
+
 	upsdebugx(1,"SNMP UPS driver: entering %s()", __func__);
 
-	/* only update every pollfreq */
-	/* FIXME: only update status (SU_STATUS_*), à la usbhid-ups, in between */
-	if (time(NULL) > (lastpoll + pollfreq)) {
+	/* traps and informs received since the last update */
+	traps = nut_snmp_trap_read(&received);
 
-		alarm_init();
-		status_init();
+	/* only update every pollfreq, and only the status in between,
+	 * when a trap told that it changed */
+	if (time(NULL) > (lastpoll + pollfreq))
+		mode = SU_WALKMODE_UPDATE;
+	else if (traps > 0)
+		mode = SU_WALKMODE_STATUS;
+	else
+		return;
 
-		/* update all dynamic info fields */
-		if (snmp_ups_walk(SU_WALKMODE_UPDATE))
-			dstate_dataok();
-		else
-			dstate_datastale();
+	alarm_init();
+	status_init();
 
-		/* Commit status first, otherwise in daisychain mode, "device.0" may
-		 * clear the alarm count since it has an empty alarm buffer and if there
-		 * is only one device that has alarms! */
-		status_commit();
-		alarm_commit();
+	/* update all dynamic info fields */
+	nut_snmp_batch_begin(mode);
+	if (snmp_ups_walk(mode))
+		dstate_dataok();
+	else
+		dstate_datastale();
+	if (mode == SU_WALKMODE_UPDATE)
+		su_caps_revalidate();
+	nut_snmp_batch_end();
+
+	/* Commit status first, otherwise in daisychain mode, "device.0" may
+	 * clear the alarm count since it has an empty alarm buffer and if there
+	 * is only one device that has alarms! */
+	status_commit();
+	alarm_commit();
+	su_batch_backoff_check();
+
+	if (traps > 0) {
+		gettimeofday(&now, NULL);
+		upsdebugx(1, "%s: %i trap(s) processed %.3f s after reception", __func__, traps,
+			(now.tv_sec - received.tv_sec) + (now.tv_usec - received.tv_usec) / 1000000.0);
+	}
 
-		/* store timestamp */
+	/* store timestamp */
+	if (mode == SU_WALKMODE_UPDATE)
 		lastpoll = time(NULL);
-	}
 }
 
 void upsdrv_shutdown(void)
@@ -284,8 +341,20 @@ void upsdrv_makevartable(void)
 		"Specifies the number of Net-SNMP retries to be used in the requests (default=5)");
 	addvar(VAR_VALUE, SU_VAR_TIMEOUT,
 		"Specifies the Net-SNMP timeout in seconds between retries (default=1)");
+	addvar(VAR_VALUE, SU_VAR_MAXVARBINDS,
+		"Specifies the number of variables requested at once (default=16, 1 to disable)");
+	addvar(VAR_VALUE, SU_VAR_MAXREPETITIONS,
+		"Specifies the number of table rows requested at once with SNMPv2c/v3 (default=10, 0 to disable)");
+	addvar(VAR_VALUE, SU_VAR_MAXREQUESTS,
+		"Specifies the number of batched requests in flight at once (default=8)");
+	addvar(VAR_VALUE, SU_VAR_MAXBACKOFF,
+		"Specifies the longest interval between two reads of a variable that doesn't change, in updates (default=8, 1 to disable)");
+	addvar(VAR_VALUE, SU_VAR_TRAPLISTEN,
+		"Listen for the device traps and informs on this address (e.g. udp:10162), to update the status right away");
 	addvar(VAR_FLAG, "notransferoids",
 		"Disable transfer OIDs (use on APCC Symmetras)");
+	addvar(VAR_FLAG, SU_VAR_NOCACHE,
+		"Don't save the device capabilities, nor use those saved, to skip the full walk on startup");
 	addvar(VAR_VALUE, SU_VAR_SECLEVEL,
 		"Set the securityLevel used for SNMPv3 messages (default=noAuthNoPriv, allowed: authNoPriv,authPriv)");
 	addvar(VAR_VALUE | VAR_SENSITIVE, SU_VAR_SECNAME,
@@ -403,6 +472,9 @@ void upsdrv_initups(void)
 		daisychain_info[curdev]->bypass_phases = (long)-1;
 	}
 
+	/* Load what a previous start found out about this device */
+	su_caps_init();
+
 	/* FIXME: also need daisychain awareness (so init)!
 	 * i.e load.off.delay+load.off + device.1.load.off.delay+device.1.load.off + ... */
 // FIXME: daisychain commands support!
@@ -548,66 +620,1741 @@ void nut_snmp_init(const char *type, const char *hostname)
 		else
 			fatalx(EXIT_FAILURE, "Bad SNMPv3 authProtocol: %s", authProtocol);
 
-		/* set the authentication key to a MD5/SHA1 hashed version of our
-		 * passphrase (must be at least 8 characters long) */
-		if(g_snmp_sess.securityLevel != SNMP_SEC_LEVEL_NOAUTH) {
-			if (generate_Ku(g_snmp_sess.securityAuthProto,
-				g_snmp_sess.securityAuthProtoLen,
-				(u_char *) authPassword, strlen(authPassword),
-				g_snmp_sess.securityAuthKey,
-				&g_snmp_sess.securityAuthKeyLen) !=
-				SNMPERR_SUCCESS) {
-				fatalx(EXIT_FAILURE, "Error generating Ku from authentication pass phrase");
-			}
-		}
+		/* set the authentication key to a MD5/SHA1 hashed version of our
+		 * passphrase (must be at least 8 characters long) */
+		if(g_snmp_sess.securityLevel != SNMP_SEC_LEVEL_NOAUTH) {
+			if (generate_Ku(g_snmp_sess.securityAuthProto,
+				g_snmp_sess.securityAuthProtoLen,
+				(u_char *) authPassword, strlen(authPassword),
+				g_snmp_sess.securityAuthKey,
+				&g_snmp_sess.securityAuthKeyLen) !=
+				SNMPERR_SUCCESS) {
+				fatalx(EXIT_FAILURE, "Error generating Ku from authentication pass phrase");
+			}
+		}
+
+		privProtocol = testvar(SU_VAR_PRIVPROT) ? getval(SU_VAR_PRIVPROT) : "DES";
+
+		if (strcmp(privProtocol, "DES") == 0) {
+			g_snmp_sess.securityPrivProto = usmDESPrivProtocol;
+			g_snmp_sess.securityPrivProtoLen =  sizeof(usmDESPrivProtocol)/sizeof(oid);
+		}
+		else if (strcmp(privProtocol, "AES") == 0) {
+			g_snmp_sess.securityPrivProto = usmAESPrivProtocol;
+			g_snmp_sess.securityPrivProtoLen =  sizeof(usmAESPrivProtocol)/sizeof(oid);
+		}
+		else
+			fatalx(EXIT_FAILURE, "Bad SNMPv3 authProtocol: %s", authProtocol);
+
+		/* set the privacy key to a MD5/SHA1 hashed version of our
+		 * passphrase (must be at least 8 characters long) */
+		if(g_snmp_sess.securityLevel == SNMP_SEC_LEVEL_AUTHPRIV) {
+			g_snmp_sess.securityPrivKeyLen = USM_PRIV_KU_LEN;
+			if (generate_Ku(g_snmp_sess.securityAuthProto,
+				g_snmp_sess.securityAuthProtoLen,
+				(u_char *) privPassword, strlen(privPassword),
+				g_snmp_sess.securityPrivKey,
+				&g_snmp_sess.securityPrivKeyLen) !=
+				SNMPERR_SUCCESS) {
+				fatalx(EXIT_FAILURE, "Error generating Ku from privacy pass phrase");
+			}
+		}
+	}
+	else
+		fatalx(EXIT_FAILURE, "Bad SNMP version: %s", version);
+
+	nut_snmp_batch_init();
+
+	/* Open the session */
+	SOCK_STARTUP; /* MS Windows wrapper, not really needed on Unix! */
+	g_snmp_sess_p = snmp_open(&g_snmp_sess);	/* establish the session */
+	if (g_snmp_sess_p == NULL) {
+		nut_snmp_perror(&g_snmp_sess, 0, NULL, "nut_snmp_init: snmp_open");
+		fatalx(EXIT_FAILURE, "Unable to establish communication");
+	}
+
+	nut_snmp_trap_init();
+}
+
+void nut_snmp_cleanup(void)
+{
+	nut_snmp_trap_free();
+	nut_snmp_batch_free();
+	su_caps_free();
+	su_instances_free();
+	su_sysoid_free();
+	su_oid_free();
+
+	/* close snmp session. */
+	if (g_snmp_sess_p) {
+		snmp_close(g_snmp_sess_p);
+		g_snmp_sess_p = NULL;
+	}
+	SOCK_CLEANUP; /* wrapper not needed on Unix! */
+}
+
+/* -----------------------------------------------------------
+ * Compiled OIDs.
+ *
+ * Textual OIDs are parsed once, and their binary form kept in a hash
+ * table: the OIDs of the mapping are compiled when it is loaded, and
+ * those of the template instances when these are expanded.
+ * ----------------------------------------------------------- */
+
+typedef struct {
+	char	*OID;
+	oid	*name;
+	size_t	name_len;
+	int	next;			/* next entry in the hash chain, or -1 */
+} su_oid_t;
+
+#define SU_OID_HASHSIZE		2048
+
+static struct {
+	su_oid_t	*entry;
+	int	count;
+	int	size;			/* allocated entries */
+	int	hash[SU_OID_HASHSIZE];	/* first entry of each chain, or -1 */
+	bool_t	ready;
+} su_oids;
+
+static unsigned int su_oid_hash(const char *OID)
+{
+	unsigned int h = 5381;
+
+	while (*OID)
+		h = (h * 33) ^ (unsigned char)*OID++;
+
+	return h % SU_OID_HASHSIZE;
+}
+
+/* Return the binary form of a textual OID, parsing it only the first time */
+static bool_t su_oid_compile(const char *OID, const oid **name, size_t *name_len)
+{
+	oid buf[MAX_OID_LEN];
+	size_t buf_len = MAX_OID_LEN;
+	su_oid_t *entry;
+	unsigned int h;
+	int i;
+
+	if (su_oids.ready == FALSE) {
+		for (i = 0; i < SU_OID_HASHSIZE; i++)
+			su_oids.hash[i] = -1;
+		su_oids.ready = TRUE;
+	}
+
+	h = su_oid_hash(OID);
+
+	for (i = su_oids.hash[h]; i != -1; i = su_oids.entry[i].next) {
+		if (!strcmp(su_oids.entry[i].OID, OID)) {
+			*name = su_oids.entry[i].name;
+			*name_len = su_oids.entry[i].name_len;
+			return TRUE;
+		}
+	}
+
+	if (!snmp_parse_oid(OID, buf, &buf_len))
+		return FALSE;
+
+	if (su_oids.count == su_oids.size) {
+		su_oids.size = su_oids.size ? 2 * su_oids.size : 256;
+		su_oids.entry = xrealloc(su_oids.entry, su_oids.size * sizeof(*su_oids.entry));
+	}
+
+	entry = &su_oids.entry[su_oids.count];
+	entry->OID = xstrdup(OID);
+	entry->name = xcalloc(buf_len, sizeof(oid));
+	memcpy(entry->name, buf, buf_len * sizeof(oid));
+	entry->name_len = buf_len;
+	entry->next = su_oids.hash[h];
+	su_oids.hash[h] = su_oids.count++;
+
+	*name = entry->name;
+	*name_len = entry->name_len;
+	return TRUE;
+}
+
+/* Compile the OIDs of the mapping (but the templates) */
+static void su_oid_compile_mapping(void)
+{
+	snmp_info_t *su_info_p;
+	alarms_info_t *alarms;
+	const oid *name;
+	size_t name_len;
+
+	for (su_info_p = snmp_info; (su_info_p != NULL) && (su_info_p->info_type != NULL); su_info_p++) {
+		if ((su_info_p->OID == NULL) || (strchr(su_info_p->OID, '%') != NULL))
+			continue;
+		if (su_oid_compile(su_info_p->OID, &name, &name_len) == FALSE)
+			upsdebugx(2, "%s: can't compile %s", __func__, su_info_p->OID);
+	}
+
+	for (alarms = alarms_info; (alarms != NULL) && (alarms->OID != NULL); alarms++)
+		su_oid_compile(alarms->OID, &name, &name_len);
+
+	upsdebugx(2, "%s: %i OID(s) compiled", __func__, su_oids.count);
+}
+
+static void su_oid_free(void)
+{
+	int i;
+
+	for (i = 0; i < su_oids.count; i++) {
+		free(su_oids.entry[i].OID);
+		free(su_oids.entry[i].name);
+	}
+
+	free(su_oids.entry);
+	su_oids.entry = NULL;
+	su_oids.count = su_oids.size = 0;
+	su_oids.ready = FALSE;
+}
+
+/* -----------------------------------------------------------
+ * Multi-varbind GET batching.
+ *
+ * The OIDs successfully read by nut_snmp_get() during a walk are
+ * remembered, and fetched at the start of the next walk with GET
+ * requests carrying up to 'snmp_max_varbinds' variables each. The
+ * walk then gets its values from these responses, and only the OIDs
+ * not read in the previous walk cost a request of their own.
+ *
+ * With SNMPv2c and v3, OIDs that only differ by their last sub-identifier
+ * (such as the instances of an outlet template) are taken as the rows of
+ * a table column, and walked with GETBULK requests of up to
+ * 'snmp_max_repetitions' rows for 'snmp_max_varbinds' columns at once.
+ *
+ * These requests are sent asynchronously, up to 'snmp_max_requests' at
+ * once, so that the time taken by a walk is bounded by the slowest answer
+ * rather than the sum of all of them, including on daisychained devices.
+ * Variables whose request timed out are taken as absent for this walk,
+ * instead of being requested again, one at a time.
+ *
+ * The settings and ratings whose value doesn't change (see su_may_rest())
+ * are read less and less often: the interval between two reads doubles
+ * each time the value was the same for SU_BACKOFF_READS reads in a row, up
+ * to 'snmp_max_backoff' updates. The walks in between take their last
+ * value. A change, any SET, or a change of ups.status or ups.alarm brings
+ * them all back to every update. The measurements are read by every walk.
+ * ----------------------------------------------------------- */
+
+typedef struct {
+	char	*OID;			/* OID, as requested by the walk */
+	const oid	*name;		/* compiled OID */
+	size_t	name_len;
+	struct snmp_pdu	*pdu;		/* response holding only this variable */
+	bool_t	fetched;		/* requested by this walk's batch */
+	bool_t	used;			/* read successfully during this walk */
+	bool_t	pending;		/* in a request in flight */
+	bool_t	failed;			/* its request timed out */
+	bool_t	status;			/* read for ups.status or an alarm */
+	bool_t	always;			/* read by every walk, whatever its value */
+	struct snmp_pdu	*last;		/* last value read */
+	bool_t	resting;		/* not read by this walk, which takes 'last' */
+	int	interval;		/* walks between two reads */
+	int	rest;			/* walks left before the next read */
+	int	stable;			/* reads without change at this interval */
+	int	column;			/* GETBULK column, or -1 */
+	int	next;			/* next entry in the hash chain, or -1 */
+} su_batch_entry_t;
+
+#define SU_BATCH_HASHSIZE	1024
+
+/* least number of rows to walk a column with GETBULK */
+#define SU_BULK_MIN_ROWS	3
+
+/* reads without change before doubling the interval of a variable */
+#define SU_BACKOFF_READS	3
+
+/* entries to fetch in this walk: all, or only the status ones, but those
+ * left to rest */
+#define SU_BATCH_WANTED(entry)	(((entry)->resting == FALSE) && \
+	((su_batch.status_only == FALSE) || ((entry)->status == TRUE)))
+
+typedef struct {
+	int	first;			/* first row, in su_batch.sorted */
+	int	count;			/* number of rows */
+	oid	next[MAX_OID_LEN];	/* OID to go on walking from */
+	size_t	next_len;
+	bool_t	done;
+	bool_t	pending;		/* in a request in flight */
+} su_bulk_column_t;
+
+/* asynchronous request in flight */
+typedef struct {
+	int	command;		/* SNMP_MSG_GET or SNMP_MSG_GETBULK */
+	int	count;
+	int	*idx;			/* entries for GET, columns for GETBULK */
+} su_batch_request_t;
+
+static struct {
+	su_batch_entry_t	*entry;
+	int	count;
+	int	size;			/* allocated entries */
+	int	hash[SU_BATCH_HASHSIZE];	/* first entry of each chain, or -1 */
+	bool_t	active;			/* within a walk */
+	bool_t	status_only;		/* this walk only refreshes the status */
+	bool_t	status_info;		/* the walk is reading a status or an alarm */
+	bool_t	always_info;		/* the walk is reading a variable to never rest */
+	bool_t	update;			/* this walk is an update, letting variables rest */
+	int	max_varbinds;		/* variables per request */
+	int	max_repetitions;	/* rows per GETBULK request, 0 for none */
+	int	*sorted;		/* entries, sorted by column and row */
+	su_bulk_column_t	*cols;	/* GETBULK columns of this walk */
+	int	ncols;
+	int	max_requests;		/* requests in flight at once */
+	int	inflight;		/* requests in flight */
+	bool_t	abort;			/* the agent is not answering */
+	unsigned int	requests;	/* batched requests sent by this walk */
+	unsigned int	responses;	/* and answered */
+	unsigned int	timeouts;	/* and timed out */
+	unsigned int	hits;		/* variables served from them */
+	int	max_backoff;		/* longest interval between two reads, in walks */
+	unsigned int	rested;		/* variables left to rest by this walk */
+} su_batch;
+
+static unsigned int su_batch_hash(const char *OID)
+{
+	unsigned int h = 5381;
+
+	while (*OID)
+		h = (h * 33) ^ (unsigned char)*OID++;
+
+	return h % SU_BATCH_HASHSIZE;
+}
+
+static void su_batch_rehash(void)
+{
+	unsigned int h;
+	int i;
+
+	for (i = 0; i < SU_BATCH_HASHSIZE; i++)
+		su_batch.hash[i] = -1;
+
+	for (i = 0; i < su_batch.count; i++) {
+		h = su_batch_hash(su_batch.entry[i].OID);
+		su_batch.entry[i].next = su_batch.hash[h];
+		su_batch.hash[h] = i;
+	}
+}
+
+static su_batch_entry_t *su_batch_find(const char *OID)
+{
+	int i;
+
+	for (i = su_batch.hash[su_batch_hash(OID)]; i != -1; i = su_batch.entry[i].next) {
+		if (!strcmp(su_batch.entry[i].OID, OID))
+			return &su_batch.entry[i];
+	}
+
+	return NULL;
+}
+
+static su_batch_entry_t *su_batch_add(const char *OID)
+{
+	su_batch_entry_t *entry;
+	unsigned int h;
+
+	if (su_batch.count == su_batch.size) {
+		su_batch.size = su_batch.size ? 2 * su_batch.size : 64;
+		su_batch.entry = xrealloc(su_batch.entry, su_batch.size * sizeof(*su_batch.entry));
+	}
+
+	entry = &su_batch.entry[su_batch.count];
+	memset(entry, 0, sizeof(*entry));
+
+	if (su_oid_compile(OID, &entry->name, &entry->name_len) == FALSE)
+		return NULL;
+
+	entry->OID = xstrdup(OID);
+	h = su_batch_hash(OID);
+	entry->next = su_batch.hash[h];
+	su_batch.hash[h] = su_batch.count++;
+
+	return entry;
+}
+
+static void nut_snmp_batch_init(void)
+{
+	su_batch.max_varbinds = DEFAULT_MAXVARBINDS;
+
+	if (testvar(SU_VAR_MAXVARBINDS))
+		su_batch.max_varbinds = atoi(getval(SU_VAR_MAXVARBINDS));
+
+	upsdebugx(2, "Setting SNMP max. varbinds to %i", su_batch.max_varbinds);
+
+	/* SNMPv1 has no GETBULK */
+	su_batch.max_repetitions = 0;
+
+	if (g_snmp_sess.version != SNMP_VERSION_1) {
+		su_batch.max_repetitions = DEFAULT_MAXREPETITIONS;
+
+		if (testvar(SU_VAR_MAXREPETITIONS))
+			su_batch.max_repetitions = atoi(getval(SU_VAR_MAXREPETITIONS));
+
+		upsdebugx(2, "Setting SNMP max. repetitions to %i", su_batch.max_repetitions);
+	}
+
+	su_batch.max_requests = DEFAULT_MAXREQUESTS;
+
+	if (testvar(SU_VAR_MAXREQUESTS))
+		su_batch.max_requests = atoi(getval(SU_VAR_MAXREQUESTS));
+
+	if (su_batch.max_requests < 1)
+		su_batch.max_requests = 1;
+
+	upsdebugx(2, "Setting SNMP max. requests in flight to %i", su_batch.max_requests);
+
+	su_batch.max_backoff = DEFAULT_MAXBACKOFF;
+
+	if (testvar(SU_VAR_MAXBACKOFF))
+		su_batch.max_backoff = atoi(getval(SU_VAR_MAXBACKOFF));
+
+	upsdebugx(2, "Setting SNMP max. backoff to %i update(s)", su_batch.max_backoff);
+
+	su_batch_rehash();
+}
+
+static void nut_snmp_batch_free(void)
+{
+	int i;
+
+	for (i = 0; i < su_batch.count; i++) {
+		if (su_batch.entry[i].pdu != NULL)
+			snmp_free_pdu(su_batch.entry[i].pdu);
+		if (su_batch.entry[i].last != NULL)
+			snmp_free_pdu(su_batch.entry[i].last);
+		free(su_batch.entry[i].OID);
+	}
+
+	free(su_batch.entry);
+	su_batch.entry = NULL;
+	free(su_batch.sorted);
+	su_batch.sorted = NULL;
+	free(su_batch.cols);
+	su_batch.cols = NULL;
+	su_batch.count = su_batch.size = 0;
+	su_batch_rehash();
+}
+
+static int su_batch_callback(int operation, netsnmp_session *session, int reqid,
+	netsnmp_pdu *response, void *magic);
+
+/* Send a GET request for the entries listed in 'idx', or a GETBULK one
+ * for the columns listed in 'idx'.
+ * Return FALSE if it couldn't be sent */
+static bool_t su_batch_send(int command, const int *idx, int count)
+{
+	su_batch_request_t *req;
+	su_batch_entry_t *entry;
+	su_bulk_column_t *col;
+	struct snmp_pdu *pdu;
+	int i;
+
+	pdu = snmp_pdu_create(command);
+
+	if (pdu == NULL) {
+		fatalx(EXIT_FAILURE, "Not enough memory");
+	}
+
+	if (command == SNMP_MSG_GETBULK) {
+		pdu->non_repeaters = 0;
+		pdu->max_repetitions = su_batch.max_repetitions;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (command == SNMP_MSG_GETBULK) {
+			col = &su_batch.cols[idx[i]];
+			snmp_add_null_var(pdu, col->next, col->next_len);
+		}
+		else {
+			entry = &su_batch.entry[idx[i]];
+			snmp_add_null_var(pdu, entry->name, entry->name_len);
+		}
+	}
+
+	req = xmalloc(sizeof(*req));
+	req->command = command;
+	req->count = count;
+	req->idx = xcalloc(count, sizeof(*req->idx));
+	memcpy(req->idx, idx, count * sizeof(*req->idx));
+
+	if (snmp_async_send(g_snmp_sess_p, pdu, su_batch_callback, req) == 0) {
+		nut_snmp_perror(g_snmp_sess_p, 0, NULL, "%s", __func__);
+		snmp_free_pdu(pdu);
+		free(req->idx);
+		free(req);
+		return FALSE;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (command == SNMP_MSG_GETBULK)
+			su_batch.cols[idx[i]].pending = TRUE;
+		else
+			su_batch.entry[idx[i]].pending = TRUE;
+	}
+
+	su_batch.inflight++;
+	su_batch.requests++;
+
+	return TRUE;
+}
+
+/* Process the response to a GET request, sending the requests that
+ * remain to be done if the agent found it too big, or (SNMPv1) if some
+ * variable was absent */
+static void su_batch_get_response(su_batch_request_t *req, struct snmp_pdu *response)
+{
+	netsnmp_variable_list *var;
+	su_batch_entry_t *entry;
+	int *idx = req->idx;
+	int count = req->count;
+	int i, half;
+
+	switch (response->errstat)
+	{
+	case SNMP_ERR_NOERROR:
+		for (i = 0, var = response->variables; (i < count) && (var != NULL);
+			i++, var = var->next_variable) {
+			entry = &su_batch.entry[idx[i]];
+			if (snmp_oid_compare(var->name, var->name_length, entry->name, entry->name_len))
+				continue;
+			/* absent, as told by SNMPv2c and v3 */
+			if ((var->type == SNMP_NOSUCHOBJECT) || (var->type == SNMP_NOSUCHINSTANCE)) {
+				entry->fetched = TRUE;
+				continue;
+			}
+			entry->pdu = snmp_split_pdu(response, i, 1);
+			if (entry->pdu != NULL)
+				entry->fetched = TRUE;
+		}
+		break;
+
+	case SNMP_ERR_TOOBIG:
+		if (count == 1)
+			break;
+		/* split in halves, and keep to that size from now on */
+		half = count / 2;
+		if (su_batch.max_varbinds > half) {
+			upsdebugx(1, "%s: response too big, requesting %i variables at once",
+				__func__, half);
+			su_batch.max_varbinds = half;
+		}
+		su_batch_send(SNMP_MSG_GET, idx, half);
+		su_batch_send(SNMP_MSG_GET, idx + half, count - half);
+		break;
+
+	case SNMP_ERR_NOSUCHNAME:
+		/* SNMPv1 fails the whole request on the first absent variable:
+		 * flag that one, and request the others again */
+		if ((response->errindex >= 1) && (response->errindex <= count)) {
+			i = response->errindex - 1;
+			su_batch.entry[idx[i]].fetched = TRUE;
+			upsdebugx(3, "%s: %s absent", __func__, su_batch.entry[idx[i]].OID);
+			memmove(&idx[i], &idx[i + 1], (count - i - 1) * sizeof(*idx));
+			if (count > 1)
+				su_batch_send(SNMP_MSG_GET, idx, count - 1);
+			break;
+		}
+		/* fallthrough */
+
+	default:
+		/* leave them to single requests */
+		nut_snmp_perror(g_snmp_sess_p, STAT_SUCCESS, response, "%s", __func__);
+		break;
+	}
+}
+
+/* Order entries by column (all sub-identifiers but the last), then row */
+static int su_bulk_compare(const void *a, const void *b)
+{
+	const su_batch_entry_t *ea = &su_batch.entry[*(const int *)a];
+	const su_batch_entry_t *eb = &su_batch.entry[*(const int *)b];
+	int ret;
+
+	if (ea->name_len != eb->name_len)
+		return (ea->name_len < eb->name_len) ? -1 : 1;
+
+	ret = snmp_oid_compare(ea->name, ea->name_len - 1, eb->name, eb->name_len - 1);
+	if (ret != 0)
+		return ret;
+
+	if (ea->name[ea->name_len - 1] == eb->name[eb->name_len - 1])
+		return 0;
+
+	return (ea->name[ea->name_len - 1] < eb->name[eb->name_len - 1]) ? -1 : 1;
+}
+
+static bool_t su_bulk_same_column(int a, int b)
+{
+	const su_batch_entry_t *ea = &su_batch.entry[a];
+	const su_batch_entry_t *eb = &su_batch.entry[b];
+
+	return ((ea->name_len == eb->name_len) &&
+		!snmp_oid_compare(ea->name, ea->name_len - 1, eb->name, eb->name_len - 1)) ? TRUE : FALSE;
+}
+
+/* Find the entry of a column matching a row, or NULL if not tracked */
+static su_batch_entry_t *su_bulk_find_row(const su_bulk_column_t *col, oid row)
+{
+	int lo = col->first, hi = col->first + col->count - 1, mid;
+	su_batch_entry_t *entry;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		entry = &su_batch.entry[su_batch.sorted[mid]];
+
+		if (entry->name[entry->name_len - 1] == row)
+			return entry;
+
+		if (entry->name[entry->name_len - 1] < row)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return NULL;
+}
+
+/* Process the response to a GETBULK request: the rows of the requested
+ * columns come in turn. Rows that can't be fetched this way are left to
+ * GET requests */
+static void su_batch_bulk_response(su_batch_request_t *req, struct snmp_pdu *response)
+{
+	su_bulk_column_t *col;
+	netsnmp_variable_list *var;
+	su_batch_entry_t *first, *entry;
+	int i, k = req->count, p;
+	u_char last_type;
+
+	if (response->errstat != SNMP_ERR_NOERROR) {
+		upsdebugx(2, "%s: GETBULK failed, falling back to GET", __func__);
+		for (i = 0; i < k; i++)
+			su_batch.cols[req->idx[i]].done = TRUE;
+		return;
+	}
+
+	last_type = SNMP_ENDOFMIBVIEW;
+	for (p = 0, var = response->variables; var != NULL; p++, var = var->next_variable) {
+		col = &su_batch.cols[req->idx[p % k]];
+		last_type = var->type;
+		first = &su_batch.entry[su_batch.sorted[col->first]];
+
+		if (col->done == TRUE)
+			continue;
+
+		/* out of the column, or not going forward */
+		if ((var->type == SNMP_ENDOFMIBVIEW) ||
+			(var->name_length < first->name_len) ||
+			snmp_oid_compare(var->name, first->name_len - 1, first->name, first->name_len - 1) ||
+			(snmp_oid_compare(var->name, var->name_length, col->next, col->next_len) <= 0)) {
+			col->done = TRUE;
+			continue;
+		}
+
+		memcpy(col->next, var->name, var->name_length * sizeof(oid));
+		col->next_len = var->name_length;
+
+		if (var->name_length == first->name_len) {
+			entry = su_bulk_find_row(col, var->name[var->name_length - 1]);
+			if ((entry != NULL) && (entry->fetched == FALSE)) {
+				entry->pdu = snmp_split_pdu(response, p, 1);
+				if (entry->pdu != NULL)
+					entry->fetched = TRUE;
+			}
+		}
+
+		/* past the last row? */
+		entry = &su_batch.entry[su_batch.sorted[col->first + col->count - 1]];
+		if (snmp_oid_compare(col->next, col->next_len, entry->name, entry->name_len) >= 0)
+			col->done = TRUE;
+	}
+
+	if (p == 0) {
+		upsdebugx(2, "%s: empty GETBULK response, falling back to GET", __func__);
+		for (i = 0; i < k; i++)
+			su_batch.cols[req->idx[i]].done = TRUE;
+		return;
+	}
+
+	/* the agent truncated its response: keep to that size from now on */
+	if ((p < k * su_batch.max_repetitions) && (last_type != SNMP_ENDOFMIBVIEW)) {
+		if (p >= k) {
+			su_batch.max_repetitions = p / k;
+		}
+		else {
+			su_batch.max_repetitions = 1;
+			su_batch.max_varbinds = p;
+		}
+		upsdebugx(1, "%s: response truncated, requesting %i row(s) of %i column(s) at once",
+			__func__, su_batch.max_repetitions, su_batch.max_varbinds);
+	}
+}
+
+/* A request timed out: its variables are taken as absent for this walk,
+ * rather than requested again one at a time */
+static void su_batch_timeout(su_batch_request_t *req)
+{
+	su_bulk_column_t *col;
+	su_batch_entry_t *entry;
+	int i, j;
+
+	su_batch.timeouts++;
+
+	upsdebugx(2, "%s: no answer to a %i %s(s) request", __func__, req->count,
+		(req->command == SNMP_MSG_GETBULK) ? "column" : "variable");
+
+	for (i = 0; i < req->count; i++) {
+		if (req->command != SNMP_MSG_GETBULK) {
+			entry = &su_batch.entry[req->idx[i]];
+			entry->fetched = entry->failed = TRUE;
+			continue;
+		}
+
+		col = &su_batch.cols[req->idx[i]];
+		col->done = TRUE;
+		for (j = col->first; j < col->first + col->count; j++) {
+			entry = &su_batch.entry[su_batch.sorted[j]];
+			if (entry->fetched == FALSE)
+				entry->fetched = entry->failed = TRUE;
+		}
+	}
+
+	/* nothing answered so far: don't wait for each request in turn */
+	if ((su_batch.responses == 0) && (su_batch.abort == FALSE)) {
+		upsdebugx(1, "%s: agent not answering, batching aborted", __func__);
+		su_batch.abort = TRUE;
+	}
+}
+
+static int su_batch_callback(int operation, netsnmp_session *session, int reqid,
+	netsnmp_pdu *response, void *magic)
+{
+	su_batch_request_t *req = magic;
+	int i;
+
+	su_batch.inflight--;
+
+	for (i = 0; i < req->count; i++) {
+		if (req->command == SNMP_MSG_GETBULK)
+			su_batch.cols[req->idx[i]].pending = FALSE;
+		else
+			su_batch.entry[req->idx[i]].pending = FALSE;
+	}
+
+	if ((operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) && (response != NULL)) {
+		su_batch.responses++;
+
+		if (req->command == SNMP_MSG_GETBULK)
+			su_batch_bulk_response(req, response);
+		else
+			su_batch_get_response(req, response);
+	}
+	else {
+		su_batch_timeout(req);
+	}
+
+	free(req->idx);
+	free(req);
+
+	return 1;
+}
+
+/* Sort the entries in table columns, to walk with GETBULK requests */
+static void su_batch_columns(void)
+{
+	su_bulk_column_t *col;
+	su_batch_entry_t *first;
+	int i, j, count;
+
+	su_batch.sorted = xrealloc(su_batch.sorted, su_batch.count * sizeof(*su_batch.sorted));
+	for (i = 0, count = 0; i < su_batch.count; i++) {
+		if (SU_BATCH_WANTED(&su_batch.entry[i]))
+			su_batch.sorted[count++] = i;
+	}
+
+	qsort(su_batch.sorted, count, sizeof(*su_batch.sorted), su_bulk_compare);
+
+	su_batch.cols = xrealloc(su_batch.cols,
+		(count / SU_BULK_MIN_ROWS + 1) * sizeof(*su_batch.cols));
+	su_batch.ncols = 0;
+
+	/* columns are runs of entries differing by their last sub-identifier */
+	for (i = 0; i < count; i = j) {
+		for (j = i + 1; (j < count) &&
+			(su_bulk_same_column(su_batch.sorted[i], su_batch.sorted[j]) == TRUE); j++);
+
+		if (j - i < SU_BULK_MIN_ROWS)
+			continue;
+
+		col = &su_batch.cols[su_batch.ncols];
+		memset(col, 0, sizeof(*col));
+		col->first = i;
+		col->count = j - i;
+
+		for (; i < j; i++)
+			su_batch.entry[su_batch.sorted[i]].column = su_batch.ncols;
+
+		/* start walking right before the first row */
+		first = &su_batch.entry[su_batch.sorted[col->first]];
+		memcpy(col->next, first->name, first->name_len * sizeof(oid));
+		col->next_len = first->name_len;
+		if (col->next[col->next_len - 1] > 0)
+			col->next[col->next_len - 1]--;
+		else
+			col->next_len--;
+
+		su_batch.ncols++;
+	}
+
+	upsdebugx(3, "%s: %i column(s) to walk", __func__, su_batch.ncols);
+}
+
+/* Send new requests, up to 'max_requests' in flight: GETBULK for the
+ * columns, then GET for the other entries, and the rows the GETBULK
+ * requests didn't provide */
+static void su_batch_fill(int *idx)
+{
+	su_batch_entry_t *entry;
+	int i, n;
+
+	while ((su_batch.abort == FALSE) && (su_batch.inflight < su_batch.max_requests)) {
+		for (i = 0, n = 0; (i < su_batch.ncols) && (n < su_batch.max_varbinds); i++) {
+			if ((su_batch.cols[i].done == FALSE) && (su_batch.cols[i].pending == FALSE))
+				idx[n++] = i;
+		}
+
+		if (n > 0) {
+			if (su_batch_send(SNMP_MSG_GETBULK, idx, n) == FALSE) {
+				for (i = 0; i < n; i++)
+					su_batch.cols[idx[i]].done = TRUE;
+			}
+			continue;
+		}
+
+		/* single variables are requested during the walk */
+		if (su_batch.max_varbinds < 2)
+			break;
+
+		for (i = 0, n = 0; (i < su_batch.count) && (n < su_batch.max_varbinds); i++) {
+			entry = &su_batch.entry[i];
+			if ((entry->fetched == TRUE) || (entry->pending == TRUE) ||
+				(SU_BATCH_WANTED(entry) == FALSE) ||
+				((entry->column != -1) && (su_batch.cols[entry->column].done == FALSE)))
+				continue;
+			idx[n++] = i;
+		}
+
+		if ((n == 0) || (su_batch_send(SNMP_MSG_GET, idx, n) == FALSE))
+			break;
+	}
+}
+
+/* Start of a walk: fetch the OIDs read by the previous walk, or only
+ * those of the status and alarms with SU_WALKMODE_STATUS */
+void nut_snmp_batch_begin(int mode)
+{
+	struct timeval timeout;
+	fd_set fdset;
+	int *idx;
+	int i, numfds, block, ret;
+
+	su_batch.active = TRUE;
+	su_batch.status_only = (mode == SU_WALKMODE_STATUS);
+	su_batch.update = (mode == SU_WALKMODE_UPDATE);
+	su_batch.abort = FALSE;
+	su_batch.requests = 0;
+	su_batch.responses = 0;
+	su_batch.timeouts = 0;
+	su_batch.hits = 0;
+	su_batch.rested = 0;
+	su_batch.ncols = 0;
+
+	/* only the updates let the stable variables rest */
+	for (i = 0; i < su_batch.count; i++) {
+		su_batch_entry_t *entry = &su_batch.entry[i];
+
+		entry->resting = FALSE;
+		if ((su_batch.update == TRUE) && (entry->rest > 0)) {
+			entry->rest--;
+			entry->resting = (entry->last != NULL);
+		}
+	}
+
+	/* take the values carried by the traps received since the last walk */
+	su_trap_apply();
+
+	if ((su_batch.max_varbinds < 1) || (su_batch.count == 0))
+		return;
+
+	for (i = 0; i < su_batch.count; i++)
+		su_batch.entry[i].column = -1;
+
+	if (su_batch.max_repetitions > 0)
+		su_batch_columns();
+
+	idx = xcalloc(su_batch.max_varbinds, sizeof(*idx));
+
+	su_batch_fill(idx);
+
+	while (su_batch.inflight > 0) {
+		numfds = 0;
+		block = 1;
+		FD_ZERO(&fdset);
+		timeout.tv_sec = g_snmp_sess.timeout / ONE_SEC;
+		timeout.tv_usec = g_snmp_sess.timeout % ONE_SEC;
+
+		snmp_select_info(&numfds, &fdset, &timeout, &block);
+
+		/* always wake up for the retries and timeouts */
+		ret = select(numfds, &fdset, NULL, NULL, &timeout);
+
+		if (ret > 0) {
+			snmp_read(&fdset);
+		}
+		else if (ret == 0) {
+			snmp_timeout();
+		}
+		else if (errno != EINTR) {
+			upslog_with_errno(LOG_ERR, "%s: select", __func__);
+			snmp_timeout();
+		}
+
+		su_batch_fill(idx);
+	}
+
+	free(idx);
+
+	/* don't let the walk wait for each of the others in turn either */
+	if (su_batch.abort == TRUE) {
+		for (i = 0; i < su_batch.count; i++) {
+			if ((su_batch.entry[i].fetched == FALSE) && SU_BATCH_WANTED(&su_batch.entry[i]))
+				su_batch.entry[i].fetched = su_batch.entry[i].failed = TRUE;
+		}
+	}
+
+	upsdebugx(2, "%s: %u request(s), %u answered, %u timed out", __func__,
+		su_batch.requests, su_batch.responses, su_batch.timeouts);
+}
+
+/* Tell if two responses hold the same value */
+static bool_t su_batch_same_value(const struct snmp_pdu *a, const struct snmp_pdu *b)
+{
+	const netsnmp_variable_list *va = a->variables, *vb = b->variables;
+
+	return ((va != NULL) && (vb != NULL) && (va->type == vb->type) && (va->val_len == vb->val_len)
+		&& !memcmp(va->val.string, vb->val.string, va->val_len));
+}
+
+/* Adapt the interval between the reads of an entry to how often its value
+ * changes, once read by this walk */
+static void su_batch_backoff(su_batch_entry_t *entry)
+{
+	if (entry->fetched == FALSE)
+		return;
+
+	/* read by every walk anyway */
+	if ((entry->status == TRUE) || (entry->always == TRUE)) {
+		entry->interval = 1;
+		return;
+	}
+
+	if (entry->interval < 1)
+		entry->interval = 1;
+
+	if ((entry->pdu != NULL) && (entry->last != NULL)
+		&& (su_batch_same_value(entry->pdu, entry->last) == TRUE)) {
+		if ((++entry->stable >= SU_BACKOFF_READS) && (entry->interval < su_batch.max_backoff)) {
+			entry->interval = (2 * entry->interval < su_batch.max_backoff) ?
+				2 * entry->interval : su_batch.max_backoff;
+			entry->stable = 0;
+			upsdebugx(3, "%s: %s stable, read every %i update(s)", __func__,
+				entry->OID, entry->interval);
+		}
+	}
+	else {
+		if (entry->interval > 1)
+			upsdebugx(3, "%s: %s changed, read every update", __func__, entry->OID);
+		entry->interval = 1;
+		entry->stable = 0;
+	}
+
+	if (entry->last != NULL)
+		snmp_free_pdu(entry->last);
+	entry->last = entry->pdu;
+	entry->pdu = NULL;
+
+	entry->rest = entry->interval - 1;
+}
+
+/* Read all the variables again from the next update, as a SET may have
+ * changed more than the variable it wrote */
+static void su_batch_backoff_reset(void)
+{
+	int i;
+
+	for (i = 0; i < su_batch.count; i++) {
+		su_batch.entry[i].interval = 1;
+		su_batch.entry[i].rest = 0;
+		su_batch.entry[i].stable = 0;
+	}
+}
+
+/* After a walk: a new status or alarm (a transfer to battery, an overload,
+ * a fault) may come with new settings, so read them all again */
+static void su_batch_backoff_check(void)
+{
+	static char	status[LARGEBUF] = "", alarm[LARGEBUF] = "";
+	const char	*val;
+	bool_t	changed = FALSE;
+
+	val = dstate_getinfo("ups.status");
+	if (strcmp(status, val ? val : "")) {
+		snprintf(status, sizeof(status), "%s", val ? val : "");
+		changed = TRUE;
+	}
+
+	val = dstate_getinfo("ups.alarm");
+	if (strcmp(alarm, val ? val : "")) {
+		snprintf(alarm, sizeof(alarm), "%s", val ? val : "");
+		changed = TRUE;
+	}
+
+	if (changed == TRUE) {
+		upsdebugx(3, "%s: status or alarm changed, reading every variable", __func__);
+		su_batch_backoff_reset();
+	}
+}
+
+/* End of a walk: only keep the OIDs read successfully */
+void nut_snmp_batch_end(void)
+{
+	unsigned int saved;
+	int i, n;
+
+	upsdebugx(1, "%s: %u variable(s) served by %u batched request(s), %u left to rest, %i OID(s) tracked",
+		__func__, su_batch.hits, su_batch.requests, su_batch.rested, su_batch.count);
+
+	/* publish the requests spared by the stable variables */
+	if (su_batch.update == TRUE) {
+		saved = su_batch.rested;
+		if (su_batch.max_varbinds > 1)
+			saved = (saved + su_batch.max_varbinds - 1) / su_batch.max_varbinds;
+		dstate_setinfo("driver.stats.requests_saved", "%u", saved);
+	}
+
+	for (i = 0, n = 0; i < su_batch.count; i++) {
+		su_batch_entry_t *entry = &su_batch.entry[i];
+
+		su_batch_backoff(entry);
+
+		if (entry->pdu != NULL) {
+			snmp_free_pdu(entry->pdu);
+			entry->pdu = NULL;
+		}
+
+		/* not read because of a timeout: try again next time */
+		if ((entry->used == FALSE) && (entry->failed == FALSE) && SU_BATCH_WANTED(entry)) {
+			if (entry->last != NULL)
+				snmp_free_pdu(entry->last);
+			free(entry->OID);
+			continue;
+		}
+
+		entry->fetched = FALSE;
+		entry->used = FALSE;
+		entry->pending = FALSE;
+		entry->failed = FALSE;
+		entry->resting = FALSE;
+		su_batch.entry[n++] = *entry;
+	}
+
+	su_batch.count = n;
+	su_batch_rehash();
+	su_batch.active = FALSE;
+	su_batch.status_only = FALSE;
+	su_batch.status_info = FALSE;
+	su_batch.always_info = FALSE;
+	su_batch.update = FALSE;
+}
+
+/* Return TRUE if the value of this OID is already known to this walk */
+static bool_t su_batch_known(const char *OID)
+{
+	su_batch_entry_t *entry;
+
+	if (su_batch.active == FALSE)
+		return FALSE;
+
+	entry = su_batch_find(OID);
+
+	return ((entry != NULL) && (entry->fetched == TRUE) && (entry->pdu != NULL));
+}
+
+/* -----------------------------------------------------------
+ * Traps and informs.
+ *
+ * With 'snmp_trap_listen', the driver also listens for the traps and
+ * informs sent by the device. Their socket is the driver's extrafd, so
+ * that one wakes up the main loop right away, and the update that follows
+ * refreshes ups.status and ups.alarm without waiting for the next walk.
+ * The variables of the mapping carried by a trap are taken as they are,
+ * instead of being requested again.
+ * ----------------------------------------------------------- */
+
+static struct {
+	netsnmp_session	*sess;		/* listening session */
+	struct snmp_pdu	**pdu;		/* received since the last walk */
+	int	count;
+	int	size;
+	struct timeval	received;	/* arrival of the first of them */
+	unsigned int	accepted;
+	unsigned int	rejected;
+} su_traps;
+
+/* Only take the traps sent with our community, or SNMPv3 security name */
+static bool_t su_trap_accept(struct snmp_pdu *pdu)
+{
+	if (pdu->version == SNMP_VERSION_3) {
+		return ((g_snmp_sess.version == SNMP_VERSION_3)
+			&& (pdu->securityName != NULL)
+			&& (pdu->securityNameLen == g_snmp_sess.securityNameLen)
+			&& !memcmp(pdu->securityName, g_snmp_sess.securityName, pdu->securityNameLen));
+	}
+
+	return ((g_snmp_sess.community != NULL)
+		&& (pdu->community != NULL)
+		&& (pdu->community_len == g_snmp_sess.community_len)
+		&& !memcmp(pdu->community, g_snmp_sess.community, pdu->community_len));
+}
+
+static int su_trap_callback(int operation, netsnmp_session *session, int reqid,
+	netsnmp_pdu *pdu, void *magic)
+{
+	struct snmp_pdu *reply;
+
+	if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+		return 1;
+
+	switch (pdu->command)
+	{
+	case SNMP_MSG_TRAP:
+	case SNMP_MSG_TRAP2:
+	case SNMP_MSG_INFORM:
+		break;
+	default:
+		return 1;
+	}
+
+	if (su_trap_accept(pdu) == FALSE) {
+		su_traps.rejected++;
+		upsdebugx(2, "%s: trap with another community or security name ignored", __func__);
+		return 1;
+	}
+
+	/* acknowledge informs, or the device keeps sending them */
+	if (pdu->command == SNMP_MSG_INFORM) {
+		reply = snmp_clone_pdu(pdu);
+		if (reply != NULL) {
+			reply->command = SNMP_MSG_RESPONSE;
+			reply->errstat = 0;
+			reply->errindex = 0;
+			if (snmp_send(session, reply) == 0) {
+				nut_snmp_perror(session, 0, NULL, "%s: snmp_send", __func__);
+				snmp_free_pdu(reply);
+			}
+		}
+	}
+
+	if (su_traps.count == su_traps.size) {
+		su_traps.size = su_traps.size ? 2 * su_traps.size : 8;
+		su_traps.pdu = xrealloc(su_traps.pdu, su_traps.size * sizeof(*su_traps.pdu));
+	}
+
+	su_traps.pdu[su_traps.count] = snmp_clone_pdu(pdu);
+	if (su_traps.pdu[su_traps.count] == NULL)
+		return 1;
+
+	if (su_traps.count++ == 0)
+		gettimeofday(&su_traps.received, NULL);
+
+	su_traps.accepted++;
+
+	upsdebugx(1, "%s: %s received", __func__,
+		(pdu->command == SNMP_MSG_INFORM) ? "inform" : "trap");
+
+	return 1;
+}
+
+static void nut_snmp_trap_init(void)
+{
+	netsnmp_session sess;
+	netsnmp_transport *transport;
+	const char *address;
+
+	if (!testvar(SU_VAR_TRAPLISTEN))
+		return;
+
+	address = getval(SU_VAR_TRAPLISTEN);
+
+	snmp_sess_init(&sess);
+	sess.peername = SNMP_DEFAULT_PEERNAME;
+	sess.version = SNMP_DEFAULT_VERSION;
+	sess.community_len = SNMP_DEFAULT_COMMUNITY_LEN;
+	sess.retries = SNMP_DEFAULT_RETRIES;
+	sess.timeout = SNMP_DEFAULT_TIMEOUT;
+	sess.callback = su_trap_callback;
+	sess.callback_magic = NULL;
+	sess.isAuthoritative = SNMP_SESS_UNKNOWNAUTH;
+
+	transport = netsnmp_transport_open_server("snmptrap", address);
+	if (transport == NULL)
+		fatalx(EXIT_FAILURE, "Unable to listen for traps on %s", address);
+
+	su_traps.sess = snmp_add(&sess, transport, NULL, NULL);
+	if (su_traps.sess == NULL) {
+		nut_snmp_perror(&sess, 0, NULL, "%s: snmp_add", __func__);
+		fatalx(EXIT_FAILURE, "Unable to listen for traps on %s", address);
+	}
+
+	/* wake up the main loop on their arrival */
+	extrafd = transport->sock;
+
+	upsdebugx(1, "Listening for traps on %s", address);
+}
+
+static void nut_snmp_trap_free(void)
+{
+	int i;
+
+	for (i = 0; i < su_traps.count; i++)
+		snmp_free_pdu(su_traps.pdu[i]);
+
+	free(su_traps.pdu);
+	su_traps.pdu = NULL;
+	su_traps.count = su_traps.size = 0;
+
+	if (su_traps.sess != NULL) {
+		upsdebugx(1, "%s: %u trap(s) accepted, %u rejected", __func__,
+			su_traps.accepted, su_traps.rejected);
+		snmp_close(su_traps.sess);
+		su_traps.sess = NULL;
+		extrafd = -1;
+	}
+}
+
+/* Read the traps waiting on the socket. Return the number received since
+ * the last walk, and the time the first of them arrived in 'received' */
+int nut_snmp_trap_read(struct timeval *received)
+{
+	struct timeval timeout;
+	fd_set fdset;
+	int fd;
+
+	if (su_traps.sess == NULL)
+		return 0;
+
+	fd = extrafd;
+
+	for (;;) {
+		FD_ZERO(&fdset);
+		FD_SET(fd, &fdset);
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 0;
+
+		if (select(fd + 1, &fdset, NULL, NULL, &timeout) <= 0)
+			break;
+
+		snmp_read(&fdset);
+	}
+
+	*received = su_traps.received;
+
+	return su_traps.count;
+}
+
+/* Feed the variables carried by the traps to the walk starting */
+static void su_trap_apply(void)
+{
+	netsnmp_variable_list *var;
+	su_batch_entry_t *entry;
+	int i, j, n;
+
+	for (i = 0; i < su_traps.count; i++) {
+		for (var = su_traps.pdu[i]->variables, n = 0; var != NULL; var = var->next_variable, n++) {
+			if ((var->type == SNMP_NOSUCHOBJECT) || (var->type == SNMP_NOSUCHINSTANCE)
+				|| (var->type == SNMP_ENDOFMIBVIEW))
+				continue;
+
+			for (j = 0; j < su_batch.count; j++) {
+				entry = &su_batch.entry[j];
+				if (snmp_oid_compare(var->name, var->name_length, entry->name, entry->name_len))
+					continue;
+				if (entry->pdu != NULL)
+					snmp_free_pdu(entry->pdu);
+				entry->pdu = snmp_split_pdu(su_traps.pdu[i], n, 1);
+				entry->fetched = (entry->pdu != NULL);
+				upsdebugx(2, "%s: %s carried by a trap", __func__, entry->OID);
+				break;
+			}
+		}
+
+		snmp_free_pdu(su_traps.pdu[i]);
+	}
+
+	su_traps.count = 0;
+}
+
+/* -----------------------------------------------------------
+ * Capabilities cache.
+ *
+ * The INIT walk tries every entry of the mapping, counts the template
+ * instances and checks the commands, which takes a while on big PDUs and
+ * daisychains. What it finds out is cached under the state path: the
+ * flags of the mapping entries, those it could not read, the template
+ * counts guessed, the commands supported and the OIDs read. On the next
+ * start, if the device still has the same sysOID, serial number and
+ * firmware, the INIT walk skips the entries it could not read, and gets
+ * the others with their OIDs batched from the start. The entries the cache
+ * tells unsupported are then tried again a few at a time by the following
+ * updates, and the cache is dropped if one of them turns out to be
+ * supported after all.
+ * ----------------------------------------------------------- */
+
+#define SU_CAPS_VERSION	"1"	/* cache file format */
+#define SU_CAPS_PROBES	8	/* unsupported entries tried again per update */
+
+typedef struct {
+	char	*name;			/* template count variable */
+	int	value;
+} su_caps_count_t;
+
+static struct {
+	char	path[SMALLBUF];		/* cache file, empty if not used */
+	char	key[3 * SU_INFOSIZE];	/* sysOID, serial number and firmware */
+	int	nentries;		/* mapping entries */
+	unsigned long	*flags;		/* their flags, as loaded from the cache */
+	bool_t	*skip;			/* not read by the previous INIT walk */
+	bool_t	*found;			/* read by this INIT walk */
+	bool_t	*cmds;			/* commands supported */
+	su_caps_count_t	*counts;	/* template counts guessed */
+	int	ncounts;
+	char	**oids;			/* OIDs read by the INIT walk */
+	int	noids;
+	bool_t	loaded;			/* the cache matches the device */
+	bool_t	restored;		/* and the INIT walk relies on it */
+	int	probe;			/* next entry to try again, or -1 */
+} su_caps;
+
+static void su_caps_err(const char *errmsg)
+{
+	upslogx(LOG_ERR, "Error in capabilities cache %s: %s", su_caps.path, errmsg);
+}
+
+/* Read a string from the device, for the cache key */
+static void su_caps_get_info(const char *type, const char *alt_type, char *buf, size_t buf_len)
+{
+	snmp_info_t *su_info_p;
+	char OID[SU_INFOSIZE];
+
+	buf[0] = '\0';
+
+	su_info_p = su_find_info(type);
+	if (su_info_p == NULL)
+		su_info_p = su_find_info(alt_type);
+
+	if ((su_info_p == NULL) || (su_info_p->OID == NULL) || (su_info_p->flags & SU_FLAG_ABSENT))
+		return;
+
+	/* daisychain: that of the master */
+	snprintf(OID, sizeof(OID), su_info_p->OID, 0);
+
+	if (nut_snmp_get_str(OID, buf, buf_len, NULL) == FALSE)
+		buf[0] = '\0';
+}
+
+static void su_caps_add_count(const char *name, int value)
+{
+	int i;
+
+	for (i = 0; i < su_caps.ncounts; i++) {
+		if (!strcmp(su_caps.counts[i].name, name)) {
+			su_caps.counts[i].value = value;
+			return;
+		}
+	}
+
+	su_caps.counts = xrealloc(su_caps.counts, (su_caps.ncounts + 1) * sizeof(*su_caps.counts));
+	su_caps.counts[su_caps.ncounts].name = xstrdup(name);
+	su_caps.counts[su_caps.ncounts].value = value;
+	su_caps.ncounts++;
+}
+
+static void su_caps_free_lists(void)
+{
+	int i;
+
+	for (i = 0; i < su_caps.ncounts; i++)
+		free(su_caps.counts[i].name);
+	free(su_caps.counts);
+	su_caps.counts = NULL;
+	su_caps.ncounts = 0;
+
+	for (i = 0; i < su_caps.noids; i++)
+		free(su_caps.oids[i]);
+	free(su_caps.oids);
+	su_caps.oids = NULL;
+	su_caps.noids = 0;
+}
+
+static bool_t su_caps_parse(int numargs, char **arg)
+{
+	int i;
+
+	if ((numargs == 2) && !strcmp(arg[0], "version"))
+		return !strcmp(arg[1], SU_CAPS_VERSION);
+
+	if ((numargs == 2) && !strcmp(arg[0], "driver"))
+		return !strcmp(arg[1], DRIVER_VERSION);
+
+	if ((numargs == 2) && !strcmp(arg[0], "key"))
+		return !strcmp(arg[1], su_caps.key);
+
+	if ((numargs == 3) && !strcmp(arg[0], "mib"))
+		return (!strcmp(arg[1], mibname) && !strcmp(arg[2], mibvers));
+
+	if ((numargs == 2) && !strcmp(arg[0], "entries"))
+		return (atoi(arg[1]) == su_caps.nentries);
+
+	if ((numargs == 3) && !strcmp(arg[0], "flags")) {
+		i = atoi(arg[1]);
+		if ((i < 0) || (i >= su_caps.nentries))
+			return FALSE;
+		su_caps.flags[i] = strtoul(arg[2], NULL, 16);
+		return TRUE;
+	}
+
+	if ((numargs == 2) && !strcmp(arg[0], "skip")) {
+		i = atoi(arg[1]);
+		if ((i < 0) || (i >= su_caps.nentries))
+			return FALSE;
+		su_caps.skip[i] = TRUE;
+		return TRUE;
+	}
+
+	if ((numargs == 2) && !strcmp(arg[0], "cmd")) {
+		i = atoi(arg[1]);
+		if ((i < 0) || (i >= su_caps.nentries))
+			return FALSE;
+		su_caps.cmds[i] = TRUE;
+		return TRUE;
+	}
+
+	if ((numargs == 3) && !strcmp(arg[0], "count")) {
+		su_caps_add_count(arg[1], atoi(arg[2]));
+		return TRUE;
+	}
+
+	if ((numargs == 2) && !strcmp(arg[0], "oid")) {
+		su_caps.oids = xrealloc(su_caps.oids, (su_caps.noids + 1) * sizeof(*su_caps.oids));
+		su_caps.oids[su_caps.noids++] = xstrdup(arg[1]);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Load the cache, and tell if it matches the device */
+static bool_t su_caps_load(void)
+{
+	PCONF_CTX_t ctx;
+	bool_t valid = TRUE;
+	int i;
+
+	pconf_init(&ctx, su_caps_err);
+
+	if (!pconf_file_begin(&ctx, su_caps.path)) {
+		upsdebugx(1, "%s: no capabilities cache (%s)", __func__, ctx.errmsg);
+		pconf_finish(&ctx);
+		return FALSE;
+	}
+
+	/* the flags of all the entries are stored */
+	for (i = 0; i < su_caps.nentries; i++)
+		su_caps.flags[i] = ULONG_MAX;
+
+	while (pconf_file_next(&ctx)) {
+		if (pconf_parse_error(&ctx)) {
+			upslogx(LOG_ERR, "Parse error: %s:%d: %s",
+				su_caps.path, ctx.linenum, ctx.errmsg);
+			valid = FALSE;
+			break;
+		}
+
+		if (ctx.numargs < 1)
+			continue;
+
+		if (su_caps_parse(ctx.numargs, ctx.arglist) == FALSE) {
+			upsdebugx(1, "%s: %s:%d: outdated or invalid, ignoring it",
+				__func__, su_caps.path, ctx.linenum);
+			valid = FALSE;
+			break;
+		}
+	}
+
+	pconf_finish(&ctx);
+
+	for (i = 0; (valid == TRUE) && (i < su_caps.nentries); i++) {
+		if (su_caps.flags[i] == ULONG_MAX) {
+			upsdebugx(1, "%s: %s: incomplete, ignoring it", __func__, su_caps.path);
+			valid = FALSE;
+		}
+	}
+
+	if (valid == FALSE) {
+		memset(su_caps.skip, 0, su_caps.nentries * sizeof(*su_caps.skip));
+		memset(su_caps.cmds, 0, su_caps.nentries * sizeof(*su_caps.cmds));
+		su_caps_free_lists();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Compute the device key, and load its cache */
+static void su_caps_init(void)
+{
+	char sysoid[SU_INFOSIZE], serial[SU_INFOSIZE], firmware[SU_INFOSIZE];
+
+	for (su_caps.nentries = 0; snmp_info[su_caps.nentries].info_type != NULL; su_caps.nentries++);
+
+	su_caps.flags = xcalloc(su_caps.nentries + 1, sizeof(*su_caps.flags));
+	su_caps.skip = xcalloc(su_caps.nentries + 1, sizeof(*su_caps.skip));
+	su_caps.found = xcalloc(su_caps.nentries + 1, sizeof(*su_caps.found));
+	su_caps.cmds = xcalloc(su_caps.nentries + 1, sizeof(*su_caps.cmds));
+	su_caps.probe = -1;
+
+	if (testvar(SU_VAR_NOCACHE))
+		return;
+
+	if (upsname)
+		snprintf(su_caps.path, sizeof(su_caps.path), "%s/%s-%s.cache", dflt_statepath(), progname, upsname);
+	else
+		snprintf(su_caps.path, sizeof(su_caps.path), "%s/%s.cache", dflt_statepath(), progname);
+
+	if (nut_snmp_get_oid(SYSOID_OID, sysoid, sizeof(sysoid)) == FALSE)
+		sysoid[0] = '\0';
+
+	su_caps_get_info("ups.serial", "device.serial", serial, sizeof(serial));
+	su_caps_get_info("ups.firmware", "device.firmware", firmware, sizeof(firmware));
+
+	snprintf(su_caps.key, sizeof(su_caps.key), "%s|%s|%s", sysoid, serial, firmware);
+
+	upsdebugx(2, "%s: device key '%s'", __func__, su_caps.key);
+
+	su_caps.loaded = su_caps_load();
+}
+
+/* Apply the cache loaded to the mapping, before the INIT walk. Return TRUE
+ * if it was, the flags of all the entries then come from the cache */
+static bool_t su_caps_restore(void)
+{
+	int i;
+
+	if (su_caps.loaded == FALSE)
+		return FALSE;
+
+	for (i = 0; i < su_caps.nentries; i++)
+		snmp_info[i].flags = su_caps.flags[i];
+
+	for (i = 0; i < su_caps.ncounts; i++)
+		dstate_setinfo(su_caps.counts[i].name, "%i", su_caps.counts[i].value);
+
+	for (i = 0; i < su_caps.noids; i++) {
+		if (su_batch_find(su_caps.oids[i]) == NULL)
+			su_batch_add(su_caps.oids[i]);
+	}
+
+	su_caps.restored = TRUE;
+
+	/* with daisychained devices, the entries are shared by all of them */
+	if (daisychain_enabled == FALSE)
+		su_caps.probe = 0;
+
+	upslogx(LOG_INFO, "Using the capabilities cache %s", su_caps.path);
+	upsdebugx(1, "%s: %i OID(s), %i template count(s)", __func__, su_caps.noids, su_caps.ncounts);
+	return TRUE;
+}
+
+/* Record that the INIT walk read this entry, or one of its instances */
+static void su_caps_set_found(const snmp_info_t *su_info_p)
+{
+	if ((su_info_p >= snmp_info) && (su_info_p < snmp_info + su_caps.nentries))
+		su_caps.found[su_info_p - snmp_info] = TRUE;
+}
+
+/* Tell if the INIT walk can skip this entry, as the previous one could not
+ * read it */
+static bool_t su_caps_skipped(const snmp_info_t *su_info_p)
+{
+	return ((su_caps.restored == TRUE) && !(su_info_p->flags & SU_FLAG_OK)
+		&& (su_caps.skip[su_info_p - snmp_info] == TRUE));
+}
+
+/* Tell if this command is supported */
+static bool_t su_caps_cmd_supported(const snmp_info_t *su_info_p)
+{
+	struct snmp_pdu *pdu;
+	int i = su_info_p - snmp_info;
+
+	if (su_caps.restored == TRUE)
+		return su_caps.cmds[i];
+
+	pdu = nut_snmp_get(su_info_p->OID);
+	su_caps.cmds[i] = (pdu != NULL);
+
+	if (pdu != NULL)
+		snmp_free_pdu(pdu);
+
+	return su_caps.cmds[i];
+}
+
+/* Save the cache, once the INIT walk is done. What a failed walk, or one
+ * with requests timed out, missed would be cached as unsupported for good:
+ * the cache is removed instead */
+static void su_caps_save(bool_t walked)
+{
+	char tmpfn[SMALLBUF + 4], buf[LARGEBUF];
+	FILE *f;
+	int i;
+
+	if (su_caps.path[0] == '\0')
+		return;
+
+	if ((walked == FALSE) || (su_batch.timeouts > 0)) {
+		su_caps_drop();
+		return;
+	}
+
+	snprintf(tmpfn, sizeof(tmpfn), "%s.tmp", su_caps.path);
+
+	f = fopen(tmpfn, "w");
+	if (f == NULL) {
+		upslog_with_errno(LOG_WARNING, "Can't save the capabilities cache %s", tmpfn);
+		return;
+	}
+
+	fprintf(f, "# Capabilities of the device, as found by %s %s\n", progname, DRIVER_VERSION);
+	fprintf(f, "# Remove this file to walk the whole device again on the next start\n");
+	fprintf(f, "version %s\n", SU_CAPS_VERSION);
+	fprintf(f, "driver \"%s\"\n", DRIVER_VERSION);
+	fprintf(f, "key \"%s\"\n", pconf_encode(su_caps.key, buf, sizeof(buf)));
+	fprintf(f, "mib \"%s\"", pconf_encode(mibname, buf, sizeof(buf)));
+	fprintf(f, " \"%s\"\n", pconf_encode(mibvers, buf, sizeof(buf)));
+	fprintf(f, "entries %i\n", su_caps.nentries);
+
+	for (i = 0; i < su_caps.nentries; i++) {
+		fprintf(f, "flags %i %lx\n", i, snmp_info[i].flags & ~SU_FLAG_STALE);
+		if (!(snmp_info[i].flags & SU_FLAG_OK) && (su_caps.found[i] == FALSE))
+			fprintf(f, "skip %i\n", i);
+		if (su_caps.cmds[i] == TRUE)
+			fprintf(f, "cmd %i\n", i);
+	}
+
+	for (i = 0; i < su_caps.ncounts; i++)
+		fprintf(f, "count \"%s\" %i\n",
+			pconf_encode(su_caps.counts[i].name, buf, sizeof(buf)), su_caps.counts[i].value);
+
+	for (i = 0; i < su_batch.count; i++)
+		fprintf(f, "oid \"%s\"\n", su_batch.entry[i].OID);
+
+	if ((fclose(f) != 0) || (rename(tmpfn, su_caps.path) != 0)) {
+		upslog_with_errno(LOG_WARNING, "Can't save the capabilities cache %s", su_caps.path);
+		unlink(tmpfn);
+		return;
+	}
+
+	upsdebugx(1, "%s: %s saved, %i OID(s)", __func__, su_caps.path, su_batch.count);
+}
+
+/* Remove the cache, so that the next start walks the whole device again */
+static void su_caps_drop(void)
+{
+	if (su_caps.path[0] == '\0')
+		return;
+
+	if ((unlink(su_caps.path) != 0) && (errno != ENOENT)) {
+		upslog_with_errno(LOG_WARNING, "Can't remove the capabilities cache %s", su_caps.path);
+		return;
+	}
+
+	upsdebugx(1, "%s: incomplete INIT walk, %s not saved", __func__, su_caps.path);
+}
+
+/* Tell if an entry the cache tells unsupported can be tried again on its own */
+static bool_t su_caps_probeable(const snmp_info_t *su_info_p)
+{
+	const snmp_info_t *other;
+
+	if ((su_info_p->flags & (SU_FLAG_OK | SU_FLAG_ABSENT | SU_OUTLET | SU_OUTLET_GROUP | SU_PHASES))
+		|| (SU_TYPE(su_info_p) == SU_TYPE_CMD)
+		|| (su_info_p->OID == NULL) || (strchr(su_info_p->OID, '%') != NULL)
+		|| !strncmp(su_info_p->info_type, "device.count", 12))
+		return FALSE;
+
+	/* another entry already provides this variable */
+	for (other = &snmp_info[0]; other->info_type != NULL; other++) {
+		if ((other->flags & SU_FLAG_OK) && !strcmp(other->info_type, su_info_p->info_type))
+			return FALSE;
+	}
+
+	return TRUE;
+}
 
-		privProtocol = testvar(SU_VAR_PRIVPROT) ? getval(SU_VAR_PRIVPROT) : "DES";
+/* Try again a few of the entries the cache tells unsupported. If one of them
+ * is supported after all, use it, and drop the cache so that the next start
+ * walks the whole device again */
+static void su_caps_revalidate(void)
+{
+	snmp_info_t *su_info_p;
+	int probes = 0;
 
-		if (strcmp(privProtocol, "DES") == 0) {
-			g_snmp_sess.securityPrivProto = usmDESPrivProtocol;
-			g_snmp_sess.securityPrivProtoLen =  sizeof(usmDESPrivProtocol)/sizeof(oid);
-		}
-		else if (strcmp(privProtocol, "AES") == 0) {
-			g_snmp_sess.securityPrivProto = usmAESPrivProtocol;
-			g_snmp_sess.securityPrivProtoLen =  sizeof(usmAESPrivProtocol)/sizeof(oid);
-		}
-		else
-			fatalx(EXIT_FAILURE, "Bad SNMPv3 authProtocol: %s", authProtocol);
+	while ((su_caps.probe != -1) && (probes < SU_CAPS_PROBES)) {
+		su_info_p = &snmp_info[su_caps.probe++];
 
-		/* set the privacy key to a MD5/SHA1 hashed version of our
-		 * passphrase (must be at least 8 characters long) */
-		if(g_snmp_sess.securityLevel == SNMP_SEC_LEVEL_AUTHPRIV) {
-			g_snmp_sess.securityPrivKeyLen = USM_PRIV_KU_LEN;
-			if (generate_Ku(g_snmp_sess.securityAuthProto,
-				g_snmp_sess.securityAuthProtoLen,
-				(u_char *) privPassword, strlen(privPassword),
-				g_snmp_sess.securityPrivKey,
-				&g_snmp_sess.securityPrivKeyLen) !=
-				SNMPERR_SUCCESS) {
-				fatalx(EXIT_FAILURE, "Error generating Ku from privacy pass phrase");
-			}
+		if (su_info_p->info_type == NULL) {
+			upsdebugx(1, "%s: capabilities cache checked", __func__);
+			su_caps.probe = -1;
+			break;
 		}
-	}
-	else
-		fatalx(EXIT_FAILURE, "Bad SNMP version: %s", version);
 
-	/* Open the session */
-	SOCK_STARTUP; /* MS Windows wrapper, not really needed on Unix! */
-	g_snmp_sess_p = snmp_open(&g_snmp_sess);	/* establish the session */
-	if (g_snmp_sess_p == NULL) {
-		nut_snmp_perror(&g_snmp_sess, 0, NULL, "nut_snmp_init: snmp_open");
-		fatalx(EXIT_FAILURE, "Unable to establish communication");
+		if (su_caps_probeable(su_info_p) == FALSE)
+			continue;
+
+		probes++;
+		current_device_number = 1;
+
+		if (su_ups_get(su_info_p) == FALSE)
+			continue;
+
+		upslogx(LOG_INFO, "%s is supported, dropping the capabilities cache %s",
+			su_info_p->info_type, su_caps.path);
+		su_info_p->flags |= SU_FLAG_OK;
+		unlink(su_caps.path);
 	}
 }
 
-void nut_snmp_cleanup(void)
+static void su_caps_free(void)
 {
-	/* close snmp session. */
-	if (g_snmp_sess_p) {
-		snmp_close(g_snmp_sess_p);
-		g_snmp_sess_p = NULL;
-	}
-	SOCK_CLEANUP; /* wrapper not needed on Unix! */
+	su_caps_free_lists();
+	free(su_caps.flags);
+	su_caps.flags = NULL;
+	free(su_caps.skip);
+	su_caps.skip = NULL;
+	free(su_caps.found);
+	su_caps.found = NULL;
+	free(su_caps.cmds);
+	su_caps.cmds = NULL;
 }
 
 /* Free a struct snmp_pdu * returned by nut_snmp_walk */
@@ -632,9 +2379,9 @@ struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 {
 	int status;
 	struct snmp_pdu *pdu, *response = NULL;
-	oid name[MAX_OID_LEN];
-	size_t name_len = MAX_OID_LEN;
-	oid * current_name;
+	const oid *name;
+	size_t name_len;
+	const oid *current_name;
 	size_t current_name_len;
 	static unsigned int numerr = 0;
 	int nb_iteration = 0;
@@ -645,7 +2392,7 @@ struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 	upsdebugx(4, "%s: max. iteration = %i", __func__, max_iteration);
 
 	/* create and send request. */
-	if (!snmp_parse_oid(OID, name, &name_len)) {
+	if (su_oid_compile(OID, &name, &name_len) == FALSE) {
 		upsdebugx(2, "[%s] %s: %s: %s",
 			upsname?upsname:device_name, __func__, OID, snmp_api_errstring(snmp_errno));
 		return NULL;
@@ -706,6 +2453,16 @@ struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 			numerr = 0;
 		}
 
+		/* SNMPv2c and v3 flag absent variables as exceptions instead */
+		if ((response->variables == NULL) ||
+			(response->variables->type == SNMP_NOSUCHOBJECT) ||
+			(response->variables->type == SNMP_NOSUCHINSTANCE) ||
+			(response->variables->type == SNMP_ENDOFMIBVIEW)) {
+			upsdebugx(3, "%s: %s: no such object", __func__, OID);
+			snmp_free_pdu(response);
+			break;
+		}
+
 		nb_iteration++;
 		/* +1 is for the terminating NULL */
 		struct snmp_pdu ** new_ret_array = realloc(ret_array,sizeof(struct snmp_pdu*)*(nb_iteration+1));
@@ -732,12 +2489,38 @@ struct snmp_pdu *nut_snmp_get(const char *OID)
 {
 	struct snmp_pdu ** pdu_array;
 	struct snmp_pdu * ret_pdu;
+	su_batch_entry_t *entry = NULL;
 
 	if (OID == NULL)
 		return NULL;
 
 	upsdebugx(3, "%s(%s)", __func__, OID);
 
+	/* Served by the requests batched at the start of this walk? */
+	if (su_batch.active == TRUE) {
+		entry = su_batch_find(OID);
+
+		if ((entry != NULL) && (entry->fetched == TRUE)) {
+			if (entry->pdu == NULL) {
+				upsdebugx(3, "%s: %s absent from batched response", __func__, OID);
+				return NULL;
+			}
+			su_batch.hits++;
+			entry->used = TRUE;
+			entry->status |= su_batch.status_info;
+			entry->always |= su_batch.always_info;
+			return snmp_clone_pdu(entry->pdu);
+		}
+
+		/* stable, and left to rest by this walk */
+		if ((entry != NULL) && (entry->resting == TRUE)
+			&& (su_batch.status_info == FALSE) && (su_batch.always_info == FALSE)) {
+			su_batch.rested++;
+			entry->used = TRUE;
+			return snmp_clone_pdu(entry->last);
+		}
+	}
+
 	pdu_array = nut_snmp_walk(OID,1);
 
 	if(pdu_array == NULL) {
@@ -748,6 +2531,17 @@ struct snmp_pdu *nut_snmp_get(const char *OID)
 
 	nut_snmp_free(pdu_array);
 
+	/* Remember it, to batch it with the others in the next walk */
+	if (su_batch.active == TRUE) {
+		if (entry == NULL)
+			entry = su_batch_add(OID);
+		if (entry != NULL) {
+			entry->used = TRUE;
+			entry->status |= su_batch.status_info;
+			entry->always |= su_batch.always_info;
+		}
+	}
+
 	return ret_pdu;
 }
 
@@ -975,8 +2769,10 @@ bool_t nut_snmp_set(const char *OID, char type, const char *value)
 
 	status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
 
-	if ((status == STAT_SUCCESS) && (response->errstat == SNMP_ERR_NOERROR))
+	if ((status == STAT_SUCCESS) && (response->errstat == SNMP_ERR_NOERROR)) {
+		su_batch_backoff_reset();
 		ret = TRUE;
+	}
 	else
 		nut_snmp_perror(g_snmp_sess_p, status, response,
 			"%s: can't set %s", __func__, OID);
@@ -1144,6 +2940,32 @@ void su_setinfo(snmp_info_t *su_info_p, const char *value)
 	}
 }
 
+/* Return TRUE if this entry is a part of ups.status or ups.alarm */
+static bool_t su_is_status_info(const snmp_info_t *su_info_p)
+{
+	const char *suffix = strrchr(su_info_p->info_type, '.');
+
+	return (!strcasecmp(su_info_p->info_type, "ups.status")
+		|| !strcasecmp(su_info_p->info_type, "ups.alarms")
+		|| ((suffix != NULL) && !strcmp(suffix, ".alarm")));
+}
+
+/* Return TRUE if this entry is a setting or a rating, which may be read
+ * less often while its value doesn't change. The measurements (battery.*,
+ * input.*, output.*, ups.load...) and the states are read by every update. */
+static bool_t su_may_rest(const snmp_info_t *su_info_p)
+{
+	const char *type = su_info_p->info_type;
+
+	if ((su_info_p->flags & SU_FLAG_STATIC) || (su_info_p->info_flags & ST_FLAG_RW))
+		return TRUE;
+
+	return ((strstr(type, ".nominal") != NULL)
+		|| (strstr(type, ".transfer.") != NULL)
+		|| (strstr(type, ".delay.") != NULL)
+		|| (strstr(type, ".desc") != NULL));
+}
+
 void su_status_set(snmp_info_t *su_info_p, long value)
 {
 	const char *info_value = NULL;
@@ -1285,6 +3107,66 @@ bool_t match_model_OID()
 	return retCode;
 }
 
+/* sysOID of the mib2nut definitions, hashed for match_sysoid() */
+#define SU_SYSOID_HASHSIZE	64
+
+static struct {
+	int	*next;			/* next mib2nut index in the hash chain, or -1 */
+	int	hash[SU_SYSOID_HASHSIZE];	/* first mib2nut index of each chain, or -1 */
+	bool_t	ready;
+} su_sysoids;
+
+static unsigned int su_sysoid_hash(const oid *name, size_t name_len)
+{
+	unsigned int h = 5381;
+	size_t i;
+
+	for (i = 0; i < name_len; i++)
+		h = (h * 33) ^ (unsigned int)name[i];
+
+	return h % SU_SYSOID_HASHSIZE;
+}
+
+static void su_sysoid_free(void)
+{
+	free(su_sysoids.next);
+	su_sysoids.next = NULL;
+	su_sysoids.ready = FALSE;
+}
+
+static void su_sysoid_init(void)
+{
+	const oid *name;
+	size_t name_len;
+	unsigned int h;
+	int i, count;
+
+	for (i = 0; i < SU_SYSOID_HASHSIZE; i++)
+		su_sysoids.hash[i] = -1;
+
+	for (count = 0; mib2nut[count] != NULL; count++);
+
+	su_sysoids.next = xcalloc(count, sizeof(*su_sysoids.next));
+
+	/* backward, so that the chains keep the order of mib2nut */
+	for (i = count - 1; i >= 0; i--) {
+		if (mib2nut[i]->sysOID == NULL)
+			continue;
+
+		if (su_oid_compile(mib2nut[i]->sysOID, &name, &name_len) == FALSE) {
+			upsdebugx(2, "%s: can't build OID %s: %s",
+				__func__, mib2nut[i]->sysOID, snmp_api_errstring(snmp_errno));
+			continue;
+		}
+
+		h = su_sysoid_hash(name, name_len);
+		su_sysoids.next[i] = su_sysoids.hash[h];
+		su_sysoids.hash[h] = i;
+	}
+
+	su_sysoids.ready = TRUE;
+}
+
 /* Try to find the MIB using sysOID matching.
  * Return a pointer to a mib2nut definition if found, NULL otherwise */
 mib2nut_info_t *match_sysoid()
@@ -1292,10 +3174,13 @@ mib2nut_info_t *match_sysoid()
 	char sysOID_buf[LARGEBUF];
 	oid device_sysOID[MAX_OID_LEN];
 	size_t device_sysOID_len = MAX_OID_LEN;
-	oid mib2nut_sysOID[MAX_OID_LEN];
-	size_t mib2nut_sysOID_len = MAX_OID_LEN;
+	const oid *mib2nut_sysOID;
+	size_t mib2nut_sysOID_len;
 	int i;
 
+	if (su_sysoids.ready == FALSE)
+		su_sysoid_init();
+
 	/* Retrieve sysOID value of this device */
 	if (nut_snmp_get_oid(SYSOID_OID, sysOID_buf, sizeof(sysOID_buf)) == TRUE)
 	{
@@ -1310,26 +3195,15 @@ mib2nut_info_t *match_sysoid()
 			return NULL;
 		}
 
-		/* Now, iterate on mib2nut definitions */
-		for (i = 0; mib2nut[i] != NULL; i++)
+		/* Now, iterate on the mib2nut definitions with the same hash */
+		for (i = su_sysoids.hash[su_sysoid_hash(device_sysOID, device_sysOID_len)];
+			i != -1; i = su_sysoids.next[i])
 		{
 			upsdebugx(1, "%s: checking MIB %s", __func__, mib2nut[i]->mib_name);
 
-			if (mib2nut[i]->sysOID == NULL)
+			if (su_oid_compile(mib2nut[i]->sysOID, &mib2nut_sysOID, &mib2nut_sysOID_len) == FALSE)
 				continue;
 
-			/* Clear variables */
-			memset(mib2nut_sysOID, 0, MAX_OID_LEN);
-			mib2nut_sysOID_len = MAX_OID_LEN;
-
-			if (!read_objid(mib2nut[i]->sysOID, mib2nut_sysOID, &mib2nut_sysOID_len))
-			{
-				upsdebugx(2, "%s: can't build OID %s: %s",
-					__func__, sysOID_buf, snmp_api_errstring(snmp_errno));
-
-				/* Try to continue anyway! */
-				continue;
-			}
 			/* Now compare these */
 			upsdebugx(1, "%s: comparing %s with %s", __func__, sysOID_buf, mib2nut[i]->sysOID);
 			if (!netsnmp_oid_equals(device_sysOID, device_sysOID_len, mib2nut_sysOID, mib2nut_sysOID_len))
@@ -1418,6 +3292,7 @@ bool_t load_mib2nut(const char *mib)
 		mibvers = m2n->mib_version;
 		alarms_info = m2n->alarms_info;
 		upsdebugx(1, "load_mib2nut: using %s mib", mibname);
+		su_oid_compile_mapping();
 		return TRUE;
 	}
 
@@ -1521,6 +3396,114 @@ bool_t is_multiple_template(const char *OID_template)
 	return retCode;
 }
 
+/* Template instances: the snmp_info_t of the outlet, outlet group and
+ * daisychain templates are expanded once per device, and kept with their
+ * compiled OIDs, rather than allocated and formatted again on each walk */
+typedef struct su_instances_s {
+	const snmp_info_t	*info_template;
+	const char	*type;		/* template type, NULL for su_ups_get() */
+	int	device;			/* current_device_number */
+	int	base;			/* first SNMP index */
+	int	count;			/* number of instances */
+	int	nut_offset;		/* base_nut_template_offset() */
+	snmp_info_t	*instance;
+	struct su_instances_s	*next;	/* next in the hash chain */
+} su_instances_t;
+
+#define SU_INSTANCES_HASHSIZE	256
+
+static su_instances_t *su_instances[SU_INSTANCES_HASHSIZE];
+
+static void su_instances_clear(su_instances_t *instances)
+{
+	snmp_info_t *instance;
+	int i;
+
+	for (i = 0; i < instances->count; i++) {
+		instance = &instances->instance[i];
+		free((char *)instance->info_type);
+		free((char *)instance->OID);
+		if (instance->dfl != instances->info_template->dfl)
+			free((char *)instance->dfl);
+	}
+
+	free(instances->instance);
+	instances->instance = NULL;
+	instances->count = 0;
+}
+
+static void su_instances_free(void)
+{
+	su_instances_t *instances, *next;
+	int i;
+
+	for (i = 0; i < SU_INSTANCES_HASHSIZE; i++) {
+		for (instances = su_instances[i]; instances != NULL; instances = next) {
+			next = instances->next;
+			su_instances_clear(instances);
+			free(instances);
+		}
+		su_instances[i] = NULL;
+	}
+}
+
+/* Return the instances of a template for the current device. These are
+ * left empty (NULL info_type) to be expanded by the caller the first
+ * time, or when the base index or the number of instances changed */
+static su_instances_t *su_instances_get(const snmp_info_t *info_template,
+	const char *type, int base, int count)
+{
+	su_instances_t *instances;
+	unsigned int h;
+
+	h = ((unsigned long)info_template / sizeof(*info_template) + current_device_number)
+		% SU_INSTANCES_HASHSIZE;
+
+	for (instances = su_instances[h]; instances != NULL; instances = instances->next) {
+		if ((instances->info_template == info_template)
+			&& (instances->device == current_device_number)
+			&& ((instances->type == type)
+				|| ((instances->type != NULL) && (type != NULL) && !strcmp(instances->type, type))))
+			break;
+	}
+
+	if (instances == NULL) {
+		instances = xcalloc(1, sizeof(*instances));
+		instances->info_template = info_template;
+		instances->type = type;
+		instances->device = current_device_number;
+		instances->next = su_instances[h];
+		su_instances[h] = instances;
+	}
+	else if ((instances->base == base) && (instances->count == count)
+		&& (instances->nut_offset == base_nut_template_offset())) {
+		return instances;
+	}
+
+	su_instances_clear(instances);
+
+	instances->base = base;
+	instances->count = count;
+	instances->nut_offset = base_nut_template_offset();
+	instances->instance = xcalloc(count, sizeof(*instances->instance));
+
+	return instances;
+}
+
+/* Get the current template data into an expanded instance */
+static void su_instance_refresh(snmp_info_t *instance, const snmp_info_t *info_template)
+{
+	const char *info_type = instance->info_type;
+	const char *OID = instance->OID;
+	const char *dfl = instance->dfl;
+
+	*instance = *info_template;
+
+	instance->info_type = info_type;
+	instance->OID = OID;
+	instance->dfl = dfl;
+}
+
 /* Instantiate an snmp_info_t from a template.
  * Useful for outlet and outlet.group templates.
  * Note: remember to adapt info_type, OID and optionaly dfl */
@@ -1580,6 +3563,7 @@ int base_snmp_template_index(const snmp_info_t *su_info_p)
 {
 	int base_index = template_index_base;
 	char test_OID[SU_INFOSIZE];
+	struct snmp_pdu *pdu;
 
 	upsdebugx(3, "%s: OID template = %s", __func__, su_info_p->OID);
 
@@ -1609,8 +3593,10 @@ int base_snmp_template_index(const snmp_info_t *su_info_p)
 				snprintf(test_OID, sizeof(test_OID), su_info_p->OID, base_index);
 			}
 
-			if (nut_snmp_get(test_OID) != NULL)
+			if ((pdu = nut_snmp_get(test_OID)) != NULL) {
+				snmp_free_pdu(pdu);
 				break;
+			}
 		}
 		/* Only store if it's a template for outlets or outlets groups,
 		 * not for daisychain (which has different index) */
@@ -1636,26 +3622,141 @@ static int guestimate_template_count(const char *OID_template)
 {
 	int base_index = 0;
 	char test_OID[SU_INFOSIZE];
+	struct snmp_pdu *pdu;
 	int base_count;
 
 	upsdebugx(1, "%s(%s)", __func__, OID_template);
 
 	/* Determine if OID index starts from 0 or 1? */
 	snprintf(test_OID, sizeof(test_OID), OID_template, base_index);
-	if (nut_snmp_get(test_OID) == NULL)
+	if ((pdu = nut_snmp_get(test_OID)) == NULL)
 		base_index++;
+	else
+		snmp_free_pdu(pdu);
 
 	/* Now, actually iterate */
 	for (base_count = 0 ;  ; base_count++) {
 		snprintf(test_OID, sizeof(test_OID), OID_template, base_index + base_count);
-		if (nut_snmp_get(test_OID) == NULL)
+		if ((pdu = nut_snmp_get(test_OID)) == NULL)
 			break;
+		snmp_free_pdu(pdu);
 	}
 
 	upsdebugx(3, "%s: %i", __func__, base_count);
 	return base_count;
 }
 
+/* Expand a template instance: adapt info_type, OID and optionaly dfl */
+static void expand_template(const char* type, const snmp_info_t *su_info_p,
+	snmp_info_t *cur_info_p, int cur_template_number)
+{
+	int cur_nut_index = 0;
+	const oid *name;
+	size_t name_len;
+	char tmp_buf[SU_INFOSIZE];
+	char buf[SU_INFOSIZE];
+
+	upsdebugx(2, "%s: %s #%i", __func__, su_info_p->info_type, cur_template_number);
+
+	*cur_info_p = *su_info_p;
+
+	/* Special processing for daisychain:
+	 * append 'device.x' to the NUT variable name, except for the
+	 * whole daisychain ("device.0") */
+	if (!strncmp(type, "device", 6))
+	{
+		/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
+		if (current_device_number > 0) {
+			const char *ptr = NULL;
+			/* Another special processing for daisychain
+			 * device collection needs special appending */
+			if (!strncmp(su_info_p->info_type, "device.", 7))
+				ptr = &su_info_p->info_type[7];
+			else
+				ptr = su_info_p->info_type;
+
+			snprintf(buf, sizeof(buf), "device.%i.%s", current_device_number, ptr);
+		}
+		else
+		{
+			/* Device 1 ("device.0", whole daisychain) needs no
+			 * special processing */
+			cur_nut_index = cur_template_number + base_nut_template_offset();
+			snprintf(buf, sizeof(buf), su_info_p->info_type, cur_nut_index);
+		}
+	}
+	else /* Outlet and outlet groups templates */
+	{
+		/* Get the index of the current template instance */
+		cur_nut_index = cur_template_number + base_nut_template_offset();
+
+		/* Special processing for daisychain */
+		if (daisychain_enabled == TRUE) {
+			/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
+			if ((devices_count > 1) && (current_device_number > 0)) {
+				memset(&tmp_buf[0], 0, SU_INFOSIZE);
+				strcat(&tmp_buf[0], "device.%i.");
+				strcat(&tmp_buf[0], su_info_p->info_type);
+
+				upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
+				snprintf(buf, sizeof(buf), &tmp_buf[0], current_device_number, cur_nut_index);
+			}
+			else {
+				// FIXME: daisychain-whole, what to do?
+				snprintf(buf, sizeof(buf), su_info_p->info_type, cur_nut_index);
+			}
+		}
+		else {
+			snprintf(buf, sizeof(buf), su_info_p->info_type, cur_nut_index);
+		}
+	}
+	cur_info_p->info_type = xstrdup(buf);
+
+	/* check if default value is also a template */
+	if ((su_info_p->dfl != NULL) &&
+		(strstr(su_info_p->dfl, "%i") != NULL)) {
+		snprintf(buf, sizeof(buf), su_info_p->dfl, cur_nut_index);
+		cur_info_p->dfl = xstrdup(buf);
+	}
+
+	if (su_info_p->OID != NULL) {
+		buf[0] = '\0';
+
+		/* Special processing for daisychain */
+		if (!strncmp(type, "device", 6)) {
+			if (current_device_number > 0) {
+				snprintf(buf, sizeof(buf), su_info_p->OID, current_device_number - 1);
+			}
+			//else
+			// FIXME: daisychain-whole, what to do?
+		}
+		else {
+			/* Special processing for daisychain:
+			 * these outlet | outlet groups also include formatting info,
+			 * so we have to check if the daisychain is enabled, and if
+			 * the formatting info for it are in 1rst or 2nd position */
+			if (daisychain_enabled == TRUE) {
+				if (su_info_p->flags & SU_TYPE_DAISY_1) {
+					snprintf(buf, sizeof(buf),
+						su_info_p->OID, current_device_number - 1, cur_template_number);
+				}
+				else {
+					snprintf(buf, sizeof(buf),
+						su_info_p->OID, cur_template_number - 1, current_device_number - 1);
+				}
+			}
+			else {
+				snprintf(buf, sizeof(buf), su_info_p->OID, cur_template_number);
+			}
+		}
+		cur_info_p->OID = xstrdup(buf);
+
+		/* compile it now, rather than on the first request */
+		if ((buf[0] != '\0') && (SU_TYPE(su_info_p) != SU_TYPE_CMD))
+			su_oid_compile(buf, &name, &name_len);
+	}
+}
+
 /* Process template definition, instantiate and get data or register
  * command
  * type: outlet, outlet.group, device */
@@ -1666,12 +3767,12 @@ bool_t process_template(int mode, const char* type, snmp_info_t *su_info_p)
 	 * negative with server side data */
 	bool_t status = TRUE;
 	int cur_template_number = 1;
-	int cur_nut_index = 0;
 	int template_count = 0;
 	int base_snmp_index = 0;
-	snmp_info_t cur_info_p;
+	su_instances_t *instances;
+	snmp_info_t *cur_info_p;
 	char template_count_var[SU_BUFSIZE];
-	char tmp_buf[SU_INFOSIZE];
+	int i;
 
 	upsdebugx(1, "%s template definition found (%s)...", type, su_info_p->info_type);
 
@@ -1686,8 +3787,10 @@ bool_t process_template(int mode, const char* type, snmp_info_t *su_info_p)
 		 * or rely on guestimation? */
 		template_count = guestimate_template_count(su_info_p->OID);
 		/* Publish the count estimation */
-		if (template_count > 0)
+		if (template_count > 0) {
 			dstate_setinfo(template_count_var, "%i", template_count);
+			su_caps_add_count(template_count_var, template_count);
+		}
 	}
 	else {
 		template_count = atoi(dstate_getinfo(template_count_var));
@@ -1695,129 +3798,41 @@ bool_t process_template(int mode, const char* type, snmp_info_t *su_info_p)
 
 	/* Only instantiate templates if needed! */
 	if (template_count > 0) {
-		/* general init of data using the template */
-		instantiate_info(su_info_p, &cur_info_p);
-
 		base_snmp_index = base_snmp_template_index(su_info_p);
 
-		for (cur_template_number = base_snmp_index ;
-				cur_template_number < (template_count + base_snmp_index) ;
-				cur_template_number++)
-		{
-			/* Special processing for daisychain:
-			 * append 'device.x' to the NUT variable name, except for the
-			 * whole daisychain ("device.0") */
-			if (!strncmp(type, "device", 6))
-			{
-				/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
-				if (current_device_number > 0) {
-					char *ptr = NULL;
-					/* Another special processing for daisychain
-					 * device collection needs special appending */
-					if (!strncmp(su_info_p->info_type, "device.", 7))
-						ptr = (char*)&su_info_p->info_type[7];
-					else
-						ptr = (char*)su_info_p->info_type;
-
-					snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-							"device.%i.%s", current_device_number, ptr);
-				}
-				else
-				{
-					/* Device 1 ("device.0", whole daisychain) needs no
-					 * special processing */
-					cur_nut_index = cur_template_number + base_nut_template_offset();
-					snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-							su_info_p->info_type, cur_nut_index);
-				}
-			}
-			else /* Outlet and outlet groups templates */
-			{
-				/* Get the index of the current template instance */
-				cur_nut_index = cur_template_number + base_nut_template_offset();
-
-				/* Special processing for daisychain */
-				if (daisychain_enabled == TRUE) {
-					/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
-					if ((devices_count > 1) && (current_device_number > 0)) {
-						memset(&tmp_buf[0], 0, SU_INFOSIZE);
-						strcat(&tmp_buf[0], "device.%i.");
-						strcat(&tmp_buf[0], su_info_p->info_type);
-
-						upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
-							snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-								&tmp_buf[0], current_device_number, cur_nut_index);
-					}
-					else {
-						// FIXME: daisychain-whole, what to do?
-						snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-							su_info_p->info_type, cur_nut_index);
-					}
-				}
-				else {
-					snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-						su_info_p->info_type, cur_nut_index);
-				}
-			}
+		/* instances expanded by a previous walk, if any */
+		instances = su_instances_get(su_info_p, type, base_snmp_index, template_count);
 
-			/* check if default value is also a template */
-			if ((cur_info_p.dfl != NULL) &&
-				(strstr(su_info_p->dfl, "%i") != NULL)) {
-				cur_info_p.dfl = (char *)xmalloc(SU_INFOSIZE);
-				snprintf((char *)cur_info_p.dfl, SU_INFOSIZE, su_info_p->dfl, cur_nut_index);
-			}
+		for (i = 0; i < template_count; i++)
+		{
+			cur_template_number = base_snmp_index + i;
+			cur_info_p = &instances->instance[i];
 
-			if (cur_info_p.OID != NULL) {
-				/* Special processing for daisychain */
-				if (!strncmp(type, "device", 6)) {
-					if (current_device_number > 0) {
-						snprintf((char *)cur_info_p.OID, SU_INFOSIZE, su_info_p->OID, current_device_number - 1);
-					}
-					//else
-					// FIXME: daisychain-whole, what to do?
-				}
-				else {
-					/* Special processing for daisychain:
-					 * these outlet | outlet groups also include formatting info,
-					 * so we have to check if the daisychain is enabled, and if
-					 * the formatting info for it are in 1rst or 2nd position */
-					if (daisychain_enabled == TRUE) {
-						if (su_info_p->flags & SU_TYPE_DAISY_1) {
-							snprintf((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, current_device_number - 1, cur_template_number);
-						}
-						else {
-							snprintf((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, cur_template_number - 1, current_device_number - 1);
-						}
-					}
-					else {
-						snprintf((char *)cur_info_p.OID, SU_INFOSIZE, su_info_p->OID, cur_template_number);
-					}
-				}
+			if (cur_info_p->info_type == NULL)
+				expand_template(type, su_info_p, cur_info_p, cur_template_number);
+			else
+				su_instance_refresh(cur_info_p, su_info_p);
 
+			if (cur_info_p->OID != NULL) {
 				/* add instant commands to the info database. */
 				if (SU_TYPE(su_info_p) == SU_TYPE_CMD) {
-					upsdebugx(1, "Adding template command %s", cur_info_p.info_type);
+					upsdebugx(1, "Adding template command %s", cur_info_p->info_type);
 					/* FIXME: only add if "su_ups_get(cur_info_p) == TRUE" */
 					if (mode == SU_WALKMODE_INIT)
-						dstate_addcmd(cur_info_p.info_type);
+						dstate_addcmd(cur_info_p->info_type);
+				}
+				else { /* get and process this data */
+					status = get_and_process_data(mode, cur_info_p);
+					if ((mode == SU_WALKMODE_INIT) && (status == TRUE))
+						su_caps_set_found(su_info_p);
 				}
-				else /* get and process this data */
-					status = get_and_process_data(mode, &cur_info_p);
 			} else {
 				/* server side (ABSENT) data */
-				su_setinfo(&cur_info_p, NULL);
+				su_setinfo(cur_info_p, NULL);
 			}
 			/* set back the flag */
-			su_info_p->flags = cur_info_p.flags;
+			su_info_p->flags = cur_info_p->flags;
 		}
-		free((char*)cur_info_p.info_type);
-		if (cur_info_p.OID != NULL)
-			free((char*)cur_info_p.OID);
-		if ((cur_info_p.dfl != NULL) &&
-			(strstr(su_info_p->dfl, "%i") != NULL))
-			free((char*)cur_info_p.dfl);
 	}
 	else {
 		upsdebugx(1, "No %s present, discarding template definition...", type);
@@ -1883,11 +3898,24 @@ bool_t get_and_process_data(int mode, snmp_info_t *su_info_p)
 
 	upsdebugx(1, "%s: %s (%s)", __func__, su_info_p->info_type, su_info_p->OID);
 
+	/* only refreshing the status: skip the others, unless a trap told
+	 * their new value */
+	if ((mode == SU_WALKMODE_STATUS) && (su_is_status_info(su_info_p) == FALSE)
+		&& (su_batch_known(su_info_p->OID) == FALSE))
+		return TRUE;
+
 	/* ok, update this element. */
+	su_batch.status_info = su_is_status_info(su_info_p);
+	su_batch.always_info = (su_batch.status_info == TRUE)
+		|| (su_may_rest(su_info_p) == FALSE);
 	status = su_ups_get(su_info_p);
+	su_batch.status_info = FALSE;
+	su_batch.always_info = FALSE;
 
 	/* set stale flag if data is stale, clear if not. */
 	if (status == TRUE) {
+		if (mode == SU_WALKMODE_INIT)
+			su_caps_set_found(su_info_p);
 		if (su_info_p->flags & SU_FLAG_STALE) {
 			upslogx(LOG_INFO, "[%s] %s: data resumed for %s",
 				upsname?upsname:device_name, __func__, su_info_p->info_type);
@@ -2214,11 +4242,15 @@ bool_t snmp_ups_walk(int mode)
 				continue;
 			}
 			/* skip elements we shouldn't show in update mode */
-			if ((mode == SU_WALKMODE_UPDATE) && !(su_info_p->flags & SU_FLAG_OK))
+			if ((mode != SU_WALKMODE_INIT) && !(su_info_p->flags & SU_FLAG_OK))
+				continue;
+
+			/* and those the device is known not to support */
+			if ((mode == SU_WALKMODE_INIT) && (su_caps_skipped(su_info_p) == TRUE))
 				continue;
 
 			/* skip static elements in update mode */
-			if ((mode == SU_WALKMODE_UPDATE) && (su_info_p->flags & SU_FLAG_STATIC))
+			if ((mode != SU_WALKMODE_INIT) && (su_info_p->flags & SU_FLAG_STATIC))
 				continue;
 
 			/* Set default value if we cannot fetch it */
@@ -2280,14 +4312,14 @@ bool_t snmp_ups_walk(int mode)
 			/* process template (outlet, outlet group, inc. daisychain) definition */
 			if (su_info_p->flags & SU_OUTLET) {
 				/* Skip commands after init */
-				if ((SU_TYPE(su_info_p) == SU_TYPE_CMD) && (mode == SU_WALKMODE_UPDATE))
+				if ((SU_TYPE(su_info_p) == SU_TYPE_CMD) && (mode != SU_WALKMODE_INIT))
 					continue;
 				else
 					status = process_template(mode, "outlet", su_info_p);
 			}
 			else if (su_info_p->flags & SU_OUTLET_GROUP) {
 				/* Skip commands after init */
-				if ((SU_TYPE(su_info_p) == SU_TYPE_CMD) && (mode == SU_WALKMODE_UPDATE))
+				if ((SU_TYPE(su_info_p) == SU_TYPE_CMD) && (mode != SU_WALKMODE_INIT))
 					continue;
 				else
 					status = process_template(mode, "outlet.group", su_info_p);
@@ -2327,6 +4359,7 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 	alarms_info_t * alarms;
 	int index = 0;
 	char *format_char = NULL;
+	su_instances_t *instances;
 	snmp_info_t *tmp_info_p = NULL;
 	int daisychain_offset = 0;
 
@@ -2342,32 +4375,22 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 
 	/* Check if this is a daisychain template */
 	if ((format_char = strchr(su_info_p->OID, '%')) != NULL) {
-		tmp_info_p = instantiate_info(su_info_p, tmp_info_p);
-		if (tmp_info_p != NULL) {
-			/* adapt the OID */
-			if (su_info_p->OID != NULL) {
-				snprintf((char *)tmp_info_p->OID, SU_INFOSIZE, su_info_p->OID,
-					current_device_number + daisychain_offset);
-			}
-			else {
-				free_info(tmp_info_p);
-				return FALSE;
-			}
+		/* instance expanded by a previous walk, if any */
+		instances = su_instances_get(su_info_p, NULL, current_device_number + daisychain_offset, 1);
+		tmp_info_p = &instances->instance[0];
 
-			/* adapt info_type */
-			if (su_info_p->info_type != NULL) {
-				snprintf((char *)tmp_info_p->info_type, SU_INFOSIZE, "%s", su_info_p->info_type);
-			}
-			else {
-				free_info(tmp_info_p);
-				return FALSE;
-			}
-			su_info_p = tmp_info_p;
-		}
-		else {
-			upsdebugx(2, "%s: can't instantiate template", __func__);
-			return FALSE;
+		if (tmp_info_p->info_type == NULL) {
+			*tmp_info_p = *su_info_p;
+			/* adapt the OID */
+			snprintf(buf, sizeof(buf), su_info_p->OID,
+				current_device_number + daisychain_offset);
+			tmp_info_p->OID = xstrdup(buf);
+			tmp_info_p->info_type = xstrdup(su_info_p->info_type);
 		}
+		else
+			su_instance_refresh(tmp_info_p, su_info_p);
+
+		su_info_p = tmp_info_p;
 	}
 
 	if (!strcasecmp(su_info_p->info_type, "ups.status")) {
@@ -2382,7 +4405,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		else
 			upsdebugx(2, "=> Failed");
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -2400,7 +4422,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		}
 		else upsdebugx(2, "=> Failed");
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -2452,7 +4473,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 			upsdebugx(2, "=> Failed");
 		}
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -2462,10 +4482,8 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 
 		status = nut_snmp_get_int(su_info_p->OID, &value);
 
-		if(status != TRUE) {
-			free_info(tmp_info_p);
+		if(status != TRUE)
 			return status;
-		}
 
 		/* only do this if using the IEM sensor */
 		if (!strcmp(su_info_p->OID, APCC_OID_IEM_TEMP)) {
@@ -2487,7 +4505,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		snprintf(buf, sizeof(buf), "%.1f", temp);
 		su_setinfo(su_info_p, buf);
 
-		free_info(tmp_info_p);
 		return TRUE;
 	}
 
@@ -2502,7 +4519,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 					disable_competition(su_info_p);
 					su_info_p->flags &= ~SU_FLAG_UNIQUE;
 				}
-				free_info(tmp_info_p);
 				return FALSE;
 			}
 			if (su_info_p->flags & SU_FLAG_SETINT) {
@@ -2532,7 +4548,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 	else
 		upsdebugx(2, "=> Failed");
 
-	free_info(tmp_info_p);
 	return status;
 }
 
@@ -2791,7 +4806,7 @@ int su_addcmd(snmp_info_t *su_info_p)
 		}
 	}
 	else {
-		if (nut_snmp_get(su_info_p->OID) != NULL) {
+		if (su_caps_cmd_supported(su_info_p) == TRUE) {
 			dstate_addcmd(su_info_p->info_type);
 			upsdebugx(1, "%s: adding command '%s'", __func__, su_info_p->info_type);
 		}
@@ -30,10 +30,8 @@
 - add syscontact/location (to all mib.h or centralized?)
 - complete shutdown
 - add enum values to OIDs.
-- optimize network flow by:
-  1) caching OID values (as in usbhid-ups) with timestamping and lifetime
-  2) constructing one big packet (calling snmp_add_null_var
-     for each OID request we made), instead of sending many small packets
+- optimize network flow by caching OID values (as in usbhid-ups) with
+  timestamping and lifetime
 - add support for registration and traps (manager mode)
   => Issue: 1 trap listener for N snmp-ups drivers!
 - complete mib2nut data (add all OID translation to NUT)
@@ -85,6 +83,10 @@
 #define DEFAULT_POLLFREQ          30   /* in seconds */
 #define DEFAULT_NETSNMP_RETRIES   5
 #define DEFAULT_NETSNMP_TIMEOUT   1    /* in seconds */
+#define DEFAULT_MAXVARBINDS       16   /* variables per GET request */
+#define DEFAULT_MAXREPETITIONS    10   /* rows per GETBULK request */
+#define DEFAULT_MAXREQUESTS       8    /* batched requests in flight at once */
+#define DEFAULT_MAXBACKOFF        8    /* updates between two reads of a stable variable */
 
 /* use explicit booleans */
 #ifndef FALSE
@@ -197,6 +199,12 @@ typedef struct {
 #define SU_VAR_TIMEOUT		"snmp_timeout"
 #define SU_VAR_MIBS			"mibs"
 #define SU_VAR_POLLFREQ		"pollfreq"
+#define SU_VAR_MAXVARBINDS	"snmp_max_varbinds"
+#define SU_VAR_MAXREPETITIONS	"snmp_max_repetitions"
+#define SU_VAR_MAXREQUESTS	"snmp_max_requests"
+#define SU_VAR_MAXBACKOFF	"snmp_max_backoff"
+#define SU_VAR_TRAPLISTEN	"snmp_trap_listen"
+#define SU_VAR_NOCACHE		"nocache"
 /* SNMP v3 related parameters */
 #define SU_VAR_SECLEVEL		"secLevel"
 #define SU_VAR_SECNAME		"secName"
@@ -215,6 +223,7 @@ typedef struct {
 /* modes to snmp_ups_walk. */
 #define SU_WALKMODE_INIT	0
 #define SU_WALKMODE_UPDATE	1
+#define SU_WALKMODE_STATUS	2	/* only ups.status and alarms */
 
 /* modes for su_setOID */
 #define SU_MODE_INSTCMD     1
@@ -245,9 +254,13 @@ typedef struct {
 void nut_snmp_init(const char *type, const char *hostname);
 void nut_snmp_cleanup(void);
 struct snmp_pdu *nut_snmp_get(const char *OID);
+void nut_snmp_batch_begin(int mode);
+void nut_snmp_batch_end(void);
+int nut_snmp_trap_read(struct timeval *received);
 bool_t nut_snmp_get_str(const char *OID, char *buf, size_t buf_len,
 	info_lkp_t *oid2info);
 bool_t nut_snmp_get_int(const char *OID, long *pval);
+bool_t nut_snmp_get_oid(const char *OID, char *buf, size_t buf_len);
 bool_t nut_snmp_set(const char *OID, char type, const char *value);
 bool_t nut_snmp_set_str(const char *OID, const char *value);
 bool_t nut_snmp_set_int(const char *OID, long value);
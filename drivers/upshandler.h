@@ -41,6 +41,10 @@ struct ups_handler
 {
 	int	(*setvar)(const char *, const char *);
 	int	(*instcmd)(const char *, const char *);
+
+	/* optional: service the device while the driver core waits for
+	 * the next update; see main_wait() in main.c */
+	int	(*idle)(int);
 };
 
 #endif /* NUT_UPSHANDLER_H */
@@ -29,7 +29,9 @@
  */
 
 #define DRIVER_NAME	"Generic HID driver"
-#define DRIVER_VERSION		"0.43"
+#define DRIVER_VERSION		"0.44"
+
+#include <ctype.h>
 
 #include "main.h"
 #include "libhid.h"
@@ -125,6 +127,13 @@ hid_dev_handle_t udev;
 /* support functions */
 static hid_info_t *find_nut_info(const char *varname);
 static hid_info_t *find_hid_info(const HIDData_t *hiddata);
+static void hu_build_index(void);
+static void hu_free_index(void);
+static void hu_cache_load(HIDDevice_t *hd, const unsigned char *rdbuf, int rdlen);
+static void hu_cache_save(void);
+static void hu_cache_check(void);
+static HIDData_t *hu_cache_item(hid_info_t *item);
+static void hu_cache_free(void);
 static const char *hu_find_infoval(info_lkp_t *hid2info, const double value);
 static long hu_find_valinfo(info_lkp_t *hid2info, const char* value);
 static void process_boolean_info(const char *nutvalue);
@@ -142,6 +151,22 @@ static double interval(void);
 HIDDesc_t	*pDesc = NULL;		/* parsed Report Descriptor */
 reportbuf_t	*reportbuf = NULL;	/* buffer for most recent reports */
 
+/* cached device capabilities, see hu_cache_load() */
+#define HU_CACHE_VERSION	1
+
+typedef struct {
+	int		valid;		/* loaded, and matches the device */
+	int		*map;		/* hid2nut entry -> descriptor item, or -1 */
+	int		nmap;		/* number of hid2nut entries */
+	unsigned char	failed[256];	/* reports that couldn't be retrieved */
+	int		nfailed;	/* number of such reports */
+	unsigned long	deschash;	/* hash of the report descriptor */
+	int		desclen;	/* length of the report descriptor */
+	char		*fn;		/* cache file name, or NULL if disabled */
+} hu_cache_t;
+
+static hu_cache_t	hu_cache = { 0, NULL, 0, { 0 }, 0, 0, 0, NULL };
+
 /* ---------------------------------------------------------------------- */
 /* data for processing boolean values from UPS */
 
@@ -833,6 +858,7 @@ void upsdrv_makevartable(void)
 	addvar(VAR_VALUE, HU_VAR_POLLFREQ, temp);
 
 	addvar(VAR_FLAG, "pollonly", "Don't use interrupt pipe, only use polling");
+	addvar(VAR_FLAG, "nocache", "Don't use the cached device capabilities");
 
 #ifndef SHUT_MODE
 	/* allow -x vendor=X, vendorid=X, product=X, productid=X, serial=X */
@@ -853,17 +879,124 @@ void upsdrv_makevartable(void)
 
 #define	MAX_EVENT_NUM	32
 
-void upsdrv_updateinfo(void)
+/* Process notifications (HID events on Interrupt pipe), waiting at most
+ * <timeout> msec for them. Return the number of events, or -1 if the
+ * device must be reconnected */
+static int ups_process_events(int timeout)
 {
 	hid_info_t	*item;
 	HIDData_t	*event[MAX_EVENT_NUM], *found_data;
 	int		i, evtCount;
 	double		value;
+
+	evtCount = HIDGetEvents(udev, event, MAX_EVENT_NUM, timeout);
+	switch (evtCount)
+	{
+	case -EBUSY:		/* Device or resource busy */
+		upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
+	case -EPERM:		/* Operation not permitted */
+	case -ENODEV:		/* No such device */
+	case -EACCES:		/* Permission denied */
+	case -EIO:		/* I/O error */
+	case -ENXIO:		/* No such device or address */
+	case -ENOENT:		/* No such file or directory */
+		/* Uh oh, got to reconnect! */
+		hd = NULL;
+		return -1;
+	default:
+		upsdebugx(1, "Got %i HID objects...", (evtCount >= 0) ? evtCount : 0);
+		break;
+	}
+
+	for (i = 0; i < evtCount; i++) {
+
+		if (HIDGetDataValue(udev, event[i], &value, poll_interval) != 1)
+			continue;
+
+		if (nut_debug_level >= 2) {
+			upsdebugx(2, "Path: %s, Type: %s, ReportID: 0x%02x, Offset: %i, Size: %i, Value: %g",
+				HIDGetDataItem(event[i], subdriver->utab),
+				HIDDataType(event[i]), event[i]->ReportID,
+				event[i]->Offset, event[i]->Size, value);
+		}
+
+		/* Skip Input reports, if we don't use the Feature report */
+		found_data = FindObject_with_Path(pDesc, &(event[i]->Path), interrupt_only ? ITEM_INPUT:ITEM_FEATURE);
+                if(!found_data && !interrupt_only) {
+			found_data = FindObject_with_Path(pDesc, &(event[i]->Path), ITEM_INPUT);
+		}
+		if(!found_data) {
+			upsdebugx(2, "Could not find event as either ITEM_INPUT or ITEM_FEATURE?");
+			continue;
+		}
+		item = find_hid_info(found_data);
+		if (!item) {
+			upsdebugx(3, "NUT doesn't use this HID object");
+			continue;
+		}
+
+		ups_infoval_set(item, value);
+	}
+
+	return (evtCount > 0) ? evtCount : 0;
+}
+
+#ifndef SHUT_MODE
+/* Idle handler: keep an interrupt transfer pending while the driver core
+ * waits for the next update, so that notifications are published as soon
+ * as the UPS sends them instead of on the next pollinterval */
+static int ups_idle(int timeout)
+{
+	struct timeval	start, now;
+
+	if ((hd == NULL) || (use_interrupt_pipe == FALSE)) {
+		return -1;
+	}
+
+	/* don't delay the driver socket for too long */
+	if (timeout > USB_IDLE_TIMEOUT) {
+		timeout = USB_IDLE_TIMEOUT;
+	}
+
+	gettimeofday(&start, NULL);
+
+	switch (ups_process_events(timeout))
+	{
+	case -1:
+		return 1;	/* reconnect in upsdrv_updateinfo() */
+	case 0:
+		gettimeofday(&now, NULL);
+		/* the read failed without waiting, don't spin on it */
+		if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000 < timeout / 2) {
+			return -1;
+		}
+		return 0;
+	default:
+		break;
+	}
+
+	status_init();
+	ups_status_set();
+	status_commit();
+
+	dstate_dataok();
+
+	return 0;
+}
+#endif
+
+void upsdrv_updateinfo(void)
+{
 	time_t		now;
+	struct timeval	start, end;
 
 	upsdebugx(1, "upsdrv_updateinfo...");
 
-	time(&now);
+	gettimeofday(&start, NULL);
+	now = start.tv_sec;
+
+	/* reports retrieved from now on are fresh for this update */
+	HIDNewCycle();
 
 	/* check for device availability to set datastale! */
 	if (hd == NULL) {
@@ -892,59 +1025,12 @@ void upsdrv_updateinfo(void)
 #endif
 	/* Get HID notifications on Interrupt pipe first */
 	if (use_interrupt_pipe == TRUE) {
-		evtCount = HIDGetEvents(udev, event, MAX_EVENT_NUM);
-		switch (evtCount)
-		{
-		case -EBUSY:		/* Device or resource busy */
-			upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
-		case -EPERM:		/* Operation not permitted */
-		case -ENODEV:		/* No such device */
-		case -EACCES:		/* Permission denied */
-		case -EIO:		/* I/O error */
-		case -ENXIO:		/* No such device or address */
-		case -ENOENT:		/* No such file or directory */
-			/* Uh oh, got to reconnect! */
-			hd = NULL;
+		if (ups_process_events(USB_EVENT_TIMEOUT) < 0) {
 			return;
-		default:
-			upsdebugx(1, "Got %i HID objects...", (evtCount >= 0) ? evtCount : 0);
-			break;
 		}
 	} else {
-		evtCount = 0;
 		upsdebugx(1, "Not using interrupt pipe...");
 	}
-
-	/* Process pending events (HID notifications on Interrupt pipe) */
-	for (i = 0; i < evtCount; i++) {
-
-		if (HIDGetDataValue(udev, event[i], &value, poll_interval) != 1)
-			continue;
-
-		if (nut_debug_level >= 2) {
-			upsdebugx(2, "Path: %s, Type: %s, ReportID: 0x%02x, Offset: %i, Size: %i, Value: %g",
-				HIDGetDataItem(event[i], subdriver->utab),
-				HIDDataType(event[i]), event[i]->ReportID,
-				event[i]->Offset, event[i]->Size, value);
-		}
-
-		/* Skip Input reports, if we don't use the Feature report */
-		found_data = FindObject_with_Path(pDesc, &(event[i]->Path), interrupt_only ? ITEM_INPUT:ITEM_FEATURE);
-                if(!found_data && !interrupt_only) {
-			found_data = FindObject_with_Path(pDesc, &(event[i]->Path), ITEM_INPUT);
-		}
-		if(!found_data) {
-			upsdebugx(2, "Could not find event as either ITEM_INPUT or ITEM_FEATURE?");
-			continue;
-		}
-		item = find_hid_info(found_data);
-		if (!item) {
-			upsdebugx(3, "NUT doesn't use this HID object");
-			continue;
-		}
-
-		ups_infoval_set(item, value);
-	}
 #ifdef DEBUG
 	upsdebugx(1, "took %.3f seconds handling interrupt reports...\n", interval());
 #endif
@@ -977,8 +1063,20 @@ void upsdrv_updateinfo(void)
 	status_commit();
 
 	dstate_dataok();
+
+	hu_cache_check();
 #ifdef DEBUG
 	upsdebugx(1, "took %.3f seconds handling feature reports...\n", interval());
+#endif
+	gettimeofday(&end, NULL);
+#ifndef APC_MODBUS_HID
+	upsdebugx(1, "Update took %.3f seconds, %u report(s) retrieved",
+		end.tv_sec - start.tv_sec + ((double)(end.tv_usec - start.tv_usec)) / 1000000,
+		reportbuf->xfers);
+#else
+	upsdebugx(1, "Update took %.3f seconds, %u report(s) retrieved, %u MODBUS transaction(s)",
+		end.tv_sec - start.tv_sec + ((double)(end.tv_usec - start.tv_usec)) / 1000000,
+		reportbuf->xfers, MBGetTransactions());
 #endif
 }
 
@@ -1008,12 +1106,16 @@ void upsdrv_initinfo(void)
 	/* install handlers */
 	upsh.setvar = setvar;
 	upsh.instcmd = instcmd;
+#ifndef SHUT_MODE
+	upsh.idle = ups_idle;
+#endif
 }
 
 void upsdrv_initups(void)
 {
 	int ret;
 	char *val;
+	struct timeval	start, end;
 #ifdef SHUT_MODE
 	/*!
 	 * SHUT is a serial protocol, so it needs
@@ -1085,10 +1187,17 @@ void upsdrv_initups(void)
 		interrupt_size = atoi(val);
 	}
 
+	gettimeofday(&start, NULL);
+
 	if (hid_ups_walk(HU_WALKMODE_INIT) == FALSE) {
 		fatalx(EXIT_FAILURE, "Can't initialize data from HID UPS");
 	}
 
+	gettimeofday(&end, NULL);
+
+	upsdebugx(1, "Initial walk took %.3f seconds",
+		end.tv_sec - start.tv_sec + ((double)(end.tv_usec - start.tv_usec)) / 1000000);
+
 	if (dstate_getinfo("battery.charge.low")) {
 		/* Retrieve user defined battery settings */
 		val = getval(HU_VAR_LOWBATT);
@@ -1135,6 +1244,11 @@ void upsdrv_cleanup(void)
 	upsdebugx(1, "upsdrv_cleanup...");
 
 	comm_driver->close(udev);
+	hu_free_index();
+	hu_cache_free();
+#ifdef APC_MODBUS_HID
+	ModbusCacheFree();
+#endif
 	Free_ReportDesc(pDesc);
 	free_report_buffer(reportbuf);
 #ifndef SHUT_MODE
@@ -1241,6 +1355,8 @@ static int callback(hid_dev_handle_t udev, HIDDevice_t *hd, unsigned char *rdbuf
 
 	upslogx(2, "Using subdriver: %s", subdriver->name);
 
+	hu_cache_load(hd, rdbuf, rdlen);
+
 	HIDDumpTree(udev, subdriver->utab);
 #ifdef APC_MODBUS_HID
 	if (!CheckModbusEnable(udev, hd)) {
@@ -1305,6 +1421,34 @@ static double interval(void)
 }
 #endif
 
+/* return TRUE if the item must be polled in the given update mode */
+static bool_t hu_update_item(hid_info_t *item, walkmode_t mode)
+{
+	switch (mode)
+	{
+	case HU_WALKMODE_QUICK_UPDATE:
+		/* Quick update only deals with status and alarms! */
+		if (!(item->hidflags & HU_FLAG_QUICK_POLL))
+			return FALSE;
+
+		return TRUE;
+
+	case HU_WALKMODE_FULL_UPDATE:
+		/* These don't need polling after initinfo() */
+		if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD | HU_FLAG_STATIC))
+			return FALSE;
+
+		/* These need to be polled after user changes (setvar / instcmd) */
+		if ((item->hidflags & HU_FLAG_SEMI_STATIC) && (data_has_changed == FALSE))
+			return FALSE;
+
+		return TRUE;
+
+	default:
+		fatalx(EXIT_FAILURE, "hid_ups_walk: unknown update mode!");
+	}
+}
+
 /* walk ups variables and set elements of the info array. */
 static bool_t hid_ups_walk(walkmode_t mode)
 {
@@ -1320,6 +1464,36 @@ static bool_t hid_ups_walk(walkmode_t mode)
 
 	/* 3 modes: HU_WALKMODE_INIT, HU_WALKMODE_QUICK_UPDATE and HU_WALKMODE_FULL_UPDATE */
 
+	/* Retrieve all the needed reports first, each one only once, so that
+	 * the items below are decoded from the same set of reports */
+	if (mode != HU_WALKMODE_INIT) {
+		unsigned char	fetched[256];
+
+		memset(fetched, 0, sizeof(fetched));
+
+		for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+
+			if ((item->hiddata == NULL) || (hu_update_item(item, mode) == FALSE))
+				continue;
+#ifdef APC_MODBUS_HID
+			if (item->hidflags & HU_FLAG_MODBUS)
+				continue;
+#endif
+#ifndef SHUT_MODE
+			/* skip report 0x54 for Tripplite SU3000LCD2UHV due to firmware bug */
+			if ((vendorID == 0x09ae) && (productID == 0x1330) && (item->hiddata->ReportID == 0x54))
+				continue;
+#endif
+			if (fetched[item->hiddata->ReportID])
+				continue;
+
+			fetched[item->hiddata->ReportID] = 1;
+
+			/* errors are reported when decoding the items */
+			HIDRefreshReport(udev, item->hiddata);
+		}
+	}
+
 	/* Device data walk ----------------------------- */
 	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
 
@@ -1348,7 +1522,11 @@ static bool_t hid_ups_walk(walkmode_t mode)
 
 			/* Create the NUT-to-HID mapping */
 
-			item->hiddata = HIDGetItemData(item->hidpath, subdriver->utab);
+			if (hu_cache.valid) {
+				item->hiddata = hu_cache_item(item);
+			} else {
+				item->hiddata = HIDGetItemData(item->hidpath, subdriver->utab);
+			}
 			if (item->hiddata == NULL)
 				continue;
 			/* Special case for handling server side variables */
@@ -1382,26 +1560,12 @@ static bool_t hid_ups_walk(walkmode_t mode)
 			item->hiddata = NULL;
 			continue;
 
-		case HU_WALKMODE_QUICK_UPDATE:
-			/* Quick update only deals with status and alarms! */
-			if (!(item->hidflags & HU_FLAG_QUICK_POLL))
-				continue;
-
-			break;
-
-		case HU_WALKMODE_FULL_UPDATE:
-			/* These don't need polling after initinfo() */
-			if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD | HU_FLAG_STATIC))
-				continue;
-
-			/* These need to be polled after user changes (setvar / instcmd) */
-			if ((item->hidflags & HU_FLAG_SEMI_STATIC) && (data_has_changed == FALSE))
+			/* Quick and full updates */
+		default:
+			if (hu_update_item(item, mode) == FALSE)
 				continue;
 
 			break;
-
-		default:
-			fatalx(EXIT_FAILURE, "hid_ups_walk: unknown update mode!");
 		}
 
 #ifndef SHUT_MODE
@@ -1413,6 +1577,23 @@ static bool_t hid_ups_walk(walkmode_t mode)
 		}
 #endif
 
+		/* don't wait again for the reports that couldn't be retrieved
+		 * last time, these will be tried on the next update */
+		if ((mode == HU_WALKMODE_INIT) && hu_cache.valid && item->hiddata
+			&& hu_cache.failed[item->hiddata->ReportID]) {
+			continue;
+		}
+
+		/* only the updates keep a failure for the rest of the cycle: at
+		 * startup, a transient one would cost the enumerations, flags
+		 * and commands of all the items of the report for the whole
+		 * run, so it is tried again for each of them */
+		if ((mode == HU_WALKMODE_INIT) && item->hiddata
+			&& (reportbuf->gen[item->hiddata->ReportID] == reportbuf->cycle)
+			&& reportbuf->err[item->hiddata->ReportID]) {
+			reportbuf->gen[item->hiddata->ReportID] = 0;
+		}
+
 #ifndef APC_MODBUS_HID
 		retcode = HIDGetDataValue(udev, item->hiddata, &value, poll_interval);
 #else 
@@ -1517,6 +1698,12 @@ static bool_t hid_ups_walk(walkmode_t mode)
 		}
 	}
 
+	/* the NUT-to-HID mapping is known now */
+	if (mode == HU_WALKMODE_INIT) {
+		hu_build_index();
+		hu_cache_save();
+	}
+
 	return TRUE;
 }
 
@@ -1630,12 +1817,354 @@ static void ups_status_set(void)
 	}
 }
 
+/* ---------------------------------------------------------------------- */
+/* Indexes for find_nut_info() and find_hid_info(), which are used for each
+ * interrupt event, setvar and instcmd. The hid2nut tables hold hundreds of
+ * entries, so rather than scanning them, the lookup results are computed
+ * once the NUT-to-HID mapping is known (after HU_WALKMODE_INIT) and stored
+ * in two open addressing hash tables. */
+
+typedef struct {
+	hid_info_t	**by_name;	/* keyed by info_type (case insensitive) */
+	hid_info_t	**by_data;	/* keyed by hiddata */
+	size_t		mask;		/* number of slots - 1 (power of 2) */
+} hu_index_t;
+
+static hu_index_t	hu_index = { NULL, NULL, 0 };
+
+static size_t hu_hash_name(const char *name)
+{
+	size_t	h = 5381;
+
+	while (*name) {
+		h = (h * 33) ^ (unsigned char)tolower((unsigned char)*name++);
+	}
+
+	return h;
+}
+
+static size_t hu_hash_data(const HIDData_t *hiddata)
+{
+	return ((size_t)hiddata >> 3) * 2654435761u;
+}
+
+static void hu_free_index(void)
+{
+	free(hu_index.by_name);
+	free(hu_index.by_data);
+
+	memset(&hu_index, 0, sizeof(hu_index));
+}
+
+/* return TRUE if item can be returned by find_nut_info() */
+static bool_t hu_nut_info_ok(hid_info_t *hidups_item)
+{
+#ifdef APC_MODBUS_HID
+	if (hidups_item->hidflags & HU_FLAG_MODBUS)
+		return TRUE;
+#endif
+	return (hidups_item->hiddata != NULL) ? TRUE : FALSE;
+}
+
+/* (re)build the indexes from the current NUT-to-HID mapping */
+static void hu_build_index(void)
+{
+	hid_info_t	*hidups_item;
+	size_t		count = 0, i;
+
+	hu_free_index();
+
+	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL; hidups_item++) {
+		count++;
+	}
+
+	/* keep the load factor below 50% */
+	hu_index.mask = 16;
+	while (hu_index.mask < 2 * count) {
+		hu_index.mask <<= 1;
+	}
+
+	hu_index.by_name = xcalloc(hu_index.mask, sizeof(*hu_index.by_name));
+	hu_index.by_data = xcalloc(hu_index.mask, sizeof(*hu_index.by_data));
+	hu_index.mask--;
+
+	/* in table order, so that the first usable entry wins, as before */
+	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL; hidups_item++) {
+
+		if (hu_nut_info_ok(hidups_item)) {
+			for (i = hu_hash_name(hidups_item->info_type) & hu_index.mask; hu_index.by_name[i]; i = (i + 1) & hu_index.mask) {
+				if (!strcasecmp(hu_index.by_name[i]->info_type, hidups_item->info_type))
+					break;
+			}
+
+			if (!hu_index.by_name[i])
+				hu_index.by_name[i] = hidups_item;
+		}
+
+		/* Skip server side vars */
+		if ((hidups_item->hiddata == NULL) || (hidups_item->hidflags & HU_FLAG_ABSENT))
+			continue;
+
+		for (i = hu_hash_data(hidups_item->hiddata) & hu_index.mask; hu_index.by_data[i]; i = (i + 1) & hu_index.mask) {
+			if (hu_index.by_data[i]->hiddata == hidups_item->hiddata)
+				break;
+		}
+
+		if (!hu_index.by_data[i])
+			hu_index.by_data[i] = hidups_item;
+	}
+
+	upsdebugx(2, "%s: %u entries indexed", __func__, (unsigned int)count);
+}
+
+/* ---------------------------------------------------------------------- */
+/* On-disk cache of the device capabilities. The HU_WALKMODE_INIT walk
+ * resolves several hundred HID paths and retrieves every report that is
+ * referenced, and some devices take seconds to time out on the reports
+ * they declare but don't support. What was found is saved in STATEPATH,
+ * keyed on VendorID:ProductID, and is only used again if the report
+ * descriptor (compared by length and hash), the subdriver and its hid2nut
+ * table are unchanged. With a valid cache, the mapping is taken from the
+ * cache and the reports that failed are not waited for before the first
+ * update. Disable with the "nocache" flag. */
+
+/* 32 bit FNV-1a */
+static unsigned long hu_cache_hash(unsigned long h, const void *buf, size_t len)
+{
+	const unsigned char	*p = buf;
+
+	while (len-- > 0) {
+		h = ((h ^ *p++) * 16777619UL) & 0xffffffffUL;
+	}
+
+	return h;
+}
+
+/* hash of the hid2nut table, so that a cache saved by another version of
+ * the subdriver isn't used */
+static unsigned long hu_cache_tablehash(void)
+{
+	hid_info_t	*item;
+	unsigned long	h = 2166136261UL;
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		h = hu_cache_hash(h, item->info_type, strlen(item->info_type) + 1);
+		if (item->hidpath)
+			h = hu_cache_hash(h, item->hidpath, strlen(item->hidpath) + 1);
+		h = hu_cache_hash(h, &item->hidflags, sizeof(item->hidflags));
+	}
+
+	return h;
+}
+
+static void hu_cache_free(void)
+{
+	free(hu_cache.map);
+	free(hu_cache.fn);
+
+	memset(&hu_cache, 0, sizeof(hu_cache));
+}
+
+/* descriptor item bound to this hid2nut entry, according to the cache */
+static HIDData_t *hu_cache_item(hid_info_t *item)
+{
+	int	idx = hu_cache.map[item - subdriver->hid2nut];
+
+	return (idx < 0) ? NULL : &pDesc->item[idx];
+}
+
+static void hu_cache_load(HIDDevice_t *hd, const unsigned char *rdbuf, int rdlen)
+{
+	char		buf[LARGEBUF], name[SMALLBUF];
+	unsigned long	deschash, tablehash;
+	unsigned int	vendorid, productid;
+	int		nmap = 0, desclen, version, i, idx, id;
+	hid_info_t	*item;
+	FILE		*fp;
+
+	hu_cache_free();
+
+	if (testvar("nocache")) {
+		return;
+	}
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		nmap++;
+	}
+
+	/* the same models may be connected several times to the host */
+	if (upsname) {
+		snprintf(buf, sizeof(buf), "%s/%s-%s-%04x%04x.cache", dflt_statepath(), progname, upsname, hd->VendorID, hd->ProductID);
+	} else {
+		snprintf(buf, sizeof(buf), "%s/%s-%04x%04x.cache", dflt_statepath(), progname, hd->VendorID, hd->ProductID);
+	}
+
+	hu_cache.fn = xstrdup(buf);
+	hu_cache.deschash = hu_cache_hash(2166136261UL, rdbuf, rdlen);
+	hu_cache.desclen = rdlen;
+	hu_cache.nmap = nmap;
+	hu_cache.map = xcalloc(nmap, sizeof(*hu_cache.map));
+
+	for (i = 0; i < nmap; i++) {
+		hu_cache.map[i] = -1;
+	}
+
+	fp = fopen(hu_cache.fn, "r");
+	if (!fp) {
+		upsdebug_with_errno(2, "%s: can't open %s", __func__, hu_cache.fn);
+		return;
+	}
+
+	/* the header must match the device, the descriptor and the table */
+	if (!fgets(buf, sizeof(buf), fp) || (sscanf(buf, "version %d", &version) != 1) || (version != HU_CACHE_VERSION) ||
+		!fgets(buf, sizeof(buf), fp) || (sscanf(buf, "device %x:%x", &vendorid, &productid) != 2) ||
+		(vendorid != hd->VendorID) || (productid != hd->ProductID) ||
+		!fgets(buf, sizeof(buf), fp) || (sscanf(buf, "descriptor %d %lx", &desclen, &deschash) != 2) ||
+		(desclen != hu_cache.desclen) || (deschash != hu_cache.deschash) ||
+		!fgets(buf, sizeof(buf), fp) || (sscanf(buf, "subdriver %d %lx %255[^\n]", &i, &tablehash, name) != 3) ||
+		(i != nmap) || (tablehash != hu_cache_tablehash()) || strcmp(name, subdriver->name)) {
+		upsdebugx(1, "%s: %s doesn't match this device, ignored", __func__, hu_cache.fn);
+		fclose(fp);
+		return;
+	}
+
+	while (fgets(buf, sizeof(buf), fp)) {
+
+		if (sscanf(buf, "map %d %d", &i, &idx) == 2) {
+
+			if ((i < 0) || (i >= nmap) || (idx < -1) || (idx >= pDesc->nitems))
+				break;
+
+			hu_cache.map[i] = idx;
+			continue;
+		}
+
+		if (sscanf(buf, "failed %x", &id) == 1) {
+
+			if ((id < 0) || (id > 255))
+				break;
+
+			hu_cache.failed[id] = 1;
+			hu_cache.nfailed++;
+			continue;
+		}
+
+		if (!strcmp(buf, "end\n")) {
+			hu_cache.valid = 1;
+			break;
+		}
+
+		break;
+	}
+
+	fclose(fp);
+
+	if (!hu_cache.valid) {
+		upsdebugx(1, "%s: %s is corrupted, ignored", __func__, hu_cache.fn);
+		memset(hu_cache.failed, 0, sizeof(hu_cache.failed));
+		hu_cache.nfailed = 0;
+		return;
+	}
+
+	upsdebugx(1, "Using cached device capabilities from %s", hu_cache.fn);
+}
+
+/* save the NUT-to-HID mapping and the reports that couldn't be retrieved,
+ * once the HU_WALKMODE_INIT walk is complete */
+static void hu_cache_save(void)
+{
+	char		fn[LARGEBUF];
+	hid_info_t	*item;
+	int		i;
+	FILE		*fp;
+
+	if (!hu_cache.fn || hu_cache.valid) {
+		return;
+	}
+
+	snprintf(fn, sizeof(fn), "%s.tmp", hu_cache.fn);
+
+	fp = fopen(fn, "w");
+	if (!fp) {
+		upsdebug_with_errno(1, "%s: can't create %s", __func__, fn);
+		return;
+	}
+
+	fprintf(fp, "version %d\n", HU_CACHE_VERSION);
+	fprintf(fp, "device %04x:%04x\n", hd->VendorID, hd->ProductID);
+	fprintf(fp, "descriptor %d %08lx\n", hu_cache.desclen, hu_cache.deschash);
+	fprintf(fp, "subdriver %d %08lx %s\n", hu_cache.nmap, hu_cache_tablehash(), subdriver->name);
+
+	for (item = subdriver->hid2nut, i = 0; item->info_type != NULL; item++, i++) {
+
+		if (item->hiddata == NULL)
+			continue;
+
+		fprintf(fp, "map %d %d\n", i, (int)(item->hiddata - pDesc->item));
+	}
+
+	for (i = 0; i < 256; i++) {
+
+		if ((reportbuf->gen[i] != reportbuf->cycle) || (reportbuf->err[i] == 0))
+			continue;
+
+		fprintf(fp, "failed %02x\n", i);
+	}
+
+	fprintf(fp, "end\n");
+
+	if (fclose(fp) || rename(fn, hu_cache.fn)) {
+		upsdebug_with_errno(1, "%s: can't write %s", __func__, hu_cache.fn);
+		unlink(fn);
+		return;
+	}
+
+	upsdebugx(1, "Device capabilities saved to %s", hu_cache.fn);
+}
+
+/* if a report that couldn't be retrieved when the cache was saved is now
+ * available, the capabilities found at startup are incomplete (commands,
+ * enumerations and writable flags are only set by HU_WALKMODE_INIT), so
+ * drop the cache for the next start */
+static void hu_cache_check(void)
+{
+	int	i;
+
+	if (!hu_cache.valid || !hu_cache.nfailed) {
+		return;
+	}
+
+	for (i = 0; i < 256; i++) {
+
+		if (!hu_cache.failed[i] || (reportbuf->gen[i] != reportbuf->cycle) || reportbuf->err[i])
+			continue;
+
+		upsdebugx(1, "Report 0x%02x is now available, removing %s", i, hu_cache.fn);
+		unlink(hu_cache.fn);
+
+		memset(hu_cache.failed, 0, sizeof(hu_cache.failed));
+		hu_cache.nfailed = 0;
+		return;
+	}
+}
+
 /* find info element definition in info array
  * by NUT varname.
  */
 static hid_info_t *find_nut_info(const char *varname)
 {
 	hid_info_t *hidups_item;
+	size_t	i;
+
+	if (hu_index.by_name) {
+		for (i = hu_hash_name(varname) & hu_index.mask; (hidups_item = hu_index.by_name[i]) != NULL; i = (i + 1) & hu_index.mask) {
+			if (!strcasecmp(hidups_item->info_type, varname))
+				return hidups_item;
+		}
+
+		upsdebugx(2, "find_nut_info: unknown info type: %s", varname);
+		return NULL;
+	}
 
 	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
 
@@ -1673,6 +2202,17 @@ static hid_info_t *find_hid_info(const HIDData_t *hiddata)
 		return NULL;
 	}
 
+	if (hu_index.by_data) {
+		size_t	i;
+
+		for (i = hu_hash_data(hiddata) & hu_index.mask; (hidups_item = hu_index.by_data[i]) != NULL; i = (i + 1) & hu_index.mask) {
+			if (hidups_item->hiddata == hiddata)
+				return hidups_item;
+		}
+
+		return NULL;
+	}
+
 	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
 
 		/* Skip server side vars */
@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include "config.h"
 #include "libhid.h"
+#include "infolkp.h"
 
 #ifdef APC_MODBUS_HID
 #include "libmodbus.h" 
@@ -59,23 +60,14 @@ extern bool_t	 	use_interrupt_pipe;	/* Set to FALSE if interrupt reports should
 					/* The driver will wait for Interrupt */
 					/* and do "light poll" in the meantime */
 
+/* Interrupt pipe timeouts, in msec */
+#define USB_EVENT_TIMEOUT	250	/* wait for notifications in upsdrv_updateinfo() */
+#define USB_IDLE_TIMEOUT	250	/* max. wait for notifications between updates */
+
 #ifndef MAX_STRING_SIZE
 #define MAX_STRING_SIZE	128
 #endif
 
-
-/* --------------------------------------------------------------- */
-/* Struct & data for lookup between HID and NUT values             */
-/* (From USB/HID, Power Devices Class standard)                    */
-/* --------------------------------------------------------------- */
-
-typedef struct {
-	const long	hid_value;	/* HID value */
-	const char	*nut_value;	/* NUT value */
-	const char	*(*fun)(double hid_value);	/* optional HID to NUT mapping */
-	double	(*nuf)(const char *nut_value);		/* optional NUT to HID mapping */
-} info_lkp_t;
-
 /* declarations of public lookup tables */
 /* boolean status values from UPS */
 extern info_lkp_t online_info[];
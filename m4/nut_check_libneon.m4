@@ -56,7 +56,7 @@ if test -z "${nut_have_neon_seen}"; then
 
 	if test "${nut_have_neon}" = "yes"; then
 		dnl Check for connect timeout support in library (optional)
-		AC_CHECK_FUNCS(ne_set_connect_timeout ne_sock_connect_timeout)
+		AC_CHECK_FUNCS(ne_set_connect_timeout ne_sock_connect_timeout ne_get_response_header)
 		LIBNEON_CFLAGS="${CFLAGS}"
 		LIBNEON_LIBS="${LIBS}"
 	fi
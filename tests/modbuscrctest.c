@@ -0,0 +1,145 @@
+/* modbuscrctest - check the table driven CRC-16/MODBUS of libmodbus
+
+   Copyright (C)
+	2017	Dmitry Togushev <jtprofacc@gmain.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libmodbus.h"
+
+/* number of random frames checked against the bitwise CRC */
+#define RANDOM_FRAMES	10000
+
+/* number of largest frames run through each CRC for the throughput */
+#define BENCH_FRAMES	50000
+
+/* keeps the timed CRCs from being optimized out */
+static volatile uint16_t	crc_sink;
+
+/* the bitwise CRC-16/MODBUS the table was derived from */
+static uint16_t crc_bitwise(const uint8_t *data, unsigned int sz)
+{
+	uint16_t	crc = 0xffff;
+	int		bit;
+
+	while (sz--) {
+		crc ^= *data++;
+
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+	}
+
+	return crc;
+}
+
+/* time BENCH_FRAMES largest frames through crcfn, return MB/s */
+static double crc_throughput(uint16_t (*crcfn)(const uint8_t *, unsigned int), uint8_t *frame)
+{
+	struct timeval	start, end;
+	double		elapsed;
+	unsigned int	i;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		frame[0] = i;
+		crc_sink = crcfn(frame, MODBUS_MAX_FRAME_SZ);
+	}
+
+	gettimeofday(&end, NULL);
+
+	elapsed = end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (elapsed <= 0) {
+		return 0;
+	}
+
+	return (double)BENCH_FRAMES * MODBUS_MAX_FRAME_SZ / elapsed / 1000000;
+}
+
+int main(void)
+{
+	const char	*check = "123456789";
+	/* read holding registers 130 to 132 of slave 1, as sent on the wire */
+	const uint8_t	request[] = { 0x01, 0x03, 0x00, 0x82, 0x00, 0x03 };
+	uint8_t		frame[MODBUS_MAX_FRAME_SZ];
+	unsigned int	i, j, sz;
+	uint16_t	crc;
+	double		table, bitwise;
+	int		errors = 0;
+
+	/* check value of the CRC-16/MODBUS catalogue entry */
+	crc = ModbusCrc((const uint8_t *)check, strlen(check));
+	if (crc != 0x4B37) {
+		printf("FAIL: CRC of \"%s\" is 0x%04X, expected 0x4B37\n", check, crc);
+		errors++;
+	}
+
+	/* an empty frame leaves the initial value */
+	crc = ModbusCrc(frame, 0);
+	if (crc != 0xFFFF) {
+		printf("FAIL: CRC of an empty frame is 0x%04X, expected 0xFFFF\n", crc);
+		errors++;
+	}
+
+	/* a frame followed by its CRC (LSB first) has a zero residue */
+	memcpy(frame, request, sizeof(request));
+	crc = ModbusCrc(frame, sizeof(request));
+	frame[sizeof(request)] = crc & 0xff;
+	frame[sizeof(request) + 1] = crc >> 8;
+	if (ModbusCrc(frame, sizeof(request) + 2) != 0) {
+		printf("FAIL: residue of a frame with its CRC is 0x%04X, expected 0\n", ModbusCrc(frame, sizeof(request) + 2));
+		errors++;
+	}
+
+	/* random frames of all the sizes, against the bitwise CRC */
+	srand(1);
+
+	for (i = 0; i < RANDOM_FRAMES; i++) {
+		sz = i % (sizeof(frame) + 1);
+
+		for (j = 0; j < sz; j++) {
+			frame[j] = rand() & 0xff;
+		}
+
+		if (ModbusCrc(frame, sz) != crc_bitwise(frame, sz)) {
+			printf("FAIL: CRC of random frame %u (%u bytes) is 0x%04X, expected 0x%04X\n",
+				i, sz, ModbusCrc(frame, sz), crc_bitwise(frame, sz));
+			errors++;
+		}
+	}
+
+	if (errors) {
+		printf("%d CRC-16/MODBUS check(s) failed\n", errors);
+		return EXIT_FAILURE;
+	}
+
+	printf("CRC-16/MODBUS: check value and %d random frames OK\n", RANDOM_FRAMES);
+
+	/* for information only, not a pass/fail criterion */
+	table = crc_throughput(ModbusCrc, frame);
+	bitwise = crc_throughput(crc_bitwise, frame);
+
+	printf("CRC-16/MODBUS throughput: table %.1f MB/s, bitwise %.1f MB/s (%d frames of %d bytes)\n",
+		table, bitwise, BENCH_FRAMES, MODBUS_MAX_FRAME_SZ);
+
+	return EXIT_SUCCESS;
+}
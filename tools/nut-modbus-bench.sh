@@ -0,0 +1,121 @@
+#!/bin/sh
+################################################################################
+#
+# nut-modbus-bench
+#   Run the smt-modbus driver against the nut-modbus-sim.py MODBUS simulator,
+#   and report the MODBUS transactions per second, the update cycle latency
+#   and the retry rate seen by the driver.
+#
+#   Any option after the mode is passed to the simulator, to add latency,
+#   jitter, CRC errors or dropped responses, for example:
+#
+#	nut-modbus-bench.sh rtu 60 --latency 5 --jitter 5 --crc-errors 0.01
+#
+################################################################################
+
+strUsage="Usage: nut-modbus-bench.sh <tcp|rtu> [duration] [simulator options]"
+
+# default run time, in seconds
+DEFAULT_DURATION=30
+
+# MODBUS/TCP port of the simulator
+SIM_PORT=5502
+
+TOOLS_DIR="`dirname "$0"`"
+DRIVER="${DRIVER:-${TOOLS_DIR}/../drivers/smt-modbus}"
+SIMULATOR="${SIMULATOR:-${TOOLS_DIR}/nut-modbus-sim.py}"
+MAP="${MAP:-${TOOLS_DIR}/smt-modbus-sim.map}"
+PYTHON="${PYTHON:-python}"
+
+MODE="$1"
+case "$MODE" in
+	tcp|rtu)
+		shift
+		;;
+	*)
+		echo "$strUsage"
+		exit 1
+		;;
+esac
+
+DURATION="$DEFAULT_DURATION"
+case "$1" in
+	[0-9]*)
+		DURATION="$1"
+		shift
+		;;
+esac
+
+if [ ! -x "$DRIVER" ]; then
+	echo "Error: driver $DRIVER not found, build it first (or set DRIVER)"
+	exit 1
+fi
+
+# the driver sockets and logs go to a private state path
+TEMP_DIR="`mktemp -d /tmp/nut-modbus-bench.XXXXXX`" || exit 1
+NUT_STATEPATH="$TEMP_DIR"
+export NUT_STATEPATH
+
+if [ "$MODE" = "tcp" ]; then
+	PORT="127.0.0.1:$SIM_PORT"
+	"$PYTHON" "$SIMULATOR" -m "$MAP" --tcp "$SIM_PORT" "$@" > "$TEMP_DIR/sim.log" 2>&1 &
+else
+	PORT="$TEMP_DIR/ttyMODBUS"
+	"$PYTHON" "$SIMULATOR" -m "$MAP" --rtu "$PORT" "$@" > "$TEMP_DIR/sim.log" 2>&1 &
+fi
+SIM_PID=$!
+
+# wait for the simulator to listen
+sleep 1
+
+echo "Running smt-modbus over $MODE for $DURATION seconds..."
+
+"$DRIVER" -D -u "`id -un`" -s bench -i 1 -x port="$PORT" \
+	> "$TEMP_DIR/driver.log" 2>&1 &
+DRV_PID=$!
+
+sleep "$DURATION"
+
+kill "$DRV_PID" 2>/dev/null
+wait "$DRV_PID" 2>/dev/null
+kill "$SIM_PID" 2>/dev/null
+wait "$SIM_PID" 2>/dev/null
+
+# Update took 0.012 seconds, 5 MODBUS transaction(s), 0 retries, 0 timeout(s), 0 error(s)
+awk '
+/Update took/ {
+	for (i = 1; i <= NF; i++) {
+		if ($i == "took") t = $(i + 1)
+		else if ($i == "MODBUS") x = $(i - 1)
+		else if ($i == "retries,") r = $(i - 1)
+		else if ($i == "timeout(s),") o = $(i - 1)
+		else if ($i == "error(s)") e = $(i - 1)
+	}
+	n++; total += t; xfers += x; retries += r; timeouts += o; errors += e
+	if (t > max) max = t
+}
+END {
+	if (n == 0) {
+		print "No update cycle completed, see the logs"
+		exit 1
+	}
+	printf("Update cycles:          %u\n", n)
+	printf("Cycle latency:          %.3f ms mean, %.3f ms max\n", total / n * 1000, max * 1000)
+	printf("MODBUS transactions:    %u (%.1f per cycle)\n", xfers, xfers / n)
+	if (total > 0)
+		printf("Transactions/sec:       %.1f (while polling)\n", xfers / total)
+	printf("Retries:                %u (%.2f %%)\n", retries, xfers ? retries * 100 / xfers : 0)
+	printf("Timeouts:               %u\n", timeouts)
+	printf("Errors:                 %u\n", errors)
+}' "$TEMP_DIR/driver.log"
+STATUS=$?
+
+echo "Simulator: `tail -n 1 "$TEMP_DIR/sim.log"`"
+
+if [ $STATUS -eq 0 ]; then
+	rm -rf "$TEMP_DIR"
+else
+	echo "Logs left in $TEMP_DIR"
+fi
+
+exit $STATUS
@@ -0,0 +1,306 @@
+#!/usr/bin/env python
+#   Copyright (C) 2017 - Dmitry Togushev <jtprofacc@gmain.com>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program; if not, write to the Free Software
+#   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+# This program simulates a MODBUS slave, such as an APC Smart-UPS, for
+# testing and benchmarking the smt-modbus driver without the hardware.
+# It serves a register map loaded from a file, either as MODBUS RTU on a
+# pseudo terminal, or as MODBUS/TCP. Response latency, jitter, corrupted
+# CRC and dropped responses can be added to exercise the driver retries.
+#
+# Register map files hold one register (or a run of registers) per line:
+#
+#	# comment
+#	<reg> <value> [<value>...]	16 bits values, decimal or 0x hexadecimal
+#	<reg> "<text>" [<nregs>]	text, 2 characters per register, space padded
+#
+# Registers not listed in the map read as 0.
+
+from __future__ import print_function
+
+import getopt
+import os
+import random
+import select
+import signal
+import socket
+import struct
+import sys
+import time
+
+MODBUS_FC_READ_HOLDING_REGS = 0x03
+MODBUS_FC_WRITE_REGS = 0x10
+
+MODBUS_EX_ILLEGAL_FUNCTION = 0x01
+MODBUS_EX_ILLEGAL_ADDRESS = 0x02
+MODBUS_EX_ILLEGAL_VALUE = 0x03
+
+MODBUS_MAX_READ_REGS = 125
+MODBUS_MAX_WRITE_REGS = 123
+
+regs = {}
+slave = 1
+latency = 0.0
+jitter = 0.0
+crc_errors = 0.0
+drops = 0.0
+verbose = 0
+
+stats = { "requests": 0, "responses": 0, "exceptions": 0, "dropped": 0, "corrupted": 0, "writes": 0 }
+
+def usage():
+	print("Usage: nut-modbus-sim.py [options] (--tcp <port> | --rtu <link>)")
+	print("")
+	print("  -m, --map <file>         register map to serve")
+	print("  -s, --slave <addr>       slave address (default: 1)")
+	print("  -t, --tcp <port>         serve MODBUS/TCP on this port of localhost")
+	print("  -r, --rtu <link>         serve MODBUS RTU on a pseudo terminal, linked as <link>")
+	print("  -l, --latency <ms>       delay before each response (default: 0)")
+	print("  -j, --jitter <ms>        random extra delay, up to <ms> (default: 0)")
+	print("  -c, --crc-errors <rate>  ratio of RTU responses sent with a bad CRC (default: 0)")
+	print("  -d, --drops <rate>       ratio of responses not sent (default: 0)")
+	print("  -v, --verbose            log requests and responses")
+	print("")
+	print("Statistics are printed on exit (SIGINT or SIGTERM).")
+
+def load_map(filename):
+	f = open(filename, 'r')
+	for lineno, line in enumerate(f, 1):
+		line = line.strip()
+		if not line or line.startswith('#'):
+			continue
+		reg, rest = (line.split(None, 1) + [""])[:2]
+		reg = int(reg, 0)
+		if rest.startswith('"'):
+			end = rest.rindex('"')
+			text = rest[1:end]
+			count = rest[end + 1:].split()
+			nregs = int(count[0], 0) if count else (len(text) + 1) // 2
+			text = text.ljust(2 * nregs)[:2 * nregs]
+			for i in range(nregs):
+				regs[reg + i] = (ord(text[2 * i]) << 8) | ord(text[2 * i + 1])
+		else:
+			for i, value in enumerate(rest.split()):
+				regs[reg + i] = int(value, 0) & 0xffff
+	f.close()
+
+def crc16(data):
+	crc = 0xffff
+	for b in data:
+		crc ^= b
+		for _ in range(8):
+			crc = (crc >> 1) ^ 0xa001 if crc & 1 else crc >> 1
+	return crc
+
+def exception(unit, fc, code):
+	stats["exceptions"] += 1
+	return bytearray([unit, fc | 0x80, code])
+
+# process a request (slave address, function code and PDU, without CRC),
+# return the response or None
+def process(req):
+	unit, fc = req[0], req[1]
+
+	stats["requests"] += 1
+
+	if unit != slave:
+		return None
+
+	if fc == MODBUS_FC_READ_HOLDING_REGS:
+		reg, nregs = struct.unpack('>HH', bytes(req[2:6]))
+		if nregs < 1 or nregs > MODBUS_MAX_READ_REGS:
+			return exception(unit, fc, MODBUS_EX_ILLEGAL_VALUE)
+		if reg + nregs > 0x10000:
+			return exception(unit, fc, MODBUS_EX_ILLEGAL_ADDRESS)
+		rsp = bytearray([unit, fc, 2 * nregs])
+		for r in range(reg, reg + nregs):
+			rsp += bytearray(struct.pack('>H', regs.get(r, 0)))
+		return rsp
+
+	if fc == MODBUS_FC_WRITE_REGS:
+		reg, nregs = struct.unpack('>HH', bytes(req[2:6]))
+		if nregs < 1 or nregs > MODBUS_MAX_WRITE_REGS or req[6] != 2 * nregs:
+			return exception(unit, fc, MODBUS_EX_ILLEGAL_VALUE)
+		if reg + nregs > 0x10000:
+			return exception(unit, fc, MODBUS_EX_ILLEGAL_ADDRESS)
+		for i in range(nregs):
+			regs[reg + i] = (req[7 + 2 * i] << 8) | req[8 + 2 * i]
+		stats["writes"] += 1
+		if verbose:
+			print("write: reg=%u, nregs=%u" % (reg, nregs))
+		return bytearray(req[0:6])
+
+	return exception(unit, fc, MODBUS_EX_ILLEGAL_FUNCTION)
+
+# apply the configured latency and faults, return False to drop the response
+def deliver():
+	delay = latency + random.uniform(0, jitter)
+	if delay > 0:
+		time.sleep(delay)
+	if random.random() < drops:
+		stats["dropped"] += 1
+		return False
+	stats["responses"] += 1
+	return True
+
+# length of the RTU request at the head of 'buf', 0 if incomplete, -1 if unknown
+def rtu_length(buf):
+	if len(buf) < 2:
+		return 0
+	if buf[1] == MODBUS_FC_READ_HOLDING_REGS:
+		return 8
+	if buf[1] == MODBUS_FC_WRITE_REGS:
+		return 9 + buf[6] if len(buf) >= 7 else 0
+	return -1
+
+def serve_rtu(link):
+	import pty
+	import tty
+
+	master, slavefd = pty.openpty()
+	tty.setraw(slavefd)
+	if os.path.lexists(link):
+		os.unlink(link)
+	os.symlink(os.ttyname(slavefd), link)
+	print("MODBUS RTU on %s (%s)" % (link, os.ttyname(slavefd)))
+	sys.stdout.flush()
+
+	buf = bytearray()
+	try:
+		while True:
+			buf += bytearray(os.read(master, 256))
+			while True:
+				n = rtu_length(buf)
+				if n < 0:
+					# out of sync: wait for the line to be silent, as a device would
+					if not select.select([master], [], [], 0.05)[0]:
+						buf = bytearray()
+					break
+				if n == 0 or len(buf) < n:
+					break
+				req, buf = buf[:n], buf[n:]
+				if crc16(req) != 0:
+					if verbose:
+						print("bad request CRC, ignored")
+					continue
+				rsp = process(req[:-2])
+				if rsp is None or not deliver():
+					continue
+				crc = crc16(rsp)
+				if random.random() < crc_errors:
+					crc ^= 0x5a5a
+					stats["corrupted"] += 1
+				os.write(master, bytes(rsp + bytearray([crc & 0xff, crc >> 8])))
+	finally:
+		os.unlink(link)
+
+def serve_tcp(port):
+	srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+	srv.bind(('127.0.0.1', port))
+	srv.listen(4)
+	print("MODBUS/TCP on 127.0.0.1:%u" % port)
+	sys.stdout.flush()
+
+	clients = {}
+	while True:
+		ready = select.select([srv] + list(clients.keys()), [], [])[0]
+		for s in ready:
+			if s is srv:
+				c, addr = srv.accept()
+				c.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+				clients[c] = bytearray()
+				if verbose:
+					print("connection from %s:%u" % addr)
+				continue
+			data = s.recv(4096)
+			if not data:
+				del clients[s]
+				s.close()
+				continue
+			buf = clients[s] + bytearray(data)
+			# MBAP header: transaction id, protocol id, length
+			while len(buf) >= 6:
+				tid, proto, n = struct.unpack('>HHH', bytes(buf[:6]))
+				if len(buf) < 6 + n:
+					break
+				req, buf = buf[6:6 + n], buf[6 + n:]
+				if proto != 0 or n < 2:
+					continue
+				rsp = process(req)
+				if rsp is None or not deliver():
+					continue
+				s.sendall(struct.pack('>HHH', tid, 0, len(rsp)) + bytes(rsp))
+			clients[s] = buf
+
+def print_stats(signum=None, frame=None):
+	print("requests: %(requests)u, responses: %(responses)u, exceptions: %(exceptions)u, "
+		"dropped: %(dropped)u, corrupted: %(corrupted)u, writes: %(writes)u" % stats)
+	sys.stdout.flush()
+	if signum is not None:
+		raise SystemExit(0)
+
+def main():
+	global slave, latency, jitter, crc_errors, drops, verbose
+
+	tcp = None
+	rtu = None
+
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "hm:s:t:r:l:j:c:d:v",
+			["help", "map=", "slave=", "tcp=", "rtu=", "latency=", "jitter=", "crc-errors=", "drops=", "verbose"])
+	except getopt.GetoptError as err:
+		print(err)
+		usage()
+		sys.exit(2)
+
+	for o, a in opts:
+		if o in ("-h", "--help"):
+			usage()
+			sys.exit(0)
+		elif o in ("-m", "--map"):
+			load_map(a)
+		elif o in ("-s", "--slave"):
+			slave = int(a, 0)
+		elif o in ("-t", "--tcp"):
+			tcp = int(a)
+		elif o in ("-r", "--rtu"):
+			rtu = a
+		elif o in ("-l", "--latency"):
+			latency = float(a) / 1000
+		elif o in ("-j", "--jitter"):
+			jitter = float(a) / 1000
+		elif o in ("-c", "--crc-errors"):
+			crc_errors = float(a)
+		elif o in ("-d", "--drops"):
+			drops = float(a)
+		elif o in ("-v", "--verbose"):
+			verbose += 1
+
+	if (tcp is None) == (rtu is None):
+		usage()
+		sys.exit(2)
+
+	signal.signal(signal.SIGINT, print_stats)
+	signal.signal(signal.SIGTERM, print_stats)
+
+	if tcp is not None:
+		serve_tcp(tcp)
+	else:
+		serve_rtu(rtu)
+
+if __name__ == '__main__':
+	main()
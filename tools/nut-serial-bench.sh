@@ -0,0 +1,162 @@
+#!/bin/sh
+################################################################################
+#
+# nut-serial-bench
+#   Run the serial drivers against the nut-serial-sim.py UPS simulator, each
+#   with the protocol it speaks, and report the time and the commands taken
+#   by the driver startup and by each update cycle, the longest update, and
+#   the CPU time the driver spends per update.
+#
+#   Any option after the duration is passed to the simulator, to change the
+#   baud rate, add latency, garbage or timeouts, or script a power failure,
+#   for example:
+#
+#	nut-serial-bench.sh 120 --baud 9600 --script 30:onbatt,60:lowbatt,90:online
+#
+#   Set DRIVERS to only run some of them, as <driver>:<personality> pairs:
+#
+#	DRIVERS="nutdrv_qx:voltronic apcsmart:apcsmart" nut-serial-bench.sh 60
+#
+################################################################################
+
+strUsage="Usage: nut-serial-bench.sh [duration] [simulator options]"
+
+# default run time of each driver, in seconds
+DEFAULT_DURATION=60
+
+TOOLS_DIR="`dirname "$0"`"
+DRIVER_DIR="${DRIVER_DIR:-${TOOLS_DIR}/../drivers}"
+SIMULATOR="${SIMULATOR:-${TOOLS_DIR}/nut-serial-sim.py}"
+PYTHON="${PYTHON:-python}"
+DRIVERS="${DRIVERS:-nutdrv_qx:megatec nutdrv_qx:voltronic blazer_ser:megatec apcsmart:apcsmart bcmxcp:bcmxcp}"
+# seconds between two updates of the driver; the simulator ends a cycle
+# after half of it without a command, which is longer than the pauses and
+# the timeouts of the drivers
+INTERVAL="${INTERVAL:-10}"
+
+DURATION="$DEFAULT_DURATION"
+case "$1" in
+	[0-9]*)
+		DURATION="$1"
+		shift
+		;;
+	-h|--help)
+		echo "$strUsage"
+		exit 0
+		;;
+esac
+
+TEMP_DIR="`mktemp -d /tmp/nut-serial-bench.XXXXXX`" || exit 1
+CLK_TCK="`getconf CLK_TCK`"
+STATUS=0
+
+# CPU time used by a process, in nanoseconds: the drivers only take a few
+# clock ticks over a whole run, so use the scheduler statistics when the
+# kernel has them, and the user and system ticks otherwise
+cpu_ns() {
+	if [ -r "/proc/$1/schedstat" ]; then
+		awk '{ printf("%.0f\n", $1) }' "/proc/$1/schedstat" 2>/dev/null || echo 0
+	else
+		awk -v tck="$CLK_TCK" '{ printf("%.0f\n", ($14 + $15) * 1000000000 / tck) }' "/proc/$1/stat" 2>/dev/null || echo 0
+	fi
+}
+
+echo "Running each driver for $DURATION seconds, updating every $INTERVAL seconds..."
+printf "%-22s %10s %8s %10s %8s %10s %10s\n" "driver" "startup" "cmds" "update" "cmds" "max" "CPU"
+
+for ENTRY in $DRIVERS; do
+	DRIVER="${ENTRY%%:*}"
+	PERSONALITY="${ENTRY#*:}"
+	NAME="$DRIVER/$PERSONALITY"
+
+	if [ ! -x "$DRIVER_DIR/$DRIVER" ]; then
+		printf "%-22s not found in %s, build it first (or set DRIVER_DIR)\n" "$NAME" "$DRIVER_DIR"
+		STATUS=1
+		continue
+	fi
+
+	# nutdrv_qx would otherwise try each of its protocols in turn
+	case "$DRIVER" in
+		nutdrv_qx)
+			ARGS="-x protocol=$PERSONALITY"
+			;;
+		*)
+			ARGS=""
+			;;
+	esac
+
+	# the driver sockets, PID file and logs go to a private state path
+	STATE_DIR="$TEMP_DIR/$DRIVER-$PERSONALITY"
+	mkdir "$STATE_DIR"
+	NUT_STATEPATH="$STATE_DIR"
+	export NUT_STATEPATH
+	PORT="$STATE_DIR/ttyUPS"
+
+	"$PYTHON" "$SIMULATOR" --personality "$PERSONALITY" --cycle-gap "`expr $INTERVAL \* 500`" \
+		"$@" "$PORT" > "$STATE_DIR/sim.log" 2>&1 &
+	SIM_PID=$!
+
+	# wait for the simulator to create the pseudo terminal
+	sleep 1
+
+	# without debug, the driver goes to the background once started
+	"$DRIVER_DIR/$DRIVER" -u "`id -un`" -s bench -i "$INTERVAL" -x port="$PORT" $ARGS \
+		> "$STATE_DIR/driver.log" 2>&1
+
+	# the PID file is written again by the driver once in the background
+	TRIES=0
+	while :; do
+		DRV_PID="`cat "$STATE_DIR/$DRIVER-bench.pid" 2>/dev/null`"
+		if [ -n "$DRV_PID" ] && [ -d "/proc/$DRV_PID" ] || [ $TRIES -ge 5 ]; then
+			break
+		fi
+		TRIES=`expr $TRIES + 1`
+		sleep 1
+	done
+
+	if [ -z "$DRV_PID" ] || [ ! -d "/proc/$DRV_PID" ]; then
+		printf "%-22s failed to start, see %s\n" "$NAME" "$STATE_DIR/driver.log"
+		kill "$SIM_PID" 2>/dev/null
+		wait "$SIM_PID" 2>/dev/null
+		STATUS=1
+		continue
+	fi
+
+	CPU_START="`cpu_ns "$DRV_PID"`"
+	sleep "$DURATION"
+	CPU_END="`cpu_ns "$DRV_PID"`"
+
+	kill "$DRV_PID" 2>/dev/null
+	while [ -d "/proc/$DRV_PID" ]; do
+		sleep 1
+	done
+	kill "$SIM_PID" 2>/dev/null
+	wait "$SIM_PID" 2>/dev/null
+
+	# cycles: 7, startup: 80 commands in 3.015 s, update: 14.0 commands in 0.426 s, max 0.435 s
+	tail -n 1 "$STATE_DIR/sim.log" | awk -v name="$NAME" -v cpu_start="$CPU_START" -v cpu_end="$CPU_END" '
+	/^cycles:/ {
+		gsub(",", "")
+		cycles = $2
+		for (i = 1; i <= NF; i++) {
+			if ($i == "startup:") { sc = $(i + 1); st = $(i + 4) }
+			else if ($i == "update:") { uc = $(i + 1); ut = $(i + 4); um = $(i + 7) }
+		}
+	}
+	END {
+		if (cycles < 2) {
+			printf("%-22s no update completed\n", name)
+			exit 1
+		}
+		printf("%-22s %8.3f s %8u %7.1f ms %8.1f %7.1f ms %7.3f ms\n", name, st, sc, ut * 1000, uc,
+			um * 1000, (cpu_end - cpu_start) / 1000000 / (cycles - 1))
+	}' || STATUS=1
+done
+
+if [ $STATUS -eq 0 ]; then
+	rm -rf "$TEMP_DIR"
+else
+	echo "Logs left in $TEMP_DIR"
+fi
+
+exit $STATUS
@@ -0,0 +1,623 @@
+#!/usr/bin/env python
+#   Copyright (C) 2017 - Dmitry Togushev <jtprofacc@gmain.com>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program; if not, write to the Free Software
+#   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+# This program simulates a serial UPS on a pseudo terminal, for testing and
+# benchmarking the serial drivers without the hardware. It speaks one of
+# these protocols (personalities):
+#
+# - megatec: Q1, F, I and the instant commands of the Megatec protocol, as
+#   used by blazer_ser and nutdrv_qx (protocol=megatec);
+# - voltronic: QGS, QPI, QMD, QMOD, QBV... of the Voltronic Power protocol,
+#   as used by nutdrv_qx (protocol=voltronic);
+# - apcsmart: the single character commands and the alerts of the APC Smart
+#   protocol, as used by apcsmart;
+# - bcmxcp: the binary BCM/XCP blocks (ID, meters, alarms, status, battery,
+#   limits, configuration), as used by bcmxcp.
+#
+# The answers of the Megatec and Voltronic protocols that don't depend on
+# the UPS state are taken from the sample answers of the matching nutdrv_qx
+# subdriver (drivers/nutdrv_qx_<personality>.c, built with TESTING), so that
+# the driver finds all it knows about.
+#
+# The UPS goes online, on battery, low on battery or silent following a
+# script of state changes. The bytes can be paced at the UPS baud rate, and
+# latency, jitter, garbled and unanswered commands can be added to exercise
+# the driver timeouts and retries.
+#
+# The commands of the driver are grouped in cycles (its startup, then each
+# update), separated by a silence of the line: the number of commands and
+# the time taken by each cycle are printed on exit.
+
+from __future__ import print_function
+
+import getopt
+import os
+import random
+import re
+import select
+import signal
+import struct
+import sys
+import time
+
+STATES = ("online", "onbatt", "lowbatt", "nocomm")
+
+# usual baud rate of each protocol
+PERSONALITIES = { "megatec": 2400, "voltronic": 2400, "apcsmart": 2400, "bcmxcp": 19200 }
+
+personality = None
+state = "online"
+script = []
+repeat = False
+baud = None
+latency = 0.0
+jitter = 0.0
+garbage = 0.0
+timeouts = 0.0
+cycle_gap = 1.0
+verbose = 0
+start_time = time.time()
+
+stats = { "commands": 0, "responses": 0, "unknown": 0, "unanswered": 0, "garbled": 0,
+	"alerts": 0, "bytes_in": 0, "bytes_out": 0, "states": 0 }
+
+cycles = []
+cycle = None
+inflight = 0
+
+# answers of the nutdrv_qx protocols, by command
+table = {}
+
+def usage():
+	print("Usage: nut-serial-sim.py [options] --personality <name> <link>")
+	print("")
+	print("  -p, --personality <name> protocol: megatec, voltronic, apcsmart or bcmxcp")
+	print("  -T, --table <file>       nutdrv_qx subdriver holding the sample answers")
+	print("                           (default: ../drivers/nutdrv_qx_<personality>.c)")
+	print("  -s, --state <state>      initial state: online, onbatt, lowbatt or nocomm")
+	print("                           (default: online)")
+	print("  -S, --script <script>    state changes, as <seconds>:<state>[,<seconds>:<state>...]")
+	print("                           counted from the start, e.g. 20:onbatt,40:lowbatt,60:online")
+	print("  -r, --repeat             run the script again once done")
+	print("  -b, --baud <rate>        pace the bytes at this baud rate, 0 to send them at once")
+	print("                           (default: 2400, 19200 for bcmxcp)")
+	print("  -l, --latency <ms>       delay before each answer (default: 0)")
+	print("  -j, --jitter <ms>        random extra delay, up to <ms> (default: 0)")
+	print("  -g, --garbage <rate>     ratio of answers sent with a garbled byte (default: 0)")
+	print("  -t, --timeouts <rate>    ratio of commands left unanswered (default: 0)")
+	print("  -G, --cycle-gap <ms>     silence ending a cycle of the driver, keep it above the")
+	print("                           driver timeout when leaving commands unanswered (default: 1000)")
+	print("  -v, --verbose            log commands and answers")
+	print("")
+	print("The UPS is served on a pseudo terminal, linked as <link>.")
+	print("Statistics are printed on exit (SIGINT or SIGTERM).")
+
+def to_bytes(s):
+	return bytearray(s.encode('latin-1') if not isinstance(s, bytearray) else s)
+
+def c_unescape(s):
+	return re.sub(r'\\(x[0-9a-fA-F]{1,2}|[0-7]{1,3}|.)', lambda m: c_escape_char(m.group(1)), s)
+
+def c_escape_char(e):
+	if e[0] == 'x':
+		return chr(int(e[1:], 16))
+	if e[0] in "01234567":
+		return chr(int(e, 8))
+	return { 'r': '\r', 'n': '\n', 't': '\t', '0': '\0' }.get(e, e)
+
+# sample answers of a nutdrv_qx subdriver:
+#	{ "QGS\r",	"(234.9 50.0 ... 100000000001\r",	-1 },
+def load_table(filename):
+	f = open(filename, 'r')
+	text = f.read()
+	f.close()
+	m = re.search(r'testing_t\s+\w+\[\]\s*=\s*\{(.*?)\n\};', text, re.S)
+	if not m:
+		return 0
+	for cmd, answer in re.findall(r'\{\s*"((?:[^"\\]|\\.)*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*,\s*-?\d+\s*\}', m.group(1)):
+		table[c_unescape(cmd)] = c_unescape(answer)
+	return len(table)
+
+#
+# UPS state
+#
+
+def values():
+	v = { "input": 230.0 + random.uniform(-2, 2), "output": 230.0, "frequency": 50.0,
+		"load": 24 + random.randint(-1, 1), "temperature": 30.0,
+		"charge": 100, "battery": 27.2, "runtime": 45, "fail": 0, "low": 0 }
+	if state in ("onbatt", "lowbatt"):
+		v.update({ "input": 0.0, "frequency": 0.0, "charge": 60, "battery": 24.6,
+			"runtime": 25, "fail": 1 })
+	if state == "lowbatt":
+		v.update({ "charge": 15, "battery": 22.4, "runtime": 3, "low": 1 })
+	return v
+
+def set_state(new):
+	global state
+	if new == state:
+		return
+	print("%.3f: state %s -> %s" % (time.time() - start_time, state, new))
+	sys.stdout.flush()
+	alert = apc_alerts(state, new) if personality == "apcsmart" else ""
+	state = new
+	stats["states"] += 1
+	if alert:
+		stats["alerts"] += len(alert)
+		queue_bytes(to_bytes(alert), 0, False)
+
+def parse_script(text):
+	events = []
+	for item in text.split(','):
+		t, s = item.split(':')
+		if s not in STATES:
+			raise ValueError("unknown state '%s'" % s)
+		events.append((float(t), s))
+	return sorted(events)
+
+#
+# Megatec and Voltronic protocols, used by blazer_ser and nutdrv_qx
+#
+
+MEGATEC_ANSWERS = {
+	"F\r": "#230.0 000 024.0 50.0\r",
+	"I\r": "#NOT_A_LIVE_UPS  TESTING    TESTING   \r",
+}
+
+VOLTRONIC_ANSWERS = {
+	"QPI\r": "(PI01\r",
+	"QRI\r": "(230.0 004 024.0 50.0\r",
+	"QMD\r": "(#######OLHVT1K0 ###1000 80 2/2 230 230 02 12.0\r",
+	"QGS\r": "(234.9 50.0 229.8 50.0 000.0 00A 369.1 ---.- 026.5 ---.- 018.8 100000000001\r",
+	"F\r": "#220.0 000 024.0 50.0\r",
+}
+
+def split_lines(buf):
+	cmds = []
+	while True:
+		i = buf.find(b'\r')
+		if i < 0:
+			return cmds, buf
+		cmd, buf = buf[:i + 1], buf[i + 1:]
+		cmds.append(bytes(cmd.lstrip(b'\n')).decode('latin-1'))
+
+def megatec_answer(cmd):
+	v = values()
+	if cmd == "Q1\r":
+		return "(%05.1f %05.1f %05.1f %03d %04.1f %04.1f %04.1f %u%u000000\r" % (v["input"],
+			v["input"], v["output"], v["load"], v["frequency"], v["battery"],
+			v["temperature"], v["fail"], v["low"])
+	if cmd in table:
+		return table[cmd]
+	if cmd in MEGATEC_ANSWERS:
+		return MEGATEC_ANSWERS[cmd]
+	# Megatec UPSes echo the commands they don't know
+	stats["unknown"] += 1
+	return cmd
+
+def voltronic_answer(cmd):
+	v = values()
+	if cmd == "QGS\r":
+		qgs = table.get(cmd, VOLTRONIC_ANSWERS[cmd])
+		return "(%05.1f %04.1f%s%05.1f%s%u%u%s" % (v["input"], v["frequency"], qgs[11:45],
+			v["battery"], qgs[50:65], v["fail"], v["low"], qgs[67:])
+	if cmd == "QMOD\r":
+		return "(%s\r" % ("B" if v["fail"] else "L")
+	if cmd == "QBV\r":
+		return "(%05.1f 02 01 %03d %03d\r" % (v["battery"], v["charge"], v["runtime"])
+	if cmd in table:
+		return table[cmd]
+	if cmd in VOLTRONIC_ANSWERS:
+		return VOLTRONIC_ANSWERS[cmd]
+	stats["unknown"] += 1
+	return "(NAK\r"
+
+#
+# APC Smart protocol, used by apcsmart
+#
+
+# answer to 'a': protocol version, alerts and commands
+APC_CMDSET = "3.!$%+?=#|.\001\032@ABCEFGKLMNOPQRSUWXYZabcefgjklmnopqrsuxyz~/"
+
+# answer to ^Z: '#', then <command><locale><entries><length><values> for each
+# setting having a list of possible values
+APC_CAPS = "#" + "".join("%s4%u%u%s" % (c, len(v), len(v[0]), "".join(v)) for c, v in (
+	("u", ("253", "264", "271", "280")), ("l", ("196", "188", "208", "204")),
+	("e", ("00", "15", "50", "90")), ("q", ("02", "05", "07", "10"))))
+
+def apc_answer(cmd):
+	v = values()
+	answers = {
+		"Y": "SM", "R": "BYE", "a": APC_CMDSET, "\032": APC_CAPS,
+		"Q": "%02X" % ((0x10 if v["fail"] else 0x08) | (0x40 if v["low"] else 0)),
+		"f": "%05.1f" % v["charge"], "B": "%05.2f" % v["battery"], "j": "%04u:" % v["runtime"],
+		"L": "%05.1f" % v["input"], "O": "%05.1f" % v["output"], "P": "%05.1f" % v["load"],
+		"F": "%05.2f" % v["frequency"], "C": "%05.1f" % v["temperature"],
+		"M": "%05.1f" % max(v["input"], 235.2), "N": "%05.1f" % min(v["input"], 226.0),
+		"/": "%05.2f" % (v["load"] * 0.06), "G": "S" if stats["states"] else "O",
+		"b": "651.12.I", "V": "NA", "\001": "Smart-UPS 1500", "n": "QS0720123456",
+		"m": "05/20/17", "x": "05/20/17", "c": "UPS_IDEN", "E": "336", "X": "OK",
+		"r": "000", "p": "020", "e": "00", "q": "02", "o": "230", "g": "024",
+		"l": "196", "u": "253", "s": "H", "k": "0", "T": "123.4", "9": "FF",
+		"i": "00", ">": "000", "<": "000", "~": "NA", "Z": "*", "S": "OK", "U": "OK",
+		"W": "OK", "A": "OK", "K": "*", "@": "OK", "\033": None,
+	}
+	if cmd in answers:
+		ret = answers[cmd]
+	else:
+		stats["unknown"] += 1
+		ret = "NA"
+	return None if ret is None else ret + "\r\n"
+
+# alerts sent on their own by the UPS when its state changes
+def apc_alerts(old, new):
+	was_ob, is_ob = old in ("onbatt", "lowbatt"), new in ("onbatt", "lowbatt")
+	alert = ""
+	if is_ob and not was_ob:
+		alert += "!"
+	if was_ob and not is_ob and new != "nocomm":
+		alert += "$"
+	if new == "lowbatt" and old != "lowbatt":
+		alert += "%"
+	if old == "lowbatt" and new != "lowbatt" and new != "nocomm":
+		alert += "+"
+	return alert
+
+#
+# BCM/XCP protocol, used by bcmxcp
+#
+
+XCP_START = 0xab
+XCP_ESC = 0x1d
+XCP_MAX_DATA = 121
+
+# meters served: (meter map index, format), the values follow this order
+XCP_METERS = [(27, 0x41), (28, 0x41), (33, 0x52), (34, 0x30), (35, 0xf0), (47, 0x30),
+	(56, 0x51), (63, 0x41), (78, 0x51)]
+
+# alarms served, by alarm map index
+XCP_ALARM_BATTERY_LOW = 56
+XCP_ALARM_UPS_ON_BATTERY = 168
+
+def xcp_word(n):
+	return bytearray(struct.pack('<H', n))
+
+def xcp_checksum(frame):
+	return (0x100 - sum(frame)) & 0xff
+
+def xcp_frames(block, data):
+	out = bytearray()
+	chunks = [data[i:i + XCP_MAX_DATA] for i in range(0, len(data), XCP_MAX_DATA)] or [bytearray([0])]
+	for seq, chunk in enumerate(chunks, 1):
+		if seq == len(chunks):
+			seq |= 0x80
+		frame = bytearray([XCP_START, block, len(chunk), seq]) + chunk
+		out += frame + bytearray([xcp_checksum(frame)])
+	return out
+
+def split_xcp(buf):
+	cmds = []
+	while buf:
+		# the driver sends ESC to leave the UPS menus, skip it and the noise
+		i = buf.find(bytearray([XCP_START]))
+		if i < 0:
+			return cmds, bytearray()
+		buf = buf[i:]
+		if len(buf) < 2 or len(buf) < buf[1] + 3:
+			break
+		frame, buf = buf[:buf[1] + 3], buf[buf[1] + 3:]
+		if sum(frame) & 0xff:
+			if verbose:
+				print("bad command checksum, ignored")
+			continue
+		cmds.append(bytes(frame[2:-1]))
+	return cmds, buf
+
+def xcp_id_block():
+	model = b"Powerware 5115"
+	meters = bytearray(79)
+	for idx, fmt in XCP_METERS:
+		meters[idx] = fmt
+	alarms = bytearray(22)
+	alarms[XCP_ALARM_BATTERY_LOW // 8] |= 1 << (XCP_ALARM_BATTERY_LOW % 8)
+	alarms[XCP_ALARM_UPS_ON_BATTERY // 8] |= 1 << (XCP_ALARM_UPS_ON_BATTERY % 8)
+	data = bytearray([1, 0x10, 0x02])		# one CPU, firmware 02.10
+	data += bytearray([0]) + xcp_word(1500 // 50)	# rating in VA / 50
+	data += bytearray([1, 0])			# phases, phase angle
+	data += bytearray([len(model)]) + bytearray(model)
+	data += bytearray([len(meters)]) + meters
+	data += bytearray([len(alarms)]) + alarms
+	data += xcp_word(80)				# configuration block
+	data += bytearray([0])				# statistics map
+	data += xcp_word(0) + xcp_word(0)		# alarm history, custom event logs
+	data += xcp_word(0)				# topology block
+	data += bytearray([8])				# longest command
+	data += xcp_word(0) + xcp_word(0)		# command list, outlet blocks
+	data += xcp_word(2)				# alarm block
+	return data
+
+def xcp_meter(fmt, value):
+	if fmt == 0xf0:
+		return bytearray(struct.pack('<i', int(value)))
+	return bytearray(struct.pack('<f', value))
+
+def xcp_answer(cmd):
+	v = values()
+	code = bytearray(cmd)[0]
+	if code == 0x31:
+		return xcp_frames(0x01, xcp_id_block())
+	if code == 0x33:
+		return xcp_frames(0x03, bytearray([0xf0 if v["fail"] else 0x50, 0]))
+	if code == 0x34:
+		meters = { 27: 50.0, 28: v["frequency"], 33: v["battery"], 34: v["charge"],
+			35: v["runtime"] * 60, 47: v["load"], 56: v["input"], 63: v["temperature"], 78: v["output"] }
+		data = bytearray()
+		for idx, fmt in XCP_METERS:
+			data += xcp_meter(fmt, meters[idx])
+		return xcp_frames(0x04, data)
+	if code == 0x35:
+		return xcp_frames(0x05, bytearray([v["low"], v["fail"]]))
+	if code == 0x36:
+		data = bytearray(80)
+		data[8:10] = xcp_word(230)
+		data[10:12] = xcp_word(50)
+		data[48:62] = bytearray(b"103005420-5591")
+		data[64:74] = bytearray(b"GA12345678")
+		return xcp_frames(0x06, data)
+	if code == 0x3b:
+		data = bytearray(21)
+		data[20] = 2 if v["fail"] else 3		# discharging or floating
+		data[19] = 1
+		return xcp_frames(0x0b, data)
+	if code == 0x3c:
+		data = bytearray(32)
+		data[0:2] = xcp_word(230)
+		data[2:4] = xcp_word(50)
+		data[16] = 3				# low battery warning, minutes
+		data[17] = 1				# horn enabled
+		data[18:20] = xcp_word(160)
+		data[20:22] = xcp_word(276)
+		return xcp_frames(0x0c, data)
+	if code == 0xa0:
+		return xcp_frames(0x01, bytearray([0x31]))
+	if code == 0xcf:
+		# authorization code, not answered
+		return None
+	if code >= 0x89:
+		# accepted, with no configurable variable
+		return xcp_frames(0x09, bytearray([0x31, code, 0]))
+	stats["unknown"] += 1
+	return xcp_frames(0x09, bytearray([0x32, code, 0]))
+
+def describe(cmd):
+	if personality == "bcmxcp":
+		return " ".join("%02x" % b for b in bytearray(cmd))
+	return repr(cmd)
+
+#
+# pseudo terminal
+#
+
+# bytes waiting to be sent: [due time, byte, ends an answer]
+output = []
+
+def queue_bytes(data, delay, answer):
+	now = time.time()
+	due = now + delay
+	if output:
+		due = max(due, output[-1][0])
+	step = 10.0 / baud if baud else 0.0
+	for i, b in enumerate(data):
+		due += step
+		output.append([due, b, answer and i == len(data) - 1])
+
+def cycle_activity(now, command):
+	global cycle, inflight
+	if command:
+		if cycle is not None and inflight == 0 and now - cycle[1] > cycle_gap:
+			cycles.append(cycle)
+			cycle = None
+		if cycle is None:
+			cycle = [now, now, 0]
+		cycle[2] += 1
+		inflight += 1
+	else:
+		inflight -= 1
+	cycle[1] = now
+
+def process(cmd, now):
+	stats["commands"] += 1
+	cycle_activity(now, True)
+	if state == "nocomm" or random.random() < timeouts:
+		stats["unanswered"] += 1
+		cycle_activity(now, False)
+		return
+	if personality == "megatec":
+		rsp = megatec_answer(cmd)
+	elif personality == "voltronic":
+		rsp = voltronic_answer(cmd)
+	elif personality == "apcsmart":
+		rsp = apc_answer(cmd)
+	else:
+		rsp = xcp_answer(cmd)
+	if verbose:
+		print("%.3f: %s -> %s" % (now - start_time, describe(cmd), "(none)" if not rsp else describe(rsp)))
+	if not rsp:
+		cycle_activity(now, False)
+		return
+	rsp = to_bytes(rsp)
+	if random.random() < garbage:
+		# any byte but the last one, so that the driver doesn't wait for more
+		i = random.randrange(max(1, len(rsp) - 1))
+		rsp[i] = (rsp[i] + random.randint(1, 255)) & 0xff
+		stats["garbled"] += 1
+	stats["responses"] += 1
+	# the command takes its time on the line too
+	received = 10.0 * len(cmd) / baud if baud else 0.0
+	queue_bytes(rsp, received + latency + random.uniform(0, jitter), True)
+
+def serve(link):
+	import pty
+	import tty
+
+	master, slavefd = pty.openpty()
+	tty.setraw(slavefd)
+	if os.path.lexists(link):
+		os.unlink(link)
+	os.symlink(os.ttyname(slavefd), link)
+	print("%s UPS on %s (%s), %s baud" % (personality, link, os.ttyname(slavefd), baud or "unpaced"))
+	sys.stdout.flush()
+
+	events = list(script)
+	offset = 0.0
+	buf = bytearray()
+	try:
+		while True:
+			now = time.time()
+			while events and offset + events[0][0] <= now - start_time:
+				set_state(events.pop(0)[1])
+				if not events and repeat:
+					offset += script[-1][0]
+					events = list(script)
+
+			timeout = None
+			if output:
+				timeout = max(0, output[0][0] - now)
+			if events:
+				next_event = max(0, start_time + offset + events[0][0] - now)
+				timeout = next_event if timeout is None else min(timeout, next_event)
+
+			if select.select([master], [], [], timeout)[0]:
+				data = bytearray(os.read(master, 1024))
+				stats["bytes_in"] += len(data)
+				now = time.time()
+				if personality == "apcsmart":
+					cmds = [chr(b) for b in data]
+				elif personality == "bcmxcp":
+					buf += data
+					cmds, buf = split_xcp(buf)
+				else:
+					buf += data
+					cmds, buf = split_lines(buf)
+				for cmd in cmds:
+					process(cmd, now)
+
+			now = time.time()
+			n = 0
+			while n < len(output) and output[n][0] <= now:
+				n += 1
+			if n:
+				os.write(master, bytes(bytearray(o[1] for o in output[:n])))
+				stats["bytes_out"] += n
+				for o in output[:n]:
+					if o[2]:
+						cycle_activity(now, False)
+				del output[:n]
+	finally:
+		os.unlink(link)
+
+def print_stats(signum=None, frame=None):
+	if cycle is not None:
+		cycles.append(cycle)
+	print("commands: %(commands)u, responses: %(responses)u, unknown: %(unknown)u, "
+		"unanswered: %(unanswered)u, garbled: %(garbled)u, alerts: %(alerts)u, "
+		"bytes in: %(bytes_in)u, bytes out: %(bytes_out)u, state changes: %(states)u" % stats)
+	# the first cycle is the driver startup, the others its updates
+	line = "cycles: %u" % len(cycles)
+	if cycles:
+		line += ", startup: %u commands in %.3f s" % (cycles[0][2], cycles[0][1] - cycles[0][0])
+	if len(cycles) > 1:
+		updates = cycles[1:]
+		line += ", update: %.1f commands in %.3f s, max %.3f s" % (
+			float(sum(c[2] for c in updates)) / len(updates),
+			sum(c[1] - c[0] for c in updates) / len(updates),
+			max(c[1] - c[0] for c in updates))
+	print(line)
+	sys.stdout.flush()
+	if signum is not None:
+		raise SystemExit(0)
+
+def main():
+	global personality, state, script, repeat, baud, latency, jitter, garbage, timeouts, cycle_gap, verbose
+
+	tablefile = None
+
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "hp:T:s:S:rb:l:j:g:t:G:v",
+			["help", "personality=", "table=", "state=", "script=", "repeat", "baud=",
+			"latency=", "jitter=", "garbage=", "timeouts=", "cycle-gap=", "verbose"])
+	except getopt.GetoptError as err:
+		print(err)
+		usage()
+		sys.exit(2)
+
+	for o, a in opts:
+		if o in ("-h", "--help"):
+			usage()
+			sys.exit(0)
+		elif o in ("-p", "--personality"):
+			personality = a
+		elif o in ("-T", "--table"):
+			tablefile = a
+		elif o in ("-s", "--state"):
+			state = a
+		elif o in ("-S", "--script"):
+			try:
+				script = parse_script(a)
+			except ValueError as err:
+				print("Invalid script: %s" % err)
+				sys.exit(2)
+		elif o in ("-r", "--repeat"):
+			repeat = True
+		elif o in ("-b", "--baud"):
+			baud = int(a)
+		elif o in ("-l", "--latency"):
+			latency = float(a) / 1000
+		elif o in ("-j", "--jitter"):
+			jitter = float(a) / 1000
+		elif o in ("-g", "--garbage"):
+			garbage = float(a)
+		elif o in ("-t", "--timeouts"):
+			timeouts = float(a)
+		elif o in ("-G", "--cycle-gap"):
+			cycle_gap = float(a) / 1000
+		elif o in ("-v", "--verbose"):
+			verbose += 1
+
+	if personality not in PERSONALITIES or state not in STATES or len(args) != 1:
+		usage()
+		sys.exit(2)
+	if repeat and (not script or script[-1][0] <= 0):
+		print("--repeat needs a script")
+		sys.exit(2)
+	if baud is None:
+		baud = PERSONALITIES[personality]
+
+	if personality in ("megatec", "voltronic"):
+		if tablefile is None:
+			tablefile = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "drivers",
+				"nutdrv_qx_%s.c" % personality)
+		if os.path.exists(tablefile):
+			print("%u answers from %s" % (load_table(tablefile), tablefile))
+
+	signal.signal(signal.SIGINT, print_stats)
+	signal.signal(signal.SIGTERM, print_stats)
+
+	serve(args[0])
+
+if __name__ == '__main__':
+	main()
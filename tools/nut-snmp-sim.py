@@ -0,0 +1,1182 @@
+#!/usr/bin/env python
+#   Copyright (C) 2017 - Dmitry Togushev <jtprofacc@gmain.com>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program; if not, write to the Free Software
+#   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+# This program simulates the SNMP agent of a UPS, PDU or ATS network card,
+# for testing and benchmarking the snmp-ups driver and its MIB-to-NUT
+# mappings without the hardware. It answers GET, GETNEXT, GETBULK and SET
+# requests over UDP on localhost, with SNMP v1, v2c and v3 (noAuthNoPriv
+# only), from an OID tree that is either:
+#
+# - loaded from an 'snmpwalk -On' dump:
+#
+#	.1.3.6.1.2.1.33.1.1.1.0 = STRING: "EATON"
+#	.1.3.6.1.2.1.33.1.2.1.0 = INTEGER: batteryNormal(2)
+#
+# - or built from a snmp-ups mapping (drivers/*-mib.c): each OID of the
+#   mapping gets the value of its NUT variable in a dummy-ups device file
+#   (such as data/epdu-managed.dev), converted back through the lookup
+#   tables and multipliers of the mapping, or a default value. Daisychained
+#   devices, outlets and outlet groups are laid out as the driver expects.
+#
+# Response latency, jitter and dropped requests can be added to exercise the
+# driver timeouts and retries. Requests in flight are served concurrently.
+
+from __future__ import print_function
+
+import bisect
+import getopt
+import glob
+import heapq
+import os
+import random
+import re
+import select
+import signal
+import socket
+import sys
+import time
+
+# BER tags
+ASN_INTEGER = 0x02
+ASN_OCTET_STR = 0x04
+ASN_NULL = 0x05
+ASN_OBJECT_ID = 0x06
+ASN_SEQUENCE = 0x30
+ASN_IPADDRESS = 0x40
+ASN_COUNTER = 0x41
+ASN_GAUGE = 0x42
+ASN_TIMETICKS = 0x43
+ASN_OPAQUE = 0x44
+ASN_COUNTER64 = 0x46
+SNMP_NOSUCHOBJECT = 0x80
+SNMP_NOSUCHINSTANCE = 0x81
+SNMP_ENDOFMIBVIEW = 0x82
+
+# PDU types
+SNMP_MSG_GET = 0xa0
+SNMP_MSG_GETNEXT = 0xa1
+SNMP_MSG_RESPONSE = 0xa2
+SNMP_MSG_SET = 0xa3
+SNMP_MSG_GETBULK = 0xa5
+SNMP_MSG_INFORM = 0xa6
+SNMP_MSG_TRAP2 = 0xa7
+SNMP_MSG_REPORT = 0xa8
+
+# error status
+SNMP_ERR_TOOBIG = 1
+SNMP_ERR_NOSUCHNAME = 2
+SNMP_ERR_NOTWRITABLE = 17
+
+SNMP_VERSION_1 = 0
+SNMP_VERSION_2c = 1
+SNMP_VERSION_3 = 3
+
+# msgFlags
+SNMP_MSG_FLAG_AUTH = 0x01
+SNMP_MSG_FLAG_PRIV = 0x02
+SNMP_MSG_FLAG_RPRT = 0x04
+
+SYS_UPTIME = (1, 3, 6, 1, 2, 1, 1, 3, 0)
+SNMP_TRAP_OID = (1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0)
+# NET-SNMP-EXAMPLES-MIB::netSnmpExampleHeartbeatNotification
+SIM_TRAP_OID = (1, 3, 6, 1, 4, 1, 8072, 2, 3, 0, 1)
+USM_STATS_UNSUPPORTED_SECLEVELS = (1, 3, 6, 1, 6, 3, 15, 1, 1, 1, 0)
+USM_STATS_UNKNOWN_USERNAMES = (1, 3, 6, 1, 6, 3, 15, 1, 1, 3, 0)
+USM_STATS_UNKNOWN_ENGINEIDS = (1, 3, 6, 1, 6, 3, 15, 1, 1, 4, 0)
+
+# net-snmp enterprise, text format
+ENGINE_ID = bytearray(b'\x80\x00\x1f\x88\x04nut-snmp-sim')
+
+tree = {}
+oids = []
+port = 1161
+community = "public"
+user = None
+latency = 0.0
+jitter = 0.0
+drops = 0.0
+max_size = 1472
+walk_gap = 0.5
+verbose = 0
+start_time = time.time()
+
+# traps: destination port, event OID and its two values, period, informs
+trap_port = None
+event = None
+trap_every = 5.0
+inform = False
+trap_reqid = 0x10000
+
+# driver socket watched for the variable the traps change
+watch = None
+watch_var = "ups.status"
+watch_value = None
+watch_buf = bytearray()
+# time of the last trap not seen on the driver socket yet
+trap_sent = None
+trap_latencies = []
+informs = {}
+
+stats = { "requests": 0, "responses": 0, "dropped": 0, "errors": 0, "varbinds": 0,
+	"get": 0, "getnext": 0, "getbulk": 0, "set": 0, "reports": 0, "ignored": 0,
+	"traps": 0, "acks": 0 }
+
+# bursts of requests (start, end, requests), separated by walk_gap of
+# silence from the driver, while no response is pending
+walks = []
+walk = None
+inflight = 0
+
+def usage():
+	print("Usage: nut-snmp-sim.py [options] (--walk <file> | --mib <name> | --dev <file>)")
+	print("")
+	print("  -w, --walk <file>        serve an 'snmpwalk -On' dump")
+	print("  -m, --mib <name>         serve the snmp-ups mapping with this name (see --list)")
+	print("  -f, --dev <file>         take the values of the mapping from a dummy-ups .dev file")
+	print("                           (the mapping defaults to the one named in driver.version.internal)")
+	print("  -M, --mib-dir <dir>      where the *-mib.c mappings are (default: ../drivers)")
+	print("  -L, --list               list the mappings, and exit")
+	print("  -n, --devices <n>        daisychained devices, for the mappings supporting it (default: 1)")
+	print("  -o, --outlets <n>        outlets per device (default: 8)")
+	print("  -g, --groups <n>         outlet groups per device (default: 2)")
+	print("  -p, --port <port>        UDP port on localhost (default: 1161)")
+	print("  -c, --community <name>   SNMP v1 and v2c community (default: public)")
+	print("  -u, --user <name>        SNMP v3 security name (default: any)")
+	print("  -s, --max-size <bytes>   largest response, GETBULK responses are truncated to it (default: 1472)")
+	print("  -l, --latency <ms>       delay before each response (default: 0)")
+	print("  -j, --jitter <ms>        random extra delay, up to <ms> (default: 0)")
+	print("  -d, --drops <rate>       ratio of requests left unanswered (default: 0)")
+	print("  -G, --walk-gap <ms>      silence ending a walk of the driver, keep it above the")
+	print("                           driver timeout when dropping requests (default: 500)")
+	print("  -v, --verbose            log requests and responses")
+	print("")
+	print("  -t, --trap <port>        send SNMP v2c traps to 127.0.0.1:<port> (the driver snmp_trap_listen)")
+	print("  -e, --event <oid>=<val>  OID the traps carry, switched between its value and <val> by each trap")
+	print("  -i, --trap-every <s>     period of the traps (default: 5)")
+	print("  -I, --inform             send informs instead of traps, and count their acknowledgements")
+	print("  -W, --watch <socket>     time the change of the variable on this driver socket after each trap")
+	print("      --watch-var <name>   variable watched (default: ups.status)")
+	print("")
+	print("Statistics are printed on exit (SIGINT or SIGTERM).")
+
+def to_bytes(s):
+	if isinstance(s, bytearray):
+		return s
+	try:
+		return bytearray(s, 'utf-8')
+	except TypeError:
+		return bytearray(s)
+
+def oid_str(oid):
+	return "." + ".".join(str(n) for n in oid)
+
+def str_oid(s):
+	return tuple(int(n) for n in s.strip().strip('.').split('.'))
+
+#
+# BER encoding and decoding
+#
+
+def ber_len(n):
+	if n < 0x80:
+		return bytearray([n])
+	b = bytearray()
+	while n:
+		b.insert(0, n & 0xff)
+		n >>= 8
+	return bytearray([0x80 | len(b)]) + b
+
+def ber_tlv(tag, content):
+	return bytearray([tag]) + ber_len(len(content)) + content
+
+def ber_int_content(n):
+	b = bytearray()
+	while True:
+		b.insert(0, n & 0xff)
+		n >>= 8
+		if (n == 0 and not b[0] & 0x80) or (n == -1 and b[0] & 0x80):
+			return b
+
+def ber_int(n, tag=ASN_INTEGER):
+	return ber_tlv(tag, ber_int_content(n))
+
+def ber_subid(n):
+	b = bytearray([n & 0x7f])
+	n >>= 7
+	while n:
+		b.insert(0, 0x80 | (n & 0x7f))
+		n >>= 7
+	return b
+
+def ber_oid_content(oid):
+	if len(oid) < 2:
+		oid = tuple(oid) + (0, 0)
+	b = ber_subid(40 * oid[0] + oid[1])
+	for n in oid[2:]:
+		b += ber_subid(n)
+	return b
+
+def ber_oid(oid):
+	return ber_tlv(ASN_OBJECT_ID, ber_oid_content(oid))
+
+def ber_read(data, pos):
+	if pos + 2 > len(data):
+		raise ValueError("truncated")
+	tag = data[pos]
+	n = data[pos + 1]
+	pos += 2
+	if n & 0x80:
+		k = n & 0x7f
+		if k > 4 or pos + k > len(data):
+			raise ValueError("bad length")
+		n = 0
+		for i in range(k):
+			n = (n << 8) | data[pos + i]
+		pos += k
+	if pos + n > len(data):
+		raise ValueError("truncated")
+	return tag, data[pos:pos + n], pos + n
+
+def ber_items(data):
+	items = []
+	pos = 0
+	while pos < len(data):
+		tag, value, pos = ber_read(data, pos)
+		items.append((tag, value))
+	return items
+
+def dec_int(b):
+	n = 0
+	for c in b:
+		n = (n << 8) | c
+	if b and b[0] & 0x80:
+		n -= 1 << (8 * len(b))
+	return n
+
+def dec_oid(b):
+	subids = []
+	n = 0
+	for c in b:
+		n = (n << 7) | (c & 0x7f)
+		if not c & 0x80:
+			subids.append(n)
+			n = 0
+	if not subids:
+		return ()
+	first = subids[0]
+	if first < 80:
+		head = (first // 40, first % 40)
+	else:
+		head = (2, first - 80)
+	return head + tuple(subids[1:])
+
+#
+# OID tree
+#
+
+def set_value(oid, tag, content, replace=True):
+	if oid not in tree:
+		bisect.insort(oids, oid)
+	elif not replace:
+		return
+	tree[oid] = (tag, content)
+
+def get_value(oid):
+	if oid == SYS_UPTIME:
+		return (ASN_TIMETICKS, ber_int_content(int((time.time() - start_time) * 100)))
+	return tree.get(oid)
+
+def next_oid(oid):
+	i = bisect.bisect_right(oids, oid)
+	if i < len(oids):
+		return oids[i]
+	return None
+
+def value_int(n, tag=ASN_INTEGER):
+	return (tag, ber_int_content(n))
+
+def value_str(s):
+	return (ASN_OCTET_STR, to_bytes(s))
+
+def unquote(s):
+	return re.sub(r'\\(.)', r'\1', s)
+
+# snmpwalk -On output, one variable per line except for multi-line strings
+WALK_RE = re.compile(r'^(\.?[0-9]+(?:\.[0-9]+)+)\s+=\s+(.*)$')
+
+def parse_walk_value(text):
+	if text == '""':
+		return value_str("")
+	if ': ' not in text:
+		if text.startswith('"'):
+			return value_str(unquote(text[1:-1]))
+		return None
+	vtype, v = text.split(': ', 1)
+	v = v.strip()
+	if vtype == "STRING":
+		if v.startswith('"') and v.endswith('"') and len(v) >= 2:
+			v = unquote(v[1:-1])
+		return value_str(v)
+	if vtype == "Hex-STRING":
+		return (ASN_OCTET_STR, bytearray(int(x, 16) for x in v.split()))
+	if vtype == "INTEGER":
+		m = re.search(r'\((-?[0-9]+)\)$', v)
+		return value_int(int(m.group(1) if m else v.split()[0]))
+	if vtype in ("Gauge32", "Counter32", "Counter64", "Timeticks", "UInteger32"):
+		m = re.match(r'\(([0-9]+)\)', v)
+		n = int(m.group(1) if m else v.split()[0])
+		tag = { "Gauge32": ASN_GAUGE, "UInteger32": ASN_GAUGE, "Counter32": ASN_COUNTER,
+			"Counter64": ASN_COUNTER64, "Timeticks": ASN_TIMETICKS }[vtype]
+		return value_int(n, tag)
+	if vtype == "OID":
+		return (ASN_OBJECT_ID, ber_oid_content(str_oid(v)))
+	if vtype in ("IpAddress", "Network Address"):
+		return (ASN_IPADDRESS, bytearray(int(x) for x in v.replace(':', '.').split('.')))
+	return None
+
+def load_walk(filename):
+	f = open(filename, 'r')
+	entries = []
+	for line in f:
+		line = line.rstrip('\r\n')
+		m = WALK_RE.match(line)
+		if m:
+			entries.append([m.group(1), m.group(2)])
+		elif entries:
+			# continuation of a multi-line string or Hex-STRING
+			sep = ' ' if entries[-1][1].startswith("Hex-STRING") else '\n'
+			entries[-1][1] += sep + line
+	f.close()
+
+	for name, text in entries:
+		value = parse_walk_value(text.strip())
+		if value is None:
+			if verbose:
+				print("%s: unsupported value '%s', skipped" % (name, text))
+			continue
+		set_value(str_oid(name), value[0], value[1])
+
+#
+# snmp-ups mappings (drivers/*-mib.c)
+#
+
+C_TOKEN_RE = re.compile(r'"(?:\\.|[^"\\])*"|[A-Za-z_][A-Za-z0-9_]*|[0-9][0-9A-Za-z.]*|\S')
+C_COMMENT_RE = re.compile(r'//[^\n]*|/\*.*?\*/|("(?:\\.|[^"\\])*")', re.S)
+C_IDENT_RE = re.compile(r'^[A-Za-z_][A-Za-z0-9_]*$')
+
+# flags and sizes from snmp-ups.h are kept as names
+def is_su_name(name):
+	return name.startswith("SU_") or name.startswith("ST_FLAG_")
+
+def preprocess(filename, mibdir, defines, seen):
+	f = open(filename, 'r')
+	text = f.read()
+	f.close()
+
+	text = C_COMMENT_RE.sub(lambda m: m.group(1) or ' ', text)
+	text = text.replace('\\\n', ' ')
+
+	out = []
+	stack = []
+	for line in text.split('\n'):
+		s = line.strip()
+		if s.startswith('#'):
+			words = s[1:].split()
+			d = words[0] if words else ""
+			if d in ("if", "ifdef", "ifndef"):
+				arg = words[1] if len(words) > 1 else ""
+				stack.append(not ((d == "if" and arg == "0") or (d == "ifdef" and arg == "DEBUG")))
+			elif d == "elif" and stack:
+				stack[-1] = False
+			elif d == "else" and stack:
+				stack[-1] = not stack[-1]
+			elif d == "endif" and stack:
+				stack.pop()
+			elif not all(stack):
+				pass
+			elif d == "include" and len(words) > 1 and words[1].startswith('"'):
+				header = os.path.join(mibdir, words[1].strip('"'))
+				if header.endswith("-mib.h") and header not in seen and os.path.exists(header):
+					seen.add(header)
+					preprocess(header, mibdir, defines, seen)
+			elif d == "define" and len(words) > 1:
+				m = re.match(r'\s*#\s*define\s+([A-Za-z_][A-Za-z0-9_]*)(\(?)(.*)$', s)
+				if m and not m.group(2) and not is_su_name(m.group(1)):
+					defines[m.group(1)] = C_TOKEN_RE.findall(m.group(3))
+			continue
+		if all(stack):
+			out.append(line)
+	return C_TOKEN_RE.findall('\n'.join(out))
+
+def expand(tokens, defines, depth=0):
+	out = []
+	for t in tokens:
+		if t in defines and depth < 16:
+			out.extend(expand(defines[t], defines, depth + 1))
+		else:
+			out.append(t)
+	return out
+
+# evaluate an initializer field: string, number, table reference, set of
+# flag names, or None
+def evaluate(tokens, defines):
+	tokens = expand(tokens, defines)
+	if not tokens or tokens == ["NULL"]:
+		return None
+	if all(t.startswith('"') for t in tokens):
+		return "".join(unquote(t[1:-1]) for t in tokens)
+	if '&' in tokens:
+		return ("ref", tokens[tokens.index('&') + 1])
+	s = "".join(t for t in tokens if t not in ("(", ")"))
+	try:
+		return float(int(s, 0))
+	except ValueError:
+		pass
+	try:
+		return float(s)
+	except ValueError:
+		pass
+	names = set(t for t in tokens if C_IDENT_RE.match(t))
+	if len(names) == 1 and '|' not in tokens:
+		return ("ref", names.pop()) if not is_su_name(s) else set([s])
+	return names
+
+# parse a brace initializer, return its fields (token lists or nested lists)
+def parse_init(tokens, i):
+	fields = []
+	cur = []
+	i += 1
+	while i < len(tokens):
+		t = tokens[i]
+		if t == '{':
+			sub, i = parse_init(tokens, i)
+			cur = sub
+			continue
+		if t == '}':
+			if cur != []:
+				fields.append(cur)
+			return fields, i + 1
+		if t == ',':
+			fields.append(cur)
+			cur = []
+		else:
+			cur.append(t)
+		i += 1
+	return fields, i
+
+class Mapping(object):
+	pass
+
+def load_mib_file(filename, mibdir):
+	defines = {}
+	tokens = preprocess(filename, mibdir, defines, set([os.path.abspath(filename)]))
+	lookups = {}
+	infos = {}
+	mappings = []
+
+	i = 0
+	while i < len(tokens):
+		t = tokens[i]
+		if t not in ("info_lkp_t", "snmp_info_t", "mib2nut_info_t"):
+			i += 1
+			continue
+		name = tokens[i + 1]
+		j = i + 2
+		while j < len(tokens) and tokens[j] not in ('=', ';'):
+			j += 1
+		if j >= len(tokens) or tokens[j] != '=' or tokens[j + 1] != '{':
+			i = j
+			continue
+		fields, i = parse_init(tokens, j + 1)
+
+		if t == "info_lkp_t":
+			table = []
+			for entry in fields:
+				if len(entry) < 2 or not isinstance(entry[0], list):
+					continue
+				code = evaluate(entry[0], defines)
+				text = evaluate(entry[1], defines)
+				if isinstance(code, float) and isinstance(text, str) and text != "NULL":
+					table.append((int(code), text))
+			lookups[name] = table
+		elif t == "snmp_info_t":
+			table = []
+			for entry in fields:
+				if len(entry) < 6 or not isinstance(entry[0], list):
+					continue
+				e = [evaluate(x, defines) if isinstance(x, list) and not any(isinstance(y, list) for y in x) else None
+					for x in entry] + [None] * 2
+				if not isinstance(e[0], str):
+					continue
+				info = Mapping()
+				info.info_type = e[0]
+				info.info_flags = e[1] if isinstance(e[1], set) else set()
+				info.info_len = e[2] if isinstance(e[2], float) else 0.0
+				info.OID = e[3] if isinstance(e[3], str) else None
+				info.dfl = e[4] if isinstance(e[4], str) else None
+				info.flags = e[5] if isinstance(e[5], set) else set()
+				info.oid2info = e[6][1] if isinstance(e[6], tuple) else None
+				table.append(info)
+			infos[name] = table
+		else:
+			e = [evaluate(x, defines) for x in fields] + [None] * 7
+			m = Mapping()
+			m.var = name
+			m.mib_name = e[0]
+			m.mib_version = e[1]
+			m.oid_pwr_status = e[2] if isinstance(e[2], str) else None
+			m.oid_auto_check = e[3] if isinstance(e[3], str) else None
+			m.snmp_info = e[4][1] if isinstance(e[4], tuple) else None
+			m.sysOID = e[5] if isinstance(e[5], str) else None
+			m.filename = filename
+			mappings.append(m)
+
+	for m in mappings:
+		m.infos = infos.get(m.snmp_info, [])
+		m.lookups = lookups
+	return mappings
+
+def load_mappings(mibdir):
+	mappings = []
+	for filename in sorted(glob.glob(os.path.join(mibdir, "*-mib.c"))):
+		mappings.extend(m for m in load_mib_file(filename, mibdir) if m.mib_name and m.infos)
+	return mappings
+
+def load_dev(filename):
+	devvars = {}
+	f = open(filename, 'r')
+	for line in f:
+		line = line.strip()
+		if not line or line.startswith('#') or ':' not in line:
+			continue
+		var, value = line.split(':', 1)
+		devvars[var.strip()] = value.strip()
+	f.close()
+	return devvars
+
+def format_template(template, args):
+	for a in args:
+		template = template.replace("%i", str(a), 1)
+	return template
+
+# statuses to pick when the device file doesn't tell
+DEFAULT_STATES = ("OL", "online", "on", "normal", "yes", "ok", "closed")
+
+def synth_value(info, names, devvars, counts, lookups, index):
+	v = None
+	for n in names:
+		if n in devvars:
+			v = devvars[n]
+			break
+	if v is None and names[-1] in counts:
+		return value_int(counts[names[-1]])
+
+	lkp = lookups.get(info.oid2info)
+	if lkp:
+		candidates = [v] if v is not None else []
+		candidates += [info.dfl] + list(DEFAULT_STATES)
+		for c in candidates:
+			for code, text in lkp:
+				if c is not None and text == c:
+					return value_int(code)
+		return value_int(lkp[0][0])
+
+	if v is None and info.dfl:
+		v = info.dfl.replace("%i", str(index))
+
+	if "ST_FLAG_STRING" in info.info_flags:
+		return value_str(v if v is not None else names[0])
+
+	try:
+		f = float(v if v is not None else 1)
+	except ValueError:
+		return value_str(v)
+	mult = info.info_len if info.info_len else 1.0
+	return value_int(int(round(f / mult)))
+
+def build_mapping(m, devvars, ndevices, noutlets, ngroups):
+	daisy = any(info.info_type == "device.count" for info in m.infos)
+	if not daisy:
+		ndevices = 1
+
+	counts = { "device.count": ndevices, "outlet.count": noutlets, "outlet.group.count": ngroups }
+
+	for info in m.infos:
+		if info.OID is None or '%' in info.OID.replace("%i", ""):
+			continue
+
+		instances = []
+		if "%i" in info.info_type:
+			# outlet and outlet group templates, indexed from 1
+			count = ngroups if info.info_type.startswith("outlet.group.") else noutlets
+			for dev in range(ndevices):
+				for idx in range(1, count + 1):
+					if not daisy:
+						args = (idx,)
+					elif "SU_TYPE_DAISY_1" in info.flags:
+						args = (dev, idx)
+					else:
+						args = (idx - 1, dev)
+					name = info.info_type.replace("%i", str(idx))
+					names = [name]
+					if ndevices > 1:
+						names.insert(0, "device.%i.%s" % (dev + 1, name))
+					instances.append((format_template(info.OID, args), names, idx))
+		else:
+			for dev in range(ndevices if "%i" in info.OID else 1):
+				names = [info.info_type]
+				if ndevices > 1 and "%i" in info.OID:
+					var = info.info_type[7:] if info.info_type.startswith("device.") else info.info_type
+					names.insert(0, "device.%i.%s" % (dev + 1, var))
+				instances.append((format_template(info.OID, (dev, dev)), names, dev))
+
+		for OID, names, index in instances:
+			if "SU_TYPE_CMD" in info.flags:
+				value = value_int(0)
+			else:
+				value = synth_value(info, names, devvars, counts, m.lookups, index)
+			# competing entries for the same OID: the first one wins
+			set_value(str_oid(OID), value[0], value[1], False)
+
+	if m.oid_auto_check:
+		set_value(str_oid(m.oid_auto_check), ASN_OCTET_STR, to_bytes(m.mib_name), False)
+	if m.oid_pwr_status:
+		set_value(str_oid(m.oid_pwr_status), ASN_INTEGER, ber_int_content(1), False)
+
+	# system group
+	sysoid = str_oid(m.sysOID) if m.sysOID else (1, 3, 6, 1, 4, 1, 8072, 3, 2, 10)
+	set_value((1, 3, 6, 1, 2, 1, 1, 1, 0), ASN_OCTET_STR,
+		to_bytes("nut-snmp-sim: %s %s" % (m.mib_name, m.mib_version)), False)
+	set_value((1, 3, 6, 1, 2, 1, 1, 2, 0), ASN_OBJECT_ID, ber_oid_content(sysoid), False)
+	set_value(SYS_UPTIME, ASN_TIMETICKS, ber_int_content(0), False)
+	set_value((1, 3, 6, 1, 2, 1, 1, 4, 0), ASN_OCTET_STR, to_bytes("root@localhost"), False)
+	set_value((1, 3, 6, 1, 2, 1, 1, 5, 0), ASN_OCTET_STR, to_bytes("nut-snmp-sim"), False)
+	set_value((1, 3, 6, 1, 2, 1, 1, 6, 0), ASN_OCTET_STR, to_bytes("localhost"), False)
+
+	return daisy
+
+#
+# SNMP agent
+#
+
+def encode_varbinds(varbinds):
+	content = bytearray()
+	for oid, (tag, value) in varbinds:
+		content += ber_tlv(ASN_SEQUENCE, ber_oid(oid) + ber_tlv(tag, value))
+	return ber_tlv(ASN_SEQUENCE, content)
+
+def encode_pdu(tag, reqid, status, index, varbinds):
+	return ber_tlv(tag, ber_int(reqid) + ber_int(status) + ber_int(index) + encode_varbinds(varbinds))
+
+def lookup_next(oid, version):
+	n = next_oid(oid)
+	if n is None:
+		return oid, (SNMP_ENDOFMIBVIEW, bytearray())
+	return n, get_value(n)
+
+# process a PDU, return the response varbinds and error, or None to ignore it
+def process_pdu(version, tag, pdu):
+	items = ber_items(pdu)
+	reqid = dec_int(items[0][1])
+	a = dec_int(items[1][1])
+	b = dec_int(items[2][1])
+	varbinds = []
+	for vtag, vb in ber_items(items[3][1]):
+		name, value = ber_items(vb)[:2]
+		varbinds.append((dec_oid(name[1]), value))
+
+	stats["requests"] += 1
+	stats["varbinds"] += len(varbinds)
+
+	status, index = 0, 0
+	result = []
+
+	if tag == SNMP_MSG_GET:
+		stats["get"] += 1
+		for i, (oid, value) in enumerate(varbinds):
+			v = get_value(oid)
+			if v is None:
+				if version == SNMP_VERSION_1:
+					return reqid, SNMP_ERR_NOSUCHNAME, i + 1, varbinds
+				parent = next_oid(oid[:-1])
+				if parent is not None and parent[:len(oid) - 1] == oid[:-1]:
+					v = (SNMP_NOSUCHINSTANCE, bytearray())
+				else:
+					v = (SNMP_NOSUCHOBJECT, bytearray())
+			result.append((oid, v))
+
+	elif tag == SNMP_MSG_GETNEXT:
+		stats["getnext"] += 1
+		for i, (oid, value) in enumerate(varbinds):
+			n, v = lookup_next(oid, version)
+			if v[0] == SNMP_ENDOFMIBVIEW and version == SNMP_VERSION_1:
+				return reqid, SNMP_ERR_NOSUCHNAME, i + 1, varbinds
+			result.append((n, v))
+
+	elif tag == SNMP_MSG_GETBULK and version != SNMP_VERSION_1:
+		stats["getbulk"] += 1
+		nonrep = max(a, 0)
+		maxrep = max(b, 0)
+		for oid, value in varbinds[:nonrep]:
+			result.append(lookup_next(oid, version))
+		columns = [oid for oid, value in varbinds[nonrep:]]
+		for r in range(maxrep):
+			if not columns:
+				break
+			row = [lookup_next(oid, version) for oid in columns]
+			result.extend(row)
+			if all(v[0] == SNMP_ENDOFMIBVIEW for n, v in row):
+				break
+			columns = [n for n, v in row]
+
+	elif tag == SNMP_MSG_SET:
+		stats["set"] += 1
+		for i, (oid, value) in enumerate(varbinds):
+			if oid not in tree or oid == SYS_UPTIME:
+				if version == SNMP_VERSION_1:
+					return reqid, SNMP_ERR_NOSUCHNAME, i + 1, varbinds
+				return reqid, SNMP_ERR_NOTWRITABLE, i + 1, varbinds
+		for oid, value in varbinds:
+			if verbose:
+				print("set: %s" % oid_str(oid))
+			set_value(oid, value[0], value[1])
+		result = varbinds
+
+	else:
+		stats["ignored"] += 1
+		return None
+
+	return reqid, status, index, result
+
+# build the response message, fitting the PDU within limit bytes
+def respond(wrap, tag, version, rsp, request_varbinds, limit):
+	reqid, status, index, varbinds = rsp
+	if status:
+		stats["errors"] += 1
+	msg = wrap(encode_pdu(SNMP_MSG_RESPONSE, reqid, status, index, varbinds))
+	if len(msg) <= limit:
+		return msg
+
+	if tag == SNMP_MSG_GETBULK:
+		# drop the last repetitions, as agents do
+		while varbinds and len(msg) > limit:
+			varbinds = varbinds[:-1]
+			msg = wrap(encode_pdu(SNMP_MSG_RESPONSE, reqid, status, index, varbinds))
+		return msg
+
+	stats["errors"] += 1
+	return wrap(encode_pdu(SNMP_MSG_RESPONSE, reqid, SNMP_ERR_TOOBIG, 0,
+		request_varbinds if version == SNMP_VERSION_1 else []))
+
+def request_varbinds(pdu):
+	try:
+		items = ber_items(pdu)
+		return [(dec_oid(ber_items(vb)[0][1]), (ASN_NULL, bytearray())) for t, vb in ber_items(items[3][1])]
+	except (ValueError, IndexError):
+		return []
+
+def handle_community(version, items):
+	if bytes(items[1][1]) != bytes(to_bytes(community)):
+		if verbose:
+			print("bad community, ignored")
+		stats["ignored"] += 1
+		return None
+
+	tag, pdu = items[2]
+	if tag == SNMP_MSG_RESPONSE:
+		inform_ack(pdu)
+		return None
+	rsp = process_pdu(version, tag, pdu)
+	if rsp is None:
+		return None
+
+	header = ber_int(version) + ber_tlv(ASN_OCTET_STR, items[1][1])
+	return respond(lambda p: ber_tlv(ASN_SEQUENCE, header + p), tag, version, rsp,
+		request_varbinds(pdu), max_size)
+
+def usm_params(username):
+	boots_time = ber_int(1) + ber_int(int(time.time() - start_time))
+	return ber_tlv(ASN_OCTET_STR, ber_tlv(ASN_SEQUENCE, ber_tlv(ASN_OCTET_STR, ENGINE_ID)
+		+ boots_time + ber_tlv(ASN_OCTET_STR, username)
+		+ ber_tlv(ASN_OCTET_STR, bytearray()) + ber_tlv(ASN_OCTET_STR, bytearray())))
+
+def handle_v3(items):
+	header = ber_items(items[1][1])
+	msgid = dec_int(header[0][1])
+	msgmax = dec_int(header[1][1])
+	flags = header[2][1][0] if len(header[2][1]) else 0
+	if dec_int(header[3][1]) != 3:
+		stats["ignored"] += 1
+		return None
+
+	usm = ber_items(ber_read(items[2][1], 0)[1])
+	engine = usm[0][1]
+	username = usm[3][1]
+
+	def wrap(scoped_pdu, ctxname=bytearray()):
+		return ber_tlv(ASN_SEQUENCE, ber_int(SNMP_VERSION_3)
+			+ ber_tlv(ASN_SEQUENCE, ber_int(msgid) + ber_int(65507)
+				+ ber_tlv(ASN_OCTET_STR, bytearray([0])) + ber_int(3))
+			+ usm_params(username)
+			+ ber_tlv(ASN_SEQUENCE, ber_tlv(ASN_OCTET_STR, ENGINE_ID)
+				+ ber_tlv(ASN_OCTET_STR, ctxname) + scoped_pdu))
+
+	def report(oid):
+		stats["reports"] += 1
+		if not flags & SNMP_MSG_FLAG_RPRT:
+			return None
+		reqid = 0
+		if items[3][0] == ASN_SEQUENCE:
+			try:
+				reqid = dec_int(ber_items(ber_items(items[3][1])[2][1])[0][1])
+			except (ValueError, IndexError):
+				pass
+		return wrap(encode_pdu(SNMP_MSG_REPORT, reqid, 0, 0,
+			[(oid, value_int(stats["reports"], ASN_COUNTER))]))
+
+	# only noAuthNoPriv is simulated
+	if flags & (SNMP_MSG_FLAG_AUTH | SNMP_MSG_FLAG_PRIV):
+		return report(USM_STATS_UNSUPPORTED_SECLEVELS)
+	# engine ID discovery
+	if bytes(engine) != bytes(ENGINE_ID):
+		return report(USM_STATS_UNKNOWN_ENGINEIDS)
+	if user is not None and bytes(username) != bytes(to_bytes(user)):
+		return report(USM_STATS_UNKNOWN_USERNAMES)
+
+	scoped = ber_items(items[3][1])
+	ctxname = scoped[1][1]
+	tag, pdu = scoped[2]
+	rsp = process_pdu(SNMP_VERSION_3, tag, pdu)
+	if rsp is None:
+		return None
+	return respond(lambda p: wrap(p, ctxname), tag, SNMP_VERSION_3, rsp,
+		request_varbinds(pdu), min(max_size, msgmax))
+
+def handle(data):
+	tag, msg, pos = ber_read(data, 0)
+	if tag != ASN_SEQUENCE:
+		raise ValueError("not a sequence")
+	items = ber_items(msg)
+	version = dec_int(items[0][1])
+	if version in (SNMP_VERSION_1, SNMP_VERSION_2c):
+		return handle_community(version, items)
+	if version == SNMP_VERSION_3:
+		return handle_v3(items)
+	stats["ignored"] += 1
+	return None
+
+def walk_activity(now, request):
+	global walk, inflight
+	if request:
+		if walk is not None and inflight == 0 and now - walk[1] > walk_gap:
+			walks.append(walk)
+			walk = None
+		if walk is None:
+			walk = [now, now, 0]
+		walk[2] += 1
+		inflight += 1
+	else:
+		inflight -= 1
+	walk[1] = now
+
+#
+# Traps
+#
+
+def send_trap(sock):
+	global trap_reqid, trap_sent
+	oid, values = event
+	# the first trap sets the event value, the next one restores it, and so on
+	value = values[stats["traps"] % 2]
+	set_value(oid, value[0], value[1])
+	trap_reqid += 1
+	tag = SNMP_MSG_INFORM if inform else SNMP_MSG_TRAP2
+	pdu = encode_pdu(tag, trap_reqid, 0, 0, [(SYS_UPTIME, get_value(SYS_UPTIME)),
+		(SNMP_TRAP_OID, (ASN_OBJECT_ID, ber_oid_content(SIM_TRAP_OID))), (oid, value)])
+	msg = ber_tlv(ASN_SEQUENCE, ber_int(SNMP_VERSION_2c)
+		+ ber_tlv(ASN_OCTET_STR, to_bytes(community)) + pdu)
+	sock.sendto(bytes(msg), ('127.0.0.1', trap_port))
+	trap_sent = time.time()
+	stats["traps"] += 1
+	if inform:
+		informs[trap_reqid] = trap_sent
+	if verbose:
+		print("%.6f %s %u sent to port %u" % (trap_sent, "inform" if inform else "trap",
+			trap_reqid, trap_port))
+
+def inform_ack(pdu):
+	reqid = dec_int(ber_items(pdu)[0][1])
+	sent = informs.pop(reqid, None)
+	if sent is None:
+		stats["ignored"] += 1
+		return
+	stats["acks"] += 1
+	if verbose:
+		print("inform %u acknowledged after %.3f ms" % (reqid, (time.time() - sent) * 1000))
+
+def watch_connect(path):
+	s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+	s.connect(path)
+	# the current value, the driver then sends the changes by itself
+	s.sendall(b"DUMPALL\n")
+	return s
+
+# SETINFO <var> "<value>" lines of the driver socket, return False on EOF
+def watch_read(s, now):
+	global watch_buf, watch_value, trap_sent
+	data = s.recv(4096)
+	if not data:
+		return False
+	watch_buf += data
+	while b"\n" in watch_buf:
+		line, watch_buf = watch_buf.split(b"\n", 1)
+		m = re.match(r'^SETINFO (\S+) "(.*)"$', line.decode("utf-8", "replace"))
+		if m is None or m.group(1) != watch_var or m.group(2) == watch_value:
+			continue
+		watch_value = m.group(2)
+		if trap_sent is None:
+			continue
+		trap_latencies.append(now - trap_sent)
+		if verbose:
+			print("%s: %s, %.3f ms after the trap" % (watch_var, watch_value, (now - trap_sent) * 1000))
+		trap_sent = None
+	return True
+
+def serve(port):
+	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	sock.bind(('127.0.0.1', port))
+	print("SNMP agent on 127.0.0.1:%u, %u OIDs" % (port, len(oids)))
+	sys.stdout.flush()
+
+	wsock = watch_connect(watch) if watch is not None else None
+	next_trap = time.time() + trap_every if trap_port is not None else None
+
+	# responses waiting for their latency: (time, seq, data, address)
+	queue = []
+	seq = 0
+	while True:
+		timeout = None
+		if queue:
+			timeout = max(0, queue[0][0] - time.time())
+		if next_trap is not None:
+			wait = max(0, next_trap - time.time())
+			timeout = wait if timeout is None else min(timeout, wait)
+		ready = select.select([sock] + ([wsock] if wsock else []), [], [], timeout)[0]
+		now = time.time()
+		if wsock in ready and not watch_read(wsock, now):
+			print("driver socket closed")
+			wsock.close()
+			wsock = None
+		if sock in ready:
+			data, addr = sock.recvfrom(65535)
+			acks = stats["acks"]
+			try:
+				rsp = handle(bytearray(data))
+			except (ValueError, IndexError) as err:
+				if verbose:
+					print("malformed request from %s:%u: %s" % (addr[0], addr[1], err))
+				stats["ignored"] += 1
+				rsp = None
+			# the acknowledgements of the informs aren't part of the walks
+			if stats["acks"] != acks:
+				continue
+			walk_activity(now, True)
+			if rsp is None:
+				walk_activity(now, False)
+			else:
+				if random.random() < drops:
+					stats["dropped"] += 1
+					walk_activity(now, False)
+				else:
+					seq += 1
+					heapq.heappush(queue, (now + latency + random.uniform(0, jitter), seq, rsp, addr))
+		while queue and queue[0][0] <= time.time():
+			due, n, rsp, addr = heapq.heappop(queue)
+			sock.sendto(bytes(rsp), addr)
+			stats["responses"] += 1
+			walk_activity(time.time(), False)
+		if next_trap is not None and time.time() >= next_trap:
+			send_trap(sock)
+			next_trap += trap_every
+
+def print_stats(signum=None, frame=None):
+	if walk is not None:
+		walks.append(walk)
+	print("requests: %(requests)u, responses: %(responses)u, dropped: %(dropped)u, "
+		"errors: %(errors)u, varbinds: %(varbinds)u, get: %(get)u, getnext: %(getnext)u, "
+		"getbulk: %(getbulk)u, set: %(set)u, reports: %(reports)u, ignored: %(ignored)u" % stats)
+	# the first walk is the driver startup, the others its updates
+	line = "walks: %u" % len(walks)
+	if walks:
+		line += ", startup: %u requests in %.3f s" % (walks[0][2], walks[0][1] - walks[0][0])
+	if len(walks) > 1:
+		updates = walks[1:]
+		line += ", update: %.1f requests in %.3f s" % (
+			float(sum(w[2] for w in updates)) / len(updates),
+			sum(w[1] - w[0] for w in updates) / len(updates))
+	print(line)
+	if stats["traps"]:
+		line = "traps: %u" % stats["traps"]
+		if inform:
+			line += ", acknowledged: %u" % stats["acks"]
+		if trap_latencies:
+			line += ", %s changed after %u of them, in %.3f/%.3f/%.3f ms (min/avg/max)" % (
+				watch_var, len(trap_latencies), min(trap_latencies) * 1000,
+				sum(trap_latencies) / len(trap_latencies) * 1000, max(trap_latencies) * 1000)
+		print(line)
+	sys.stdout.flush()
+	if signum is not None:
+		raise SystemExit(0)
+
+def find_mapping(mappings, name):
+	for m in mappings:
+		if name in (m.mib_name, m.var):
+			return m
+	return None
+
+def main():
+	global port, community, user, latency, jitter, drops, max_size, walk_gap, verbose
+	global trap_port, event, trap_every, inform, watch, watch_var
+
+	walkfile = None
+	mib = None
+	devfile = None
+	mibdir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "drivers")
+	do_list = False
+	ndevices = 1
+	noutlets = None
+	ngroups = None
+	event_arg = None
+
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "hw:m:f:M:Ln:o:g:p:c:u:s:l:j:d:G:vt:e:i:IW:",
+			["help", "walk=", "mib=", "dev=", "mib-dir=", "list", "devices=", "outlets=", "groups=",
+			"port=", "community=", "user=", "max-size=", "latency=", "jitter=", "drops=",
+			"walk-gap=", "verbose", "trap=", "event=", "trap-every=", "inform", "watch=", "watch-var="])
+	except getopt.GetoptError as err:
+		print(err)
+		usage()
+		sys.exit(2)
+
+	for o, a in opts:
+		if o in ("-h", "--help"):
+			usage()
+			sys.exit(0)
+		elif o in ("-w", "--walk"):
+			walkfile = a
+		elif o in ("-m", "--mib"):
+			mib = a
+		elif o in ("-f", "--dev"):
+			devfile = a
+		elif o in ("-M", "--mib-dir"):
+			mibdir = a
+		elif o in ("-L", "--list"):
+			do_list = True
+		elif o in ("-n", "--devices"):
+			ndevices = int(a)
+		elif o in ("-o", "--outlets"):
+			noutlets = int(a)
+		elif o in ("-g", "--groups"):
+			ngroups = int(a)
+		elif o in ("-p", "--port"):
+			port = int(a)
+		elif o in ("-c", "--community"):
+			community = a
+		elif o in ("-u", "--user"):
+			user = a
+		elif o in ("-s", "--max-size"):
+			max_size = int(a)
+		elif o in ("-l", "--latency"):
+			latency = float(a) / 1000
+		elif o in ("-j", "--jitter"):
+			jitter = float(a) / 1000
+		elif o in ("-d", "--drops"):
+			drops = float(a)
+		elif o in ("-G", "--walk-gap"):
+			walk_gap = float(a) / 1000
+		elif o in ("-v", "--verbose"):
+			verbose += 1
+		elif o in ("-t", "--trap"):
+			trap_port = int(a)
+		elif o in ("-e", "--event"):
+			event_arg = a
+		elif o in ("-i", "--trap-every"):
+			trap_every = float(a)
+		elif o in ("-I", "--inform"):
+			inform = True
+		elif o in ("-W", "--watch"):
+			watch = a
+		elif o == "--watch-var":
+			watch_var = a
+
+	if do_list:
+		for m in load_mappings(mibdir):
+			print("%-20s %-24s %-28s %s" % (m.mib_name, m.var, os.path.basename(m.filename), m.sysOID or ""))
+		sys.exit(0)
+
+	if walkfile is not None:
+		load_walk(walkfile)
+	elif mib is not None or devfile is not None:
+		devvars = load_dev(devfile) if devfile is not None else {}
+		if mib is None:
+			# driver.version.internal: 0.44 (mib: aphel_revelation 0.2)
+			m = re.search(r'\(mib: (\S+)', devvars.get("driver.version.internal", ""))
+			if not m:
+				print("%s doesn't tell the mapping, use --mib" % devfile)
+				sys.exit(2)
+			mib = m.group(1)
+		m = find_mapping(load_mappings(mibdir), mib)
+		if m is None:
+			print("Unknown mapping '%s', see --list" % mib)
+			sys.exit(2)
+		if noutlets is None:
+			noutlets = int(float(devvars.get("outlet.count", 8)))
+		if ngroups is None:
+			ngroups = int(float(devvars.get("outlet.group.count", 2)))
+		if devfile is not None and "device.count" in devvars:
+			ndevices = int(float(devvars["device.count"]))
+		daisy = build_mapping(m, devvars, ndevices, noutlets, ngroups)
+		print("Mapping %s (%s, %s), %u device(s), %u outlet(s), %u group(s)" % (m.mib_name, m.var,
+			os.path.basename(m.filename), ndevices if daisy else 1, noutlets, ngroups))
+	else:
+		usage()
+		sys.exit(2)
+
+	if trap_port is not None:
+		if event_arg is None or "=" not in event_arg:
+			print("--trap needs an --event <oid>=<value>")
+			sys.exit(2)
+		name, text = event_arg.split("=", 1)
+		oid = str_oid(name)
+		served = get_value(oid)
+		if served is None:
+			print("%s isn't served" % name)
+			sys.exit(2)
+		# keep the type of the served value
+		if served[0] == ASN_OCTET_STR:
+			value = value_str(text)
+		else:
+			value = value_int(int(text), served[0])
+		event = (oid, [value, served])
+
+	signal.signal(signal.SIGINT, print_stats)
+	signal.signal(signal.SIGTERM, print_stats)
+
+	serve(port)
+
+if __name__ == '__main__':
+	main()